@@ -50,19 +50,69 @@
  * Changes frequency and voltage via the cpufreq kernel interface and writes 
  * to /sys/devices/system/cpu/cpu<nr>/cpufreq/scaling_[governor|setspeed]
  * These files should be accessible and writable for the user!
+ * If a cpufreq policy does not support the userspace governor (e.g., with
+ * intel_pstate or amd-pstate), the frequency is pinned via scaling_min_freq
+ * and scaling_max_freq instead and the active governor is kept.
+ * Every cpufreq policy has its own table of available frequencies, requested
+ * frequencies are snapped to the nearest available one.
+ * All CPUs of a cpufreq policy (see related_cpus) share one frequency, which
+ * is written once per policy. If threads on these CPUs request different
+ * frequencies, the top-level setting dvfs_domain_policy selects the result:
+ * "last" (default, the last request wins), "max", or "min".
+ * With the top-level setting dvfs_backend = "msr", the frequency ratio is
+ * written to IA32_PERF_CTL via /dev/cpu/<nr>/msr instead of sysfs. This
+ * requires the msr kernel module and an Intel processor and is only used for
+ * cpufreq policies with the userspace governor (an Intel processor is
+ * detected from the vendor_id in /proc/cpuinfo). The original register values
+ * are restored when libadapt is closed, as are the original governors,
+ * scaling_min_freq, and scaling_max_freq. All files are accessed below
+ * sysfs_root.
  * @subsubsection dct Concurrency Throttling
  * Changes the number of OpenMP threads. This should only be used outside of
  * parallel regions (e.g., before the region is started)
  * The OpenMP parallel program should also be linked dynamically.
- * @bug changing the number of threads leads to a situation where some CPUs are
+ * Changing the number of threads leads to a situation where some CPUs are
  * not used anymore. However their frequency settings can still be taken into
  * account by the OS. If the number of threads is first reduced and afterwards
  * the frequency of the active CPUs is reduced, some CPUs still have a high
  * frequency. The processor or OS is then free to use this high frequency also
  * for the still active CPUs.
+ * To avoid this, the top-level settings dct_idle_freq (kHz) and dct_idle_csl
+ * (deepest allowed C-state) are applied to CPUs that become idle when the
+ * number of threads is reduced. Their former settings are restored when the
+ * number of threads grows again. The threads are assumed to run on the first
+ * CPUs of the affinity mask that the process has when libadapt is opened
+ * (e.g., with OMP_PROC_BIND=close). CPUs that share a cpufreq policy with
+ * active CPUs are not down-clocked.
+ * Instead of dct_threads_before, regions (or the defaults of a binary) can
+ * set dct_tune = 1 to select the number of threads online. The first
+ * invocations of each region are run with different numbers of threads,
+ * selected by a golden-section search between 1 and the maximal number of
+ * threads. Each number of threads is measured dct_tune_samples times
+ * (default 3) after one invocation that is not counted. Afterwards, the
+ * number with the lowest runtime is used, or the lowest energy with
+ * dct_tune_metric = "energy" (read from
+ * /sys/class/powercap/intel-rapl:<nr>/energy_uj). If the top-level setting
+ * dct_tune_dir is set, the results are stored in
+ * <dct_tune_dir>/<program name>.dct when libadapt is closed and used directly
+ * by later runs. Regions are identified by their names, regions without a
+ * name are tuned, but not stored.
+ * @subsubsection omp_sched OpenMP Schedule and Wait Policy
+ * Changes the schedule of loops with schedule(runtime) via omp_set_schedule
+ * (omp_schedule_*: "static", "dynamic", "guided", or "auto", omp_chunk_*: the
+ * chunk size, 0 for the default) and, if the OpenMP runtime provides
+ * kmp_set_blocktime (e.g., the LLVM or Intel runtime), the time in ms that
+ * idle threads spin before they sleep (omp_blocktime_*). Like the number of
+ * threads, these settings are applied by the primary thread and only if they
+ * change.
  * @subsubsection x86_adapt Hardware Changes
  * Allows to change hardware prefetcher settings or C-state specifications.
  * see https://github.com/tud-zih-energy/x86_adapt
+ * x86_adapt_<item>_before/after changes the CPU device of the current CPU or,
+ * for die items, the die device that contains it.
+ * x86_adapt_<item>_all_before/after changes all devices of the item type.
+ * All settings of a region are applied, and a value is only written if it
+ * differs from the last value libadapt has written to this device and item.
  * @subsubsection csl C state limit
  * Change the C-state limit by disabling certain C-states via writes to 
  * /sys/devices/system/cpu/cpu<nr>/cpuidle/state<id>/disable
@@ -70,18 +120,205 @@
  * these fancy papers:
  *    -  Wake-up latencies for processor idle states on current x86 processors (Schoene et al.)
  *    -  An Energy Efficiency Feature Survey of the Intel Haswell Processor (Hackenberg et al.)
+ *
+ * Only the states that change are written. With the top-level setting
+ * csl_backend = "pm_qos", the limit is applied with a single write to
+ * /sys/devices/system/cpu/cpu<nr>/power/pm_qos_resume_latency_us instead,
+ * which allows all states with a wake-up latency up to the one of the limit.
+ * The original settings are restored when libadapt is closed.
+ * @subsubsection epp Energy Performance Preference
+ * Changes the energy performance preference of HWP via
+ * /sys/devices/system/cpu/cpu<nr>/cpufreq/energy_performance_preference
+ * and the energy performance bias via
+ * /sys/devices/system/cpu/cpu<nr>/power/energy_perf_bias
+ * The hardware still selects the frequency, but prefers energy efficiency
+ * or performance. Values are only written if they change and the original
+ * values are restored when libadapt is closed.
+ * @subsubsection uncore Uncore Frequency
+ * Changes the minimal and maximal uncore frequency of the package and die of
+ * the current CPU via
+ * /sys/devices/system/cpu/intel_uncore_frequency/package_<nr>_die_<nr>/[min|max]_freq_khz
+ * Values are only written if they change and the original values are
+ * restored when libadapt is closed.
+ * @subsubsection placement Thread Placement
+ * Binds the threads of the process to CPUs via sched_setaffinity when a region
+ * is entered. Every thread that enters the region binds itself, the thread
+ * with OpenMP thread number i to the i-th CPU of the process affinity mask in
+ * the order of the policy: "compact" (hardware
+ * threads of a core, then the cores of a die and package), "scatter" (one CPU
+ * per core, alternating between packages), "one_per_core" (one CPU per core
+ * before the second hardware threads are used), or "no_smt" (all threads may
+ * run on the first hardware thread of every core). "original" restores the
+ * masks the threads had before. Threads that do not enter the region, e.g.,
+ * helper threads of the OpenMP runtime, are not bound. Thus, the region should
+ * be entered by all threads of the team, e.g., via the OMPT frontend. If only
+ * placement_before is given, the original masks are restored when the region
+ * is exited. The mask of a thread is only changed if its policy or OpenMP
+ * thread number changed and the original masks are restored when libadapt is
+ * closed.
+ * @subsubsection msr Model Specific Registers
+ * Changes model specific registers via /dev/cpu/<nr>/msr (requires the msr
+ * kernel module), e.g., the prefetchers in MSR 0x1A4 on nodes without
+ * x86_adapt. Every msr_<nr> entry writes the bits of mask (default: all bits)
+ * of the register at address with a read-modify-write. Only 0x1A4, 0x1B0,
+ * and 0x19A can be written, further registers have to be allowed at build
+ * time with -DMSR_ALLOWLIST=..., not in the config file. A register is only
+ * read when it is changed first. Later values are computed from the last
+ * written value and only written if they change. Entries for the same
+ * register are merged into one write. The original values are restored when
+ * libadapt is closed.
+ * @subsubsection clock_mod Clock Modulation
+ * Sets the duty cycle of the clock (T-state) of a CPU via
+ * IA32_CLOCK_MODULATION (MSR 0x19A, requires the msr kernel module).
+ * clock_mod_before/after is the duty cycle in percent, which is rounded to
+ * steps of 12.5 % (or 6.25 % if the processor supports the extended
+ * resolution). 100 disables clock modulation. Values are only written if they
+ * change and the original values are restored when libadapt is closed.
+ * @subsubsection uclamp Utilization Clamping
+ * Sets the utilization clamps of threads via sched_setattr (uclamp_min_* and
+ * uclamp_max_*, 0 to 1024). With the schedutil governor, the frequency of a
+ * CPU follows the clamped utilization of its threads. The clamps are applied
+ * to the calling thread, or to all threads of the process with
+ * uclamp_all_threads = 1 (only by the primary thread of an OpenMP team). A
+ * minimum above the maximum is lowered to the maximum. The current clamps of
+ * every thread are cached, so unchanged clamps are not written. The original
+ * clamps are restored when libadapt is closed, threads with the default
+ * clamps (0 and 1024) follow the system defaults again (Linux 5.11 or
+ * later). The kernel has to support utilization clamping
+ * (CONFIG_UCLAMP_TASK), which is detected via
+ * /proc/sys/kernel/sched_util_clamp_max below sysfs_root.
+ * @subsubsection sched_policy Scheduling Policy and Timer Slack
+ * Sets the scheduling policy (sched_policy_*: other, batch, idle, fifo or
+ * rr), the realtime priority of fifo and rr (sched_priority_*, 1 to 99), the
+ * nice value (sched_nice_*) and the timer slack in ns (sched_timerslack_*)
+ * via sched_setattr and PR_SET_TIMERSLACK. The settings are applied to the
+ * calling thread, or to all threads of the process with
+ * sched_all_threads = 1 (only by the primary thread of an OpenMP team). If
+ * no *_after setting is given, the previous settings are restored on exit.
+ * Unchanged settings are not written. The original settings are restored
+ * when libadapt is closed.
+ * @subsubsection resctrl Cache and Memory Bandwidth Allocation
+ * Moves threads between resctrl groups by writing their thread ids to the
+ * tasks file of the group (resctrl_group_before and resctrl_group_after, "/"
+ * is the default group). The groups are either created beforehand or by
+ * libadapt from the top-level entries resctrl_group_<nr> with a name and a
+ * schemata. resctrl is expected at /sys/fs/resctrl below sysfs_root, or at
+ * the top-level setting resctrl_root. The calling thread is moved, or all
+ * threads of the process with resctrl_all_threads = 1 (only by the primary
+ * thread of an OpenMP team). Threads are only moved if their group changes.
+ * When libadapt is closed, all moved threads return to their original group
+ * and created groups are removed.
+ * @subsubsection powercap Power Limits
+ * Sets the RAPL power limit of the package (powercap_package_before/after) or
+ * DRAM (powercap_dram_before/after) zone of a CPU in uW, and optionally the
+ * time window in us (powercap_package_window_* and powercap_dram_window_*)
+ * via /sys/class/powercap. The constraint is selected with the top-level
+ * setting powercap_constraint (default 0, the long term limit). Values are
+ * only written if they change. The original limits are restored when
+ * libadapt is closed.
+ * @subsubsection turbo Turbo
+ * Enables (turbo_before/after = 1) or disables (0) turbo frequencies via the
+ * boost file of the cpufreq policy of a CPU, intel_pstate/no_turbo, or the
+ * global cpufreq/boost, whichever is found first when libadapt is opened.
+ * Values are only written if they change. The original state is restored when
+ * libadapt is closed.
+ * @subsubsection mempolicy NUMA Memory Policy
+ * Sets the memory policy of the calling thread via set_mempolicy
+ * (mempolicy_before/after: default, local, preferred, bind, or interleave)
+ * over the nodes in mempolicy_nodes_before/after. Without nodes, preferred
+ * uses the node of the CPU and bind and interleave use all online nodes. If
+ * mempolicy_after is not given, the previous policy is restored on exit.
+ * Unchanged policies are not set again. With mempolicy_numa_balancing,
+ * /proc/sys/kernel/numa_balancing is set while at least one thread is in such
+ * a region.
+ * @subsubsection madvise Memory Range Advice
+ * Applies madvise advice to memory ranges that the application registered
+ * with adapt_register_range(). Every madvise_<nr> entry of a region names a
+ * range and the advice for entering (before) and exiting (after) the region:
+ * normal, random, sequential, willneed, dontneed, hugepage, nohugepage, cold,
+ * pageout, populate_read, or populate_write. prefault_before/after ("read" or
+ * "write") populate the range asynchronously via MADV_POPULATE_READ/WRITE on a
+ * helper thread, e.g., at the exit of the region that precedes a compute
+ * phase. Entries for ranges that are not registered are skipped.
  * @subsubsection file File Handling
  * Allows to write settings to a specific file, which can also be a device.
  * E.g., write a 1 whenever a function is entered and a 0 whenever it is exited.
- * Or write sth to /dev/cpu/0/msr at a specific offset
+ * Or write sth to /dev/cpu/0/msr at a specific offset.
+ * Without offset, values are appended to the file. With offset, they are
+ * written to this position via pwrite. The string {cpu} in a file name is
+ * replaced by the CPU of the region (e.g., /dev/cpu/{cpu}/msr), and the file
+ * of a CPU is opened when it is used first. format selects how before and
+ * after are written: "text" (default), "hex" (a string of hex digits that is
+ * written as raw bytes), or "u8", "u16", "u32", "u64" (an integer or integer
+ * string that is written in the byte order of the CPU). Several values for
+ * the same file are written with one writev, or with one pwritev if their
+ * offsets are adjacent.
+ * @subsection scope Scopes
+ * By default, the settings of a region are applied to the CPU that is passed
+ * to libadapt (or the current CPU of the calling thread). The x86_adapt, DVFS,
+ * C-state limit, energy performance preference, uncore, MSR, clock
+ * modulation, power limit, and turbo settings can also be applied to a scope
+ * of CPUs, relative to this CPU: "cpu", "core" (or "smt", all hardware
+ * threads of the core), "die", "package", "affinity" (all CPUs the calling
+ * thread may run on), or "all" online CPUs. The scope is selected for all
+ * settings of a region via scope or for a single knob category via
+ * <category>_scope, e.g., dvfs_scope.
  * @subsection add Adding new Knobs
  * Have a look at the adapt_internal.h documentation
  * @subsection call Calling libadapt
  * Have a look at the adapt.h documentation
+ * @subsection ompt OpenMP Tool Interface
+ * libadapt provides an OpenMP tool (OMPT) that adapts parallel regions
+ * without further instrumentation. It is enabled by setting the environment
+ * variable ADAPT_OMPT=1 and requires an OpenMP runtime with OMPT support.
+ * libadapt has to be linked to the program or loaded via
+ * OMP_TOOL_LIBRARIES=libadapt.so. A parallel region is named after the
+ * function that contains it (the executable has to be linked with -rdynamic),
+ * otherwise after its offset within the binary, e.g., "0x119b".
+ * The primary thread applies the settings before the team is formed, so
+ * dct_threads_before selects the size of this team. Strictly, OMPT does not
+ * allow calls of OpenMP runtime routines in tool callbacks. dct_threads_before
+ * calls omp_set_num_threads anyway, which works with the LLVM OpenMP runtime
+ * and runtimes based on it. With other runtimes, dct_* settings should not be
+ * used for parallel regions. All other threads of the team apply the settings
+ * on their own CPUs.
+ * Threads that wait in barriers, taskwaits, taskgroups, or for locks can run
+ * at a lower frequency. If the top-level setting dvfs_wait_freq (kHz) is set
+ * and the last wait of a thread at the same synchronization construct took at
+ * least dvfs_wait_threshold microseconds (default: 500, shorter waits do not
+ * pay off the frequency transitions), the frequency of its CPU is set to
+ * dvfs_wait_freq until the wait ends. The duration of a wait is only known
+ * when it ends, so the decision is based on the previous wait at the site and
+ * the first wait at a site is never slowed down. Afterwards, the CPU returns
+ * to the frequency requested for it before, or without such a request, to the
+ * frequency its cpufreq policy had before libadapt changed it.
  * @subsection cfg The Configuration File
  * The configuration file is read via libconfig. Thus the syntax is special.
  * Here is an example:
  * @code
+ * # optional, prefix for all sysfs files, e.g., to test against a fake tree
+ * # sysfs_root = "/tmp/fake_sys";
+ * # optional, how to combine frequency requests for CPUs of one cpufreq policy
+ * dvfs_domain_policy = "max";
+ * # optional, how to apply C-state limits ("disable" or "pm_qos")
+ * # csl_backend = "pm_qos";
+ * # optional, frequency and C-state limit of CPUs left idle by dct_threads_*
+ * # dct_idle_freq = 800000;
+ * # dct_idle_csl = 3;
+ * # optional, where regions with dct_tune = 1 store their number of threads
+ * # dct_tune_dir = "/home/user/.adapt";
+ * # dct_tune_samples = 3;
+ * # dct_tune_metric = "time";
+ * # optional, frequency of threads that wait in OpenMP synchronization (OMPT)
+ * # dvfs_wait_freq = 800000;
+ * # dvfs_wait_threshold = 500;
+ * # optional, write frequencies to IA32_PERF_CTL instead of sysfs ("sysfs" or "msr")
+ * # dvfs_backend = "msr";
+ * # optional, resctrl mount point and groups that are created by libadapt
+ * # resctrl_root = "/sys/fs/resctrl";
+ * # resctrl_group_0 = { name = "stream"; schemata = "L3:0=00f"; };
+ * # optional, which powercap constraint powercap_* settings change
+ * # powercap_constraint = 0;
  * init:
  * {
  *    # here can be settings that are enabled when the library is loaded
@@ -106,11 +343,23 @@
  *         # change frequency when entering/exiting this function
  *         dvfs_freq_before= 1866000; 
  *         dvfs_freq_after= 1600000;
+ *         # optional
+ *         # apply the frequency to all CPUs of the package, e.g., for OpenMP
+ *         dvfs_scope = "package";
  *
  *         # optional
  *         # change number of threads when entering/exiting this function
  *         dct_threads_before = 2;
  *         dct_threads_after = 3;
+ *         # or select the number of threads online, see dct_tune_dir
+ *         # dct_tune = 1;
+ *
+ *         # optional
+ *         # change the schedule of schedule(runtime) loops and the time
+ *         # threads spin before they sleep (ms)
+ *         omp_schedule_before = "dynamic";
+ *         omp_chunk_before = 16;
+ *         omp_blocktime_after = 0;
  *
  *         # optional
  *         # change settings from x86a
@@ -119,6 +368,67 @@
  *         x86_adapt_AMD_Stride_Prefetch_after = 0;
  * 
  *         # optional
+ *         # change the energy performance preference (string or 0-255)
+ *         # and the energy performance bias (0-15)
+ *         epp_before = "power";
+ *         epp_after = "balance_performance";
+ *         epb_before = 15;
+ *         epb_after = 6;
+ *
+ *         # optional
+ *         # change the uncore frequency range (kHz) of the current package
+ *         uncore_min_before = 2400000;
+ *         uncore_max_before = 2400000;
+ *         uncore_min_after = 800000;
+ *         uncore_max_after = 2400000;
+ *
+ *         # optional
+ *         # bind the threads of the process to one CPU per core
+ *         placement_before = "scatter";
+ *         placement_after = "original";
+ *
+ *         # optional
+ *         # run the current CPU at a duty cycle of 25 % (for spinning regions)
+ *         clock_mod_before = 25;
+ *         clock_mod_after = 100;
+ *
+ *         # optional
+ *         # let schedutil select at least half of the maximal frequency
+ *         uclamp_min_before = 512;
+ *         uclamp_min_after = 0;
+ *
+ *         # optional
+ *         # run this region in the background, the previous settings are
+ *         # restored on exit
+ *         sched_policy_before = "idle";
+ *         sched_timerslack_before = 1000000;
+ *
+ *         # optional
+ *         # limit the LLC share of this region
+ *         resctrl_group_before = "stream";
+ *         resctrl_group_after = "/";
+ *
+ *         # optional
+ *         # limit the package of the calling CPU to 80 W
+ *         powercap_package_before = 80000000;
+ *         powercap_package_after = 200000000;
+ *
+ *         # optional
+ *         # no turbo for this memory-bound region
+ *         turbo_before = 0;
+ *         turbo_after = 1;
+ *
+ *         # optional
+ *         # interleave the memory that is allocated in this region
+ *         mempolicy_before = "interleave";
+ *         mempolicy_nodes_before = [ 0, 1 ];
+ *
+ *         # optional
+ *         # back a registered range with huge pages and prefault it
+ *         madvise_0 = { range = "matrix"; before = "hugepage";
+ *                       prefault_before = "write"; };
+ *
+ *         # optional
  *         # write something to this file whenever a region is entered
  *         file_0:
  *         {
@@ -129,6 +439,26 @@
  *
  *         };
  *         # another file definition could be placed here
+ *         # e.g., write IA32_ENERGY_PERF_BIAS (0x1b0) of the current CPU
+ *         file_1:
+ *         {
+ *             name="/dev/cpu/{cpu}/msr";
+ *             offset=0x1b0;
+ *             format="u64";
+ *             before=15;
+ *             after=6;
+ *         };
+ *
+ *         # optional
+ *         # disable the L2 hardware prefetcher (bit 0 of MSR 0x1a4) of the
+ *         # current CPU
+ *         msr_0:
+ *         {
+ *             address=0x1a4;
+ *             mask=0x1;
+ *             before=0x1;
+ *             after=0x0;
+ *         };
  *
  *         # optional
  *         # change the deepest allowed c-state
@@ -152,6 +482,7 @@
  */
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #define ADAPT_OK                  0
 #define ADAPT_NO_ACTUAL_ADAPT     1
@@ -260,3 +591,17 @@ int adapt_enter_no_stacks(uint64_t binary_id, uint32_t rid, int32_t cpu);
  *          2 if some error occured
  */
 int adapt_exit(uint64_t binary_id,uint32_t tid, int32_t cpu);
+
+/**
+ * @brief Register a named memory range for madvise_<nr> settings
+ *
+ * The range can be registered before or after adapt_open() and registering
+ * it again with the same name replaces it (e.g., after a realloc). A length
+ * of 0 unregisters it. Only the whole pages within the range are advised.
+ * Ranges are forgotten when libadapt is closed.
+ * @param name the name of the range, as used in the configuration file
+ * @param address the start of the range
+ * @param length the length of the range in bytes
+ * @returns 0 or ErrorCode
+ */
+int adapt_register_range(const char * name, void * address, size_t length);
@@ -43,6 +43,9 @@
 /* Dynamic Concurrency Throttling */
 #ifndef NO_DCT
 #include "../knobs/dct.h"
+#include "../knobs/dct_idle.h"
+#include "../knobs/dct_tune.h"
+#include "../knobs/omp_sched.h"
 #endif
 
 /* x86 adapt */
@@ -60,9 +63,81 @@
 #include "../knobs/c_state_limit.h"
 #endif
 
+/* energy performance preference and bias via sysfs */
+#ifndef NO_EPP
+#include "../knobs/epp.h"
+#endif
+
+/* uncore frequency via intel_uncore_frequency in sysfs */
+#ifndef NO_UNCORE
+#include "../knobs/uncore.h"
+#endif
+
+#ifndef NO_PLACEMENT
+#include "../knobs/placement.h"
+#endif
+
+#ifndef NO_MSR
+#include "../knobs/msr_settings.h"
+#endif
+
+#ifndef NO_CLOCK_MOD
+#include "../knobs/clock_mod.h"
+#endif
+
+#ifndef NO_UCLAMP
+#include "../knobs/uclamp.h"
+#endif
+
+#ifndef NO_SCHED_POLICY
+#include "../knobs/sched_policy.h"
+#endif
+
+#ifndef NO_RESCTRL
+#include "../knobs/resctrl.h"
+#endif
+
+#ifndef NO_POWERCAP
+#include "../knobs/powercap.h"
+#endif
+
+#ifndef NO_TURBO
+#include "../knobs/turbo.h"
+#endif
+
+#ifndef NO_MEMPOLICY
+#include "../knobs/mempolicy.h"
+#endif
+
+#ifndef NO_MADVISE
+#include "../knobs/madvise.h"
+#endif
+
 /* write sth to a file */
 #include "../knobs/file.h"
 
+/**
+ * @enum adapt_scope
+ * @brief the cpus a setting is applied to, relative to the cpu that is passed
+ * to adapt_enter / adapt_exit. Selected in the configuration file via
+ * scope or <config_string>_scope, e.g., dvfs_scope = "package";
+ */
+enum adapt_scope {
+  /** only the cpu ("cpu", default) */
+  ADAPT_SCOPE_CPU = 0,
+  /** all hardware threads of its core ("core" or "smt") */
+  ADAPT_SCOPE_CORE,
+  /** all cpus of its die ("die") */
+  ADAPT_SCOPE_DIE,
+  /** all cpus of its package ("package") */
+  ADAPT_SCOPE_PACKAGE,
+  /** all cpus in the affinity mask of the calling thread ("affinity") */
+  ADAPT_SCOPE_AFFINITY,
+  /** all online cpus ("all") */
+  ADAPT_SCOPE_ALL,
+  ADAPT_SCOPE_MAX
+};
+
 /**
  * @struct adapt_definition
  * @brief represents a knob type that can be changed via libadapt 
@@ -78,6 +153,13 @@ struct adapt_definition {
    */
   char * name;
 
+  /**
+   * the prefix of the settings of the knob type in the configuration file.
+   * If set, settings can be applied to a scope of cpus (see adapt_scope),
+   * otherwise they are only applied to the current cpu.
+   */
+  char * config_string;
+
   /**
    * initialize the knob type and check whether the prerequisites for the
    * knob type are fulfilled.
@@ -85,6 +167,16 @@ struct adapt_definition {
    */
   int (*init)(void);
 
+  /**
+   * parse settings of the knob type that are not bound to a binary or
+   * region, i.e., top-level entries of the configuration file. This is called
+   * once before init.
+   * @param cfg the configuration file that should be parsed
+   * @param buffer a string buffer of 1024 byte you can work with to avoid allocs
+   * @return 0 or ErrorCode
+   */
+  int (*read_global_config)(struct config_t * cfg, char * buffer);
+
   /**
    * parse the configuration file and check whether there has been a definition
    * for this knob type
@@ -132,9 +224,19 @@ struct adapt_definition knobs[] =
     .information_size=sizeof(struct dct_information),
     .name="Dynamic Concurrency Throttling",
     .init=init_dct_information,
+    .read_global_config=dct_read_global_config,
     .read_from_config=dct_read_from_config,
     .process_before=dct_process_before,
     .process_after=dct_process_after,
+    .fini=dct_tune_fini
+  },
+  {
+    .information_size=sizeof(struct omp_sched_information),
+    .name="OpenMP schedule and wait policy",
+    .init=omp_sched_init,
+    .read_from_config=omp_sched_read_from_config,
+    .process_before=omp_sched_process_before,
+    .process_after=omp_sched_process_after,
     .fini=NULL
   },
 #endif
@@ -142,6 +244,7 @@ struct adapt_definition knobs[] =
   {
     .information_size=sizeof(struct x86_adapt_pref_information),
     .name="x86_adapt",
+    .config_string=X86_ADAPT_PREF_CONFIG_STRING,
     .init=x86_adapt_init, // directly from x86_adapt.h
     .read_from_config=x86_adapt_read_from_config,
     .process_before=x86_adapt_process_before,
@@ -154,7 +257,9 @@ struct adapt_definition knobs[] =
   {
     .information_size=sizeof(struct dvfs_information),
     .name="DVFS via cpufreq entries in sysfs",
+    .config_string=DVFS_CONFIG_STRING,
     .init=init_dvfs,
+    .read_global_config=dvfs_read_global_config,
     .read_from_config=dvfs_read_from_config,
     .process_before=dvfs_process_before,
     .process_after=dvfs_process_after,
@@ -166,13 +271,157 @@ struct adapt_definition knobs[] =
   {
     .information_size=sizeof(struct csl_information),
     .name="C-State limit via cpuidle entries in sysfs",
+    .config_string=CSTATE_LIMIT_CONFIG_STRING,
     .init=csl_init,
+    .read_global_config=csl_read_global_config,
     .read_from_config=csl_read_from_config,
     .process_before=csl_process_before,
     .process_after=csl_process_after,
     .fini=csl_fini
   },
 #endif
+
+#ifndef NO_EPP
+  {
+    .information_size=sizeof(struct epp_information),
+    .name="Energy performance preference and bias via sysfs",
+    .config_string=EPP_CONFIG_STRING,
+    .init=epp_init,
+    .read_from_config=epp_read_from_config,
+    .process_before=epp_process_before,
+    .process_after=epp_process_after,
+    .fini=epp_fini
+  },
+#endif
+
+#ifndef NO_UNCORE
+  {
+    .information_size=sizeof(struct uncore_information),
+    .name="Uncore frequency via intel_uncore_frequency entries in sysfs",
+    .config_string=UNCORE_CONFIG_STRING,
+    .init=uncore_init,
+    .read_from_config=uncore_read_from_config,
+    .process_before=uncore_process_before,
+    .process_after=uncore_process_after,
+    .fini=uncore_fini
+  },
+#endif
+#ifndef NO_PLACEMENT
+  {
+    .information_size=sizeof(struct placement_information),
+    .name="Thread placement via sched_setaffinity",
+    .init=placement_init,
+    .read_from_config=placement_read_from_config,
+    .process_before=placement_process_before,
+    .process_after=placement_process_after,
+    .fini=placement_fini
+  },
+#endif
+#ifndef NO_MSR
+  {
+    .information_size=sizeof(struct msr_information),
+    .name="Model specific registers via /dev/cpu/<nr>/msr",
+    .config_string=MSR_CONFIG_STRING,
+    .init=NULL,
+    .read_global_config=msr_settings_read_global_config,
+    .read_from_config=msr_settings_read_from_config,
+    .process_before=msr_settings_process_before,
+    .process_after=msr_settings_process_after,
+    .fini=msr_settings_fini
+  },
+#endif
+#ifndef NO_CLOCK_MOD
+  {
+    .information_size=sizeof(struct clock_mod_information),
+    .name="Clock modulation via IA32_CLOCK_MODULATION",
+    .config_string=CLOCK_MOD_CONFIG_STRING,
+    .init=clock_mod_init,
+    .read_from_config=clock_mod_read_from_config,
+    .process_before=clock_mod_process_before,
+    .process_after=clock_mod_process_after,
+    .fini=clock_mod_fini
+  },
+#endif
+#ifndef NO_UCLAMP
+  {
+    .information_size=sizeof(struct uclamp_information),
+    .name="Utilization clamping via sched_setattr",
+    .init=uclamp_init,
+    .read_from_config=uclamp_read_from_config,
+    .process_before=uclamp_process_before,
+    .process_after=uclamp_process_after,
+    .fini=uclamp_fini
+  },
+#endif
+#ifndef NO_SCHED_POLICY
+  {
+    .information_size=sizeof(struct sched_policy_information),
+    .name="Scheduling policy and timer slack",
+    .init=sched_policy_init,
+    .read_from_config=sched_policy_read_from_config,
+    .process_before=sched_policy_process_before,
+    .process_after=sched_policy_process_after,
+    .fini=sched_policy_fini
+  },
+#endif
+#ifndef NO_RESCTRL
+  {
+    .information_size=sizeof(struct resctrl_information),
+    .name="Cache and memory bandwidth allocation via resctrl",
+    .read_global_config=resctrl_read_global_config,
+    .init=resctrl_init,
+    .read_from_config=resctrl_read_from_config,
+    .process_before=resctrl_process_before,
+    .process_after=resctrl_process_after,
+    .fini=resctrl_fini
+  },
+#endif
+#ifndef NO_POWERCAP
+  {
+    .information_size=sizeof(struct powercap_information),
+    .name="RAPL power limits via powercap",
+    .config_string=POWERCAP_CONFIG_STRING,
+    .read_global_config=powercap_read_global_config,
+    .init=powercap_init,
+    .read_from_config=powercap_read_from_config,
+    .process_before=powercap_process_before,
+    .process_after=powercap_process_after,
+    .fini=powercap_fini
+  },
+#endif
+#ifndef NO_TURBO
+  {
+    .information_size=sizeof(struct turbo_information),
+    .name="Turbo via cpufreq boost or intel_pstate",
+    .config_string=TURBO_CONFIG_STRING,
+    .init=turbo_init,
+    .read_from_config=turbo_read_from_config,
+    .process_before=turbo_process_before,
+    .process_after=turbo_process_after,
+    .fini=turbo_fini
+  },
+#endif
+#ifndef NO_MEMPOLICY
+  {
+    .information_size=sizeof(struct mempolicy_information),
+    .name="NUMA memory policy via set_mempolicy",
+    .init=mempolicy_init,
+    .read_from_config=mempolicy_read_from_config,
+    .process_before=mempolicy_process_before,
+    .process_after=mempolicy_process_after,
+    .fini=mempolicy_fini
+  },
+#endif
+#ifndef NO_MADVISE
+  {
+    .information_size=sizeof(struct madvise_information),
+    .name="Memory range advice via madvise",
+    .read_from_config=madvise_read_from_config,
+    .process_before=madvise_process_before,
+    .process_after=madvise_process_after,
+    .fini=madvise_fini
+  },
+#endif
   {
     .information_size=sizeof(struct file_information),
     .name="File access",
@@ -189,6 +438,7 @@ enum knobs
 {
 #ifndef NO_DCT
   ADAPT_DCT,
+  ADAPT_OMP_SCHED,
 #endif
 #ifndef NO_X86_ADAPT
   X86A,
@@ -201,6 +451,54 @@ enum knobs
 #ifndef NO_CSL
   ADAPT_CSL,
 #endif
+
+#ifndef NO_EPP
+  ADAPT_EPP,
+#endif
+
+#ifndef NO_UNCORE
+  ADAPT_UNCORE,
+#endif
+
+#ifndef NO_PLACEMENT
+  ADAPT_PLACEMENT,
+#endif
+
+#ifndef NO_MSR
+  ADAPT_MSR,
+#endif
+
+#ifndef NO_CLOCK_MOD
+  ADAPT_CLOCK_MOD,
+#endif
+
+#ifndef NO_UCLAMP
+  ADAPT_UCLAMP,
+#endif
+
+#ifndef NO_SCHED_POLICY
+  ADAPT_SCHED_POLICY,
+#endif
+
+#ifndef NO_RESCTRL
+  ADAPT_RESCTRL,
+#endif
+
+#ifndef NO_POWERCAP
+  ADAPT_POWERCAP,
+#endif
+
+#ifndef NO_TURBO
+  ADAPT_TURBO,
+#endif
+
+#ifndef NO_MEMPOLICY
+  ADAPT_MEMPOLICY,
+#endif
+
+#ifndef NO_MADVISE
+  ADAPT_MADVISE,
+#endif
   ADAPT_FILE,
   /* used for loops */
   ADAPT_MAX
@@ -210,6 +508,7 @@ enum knobs
 static size_t adapt_information_size =
 #ifndef NO_DCT
     sizeof(struct dct_information)+
+    sizeof(struct omp_sched_information)+
 #endif
 #ifndef NO_X86_ADAPT
     sizeof(struct x86_adapt_pref_information)+
@@ -221,7 +520,47 @@ static size_t adapt_information_size =
 #ifndef NO_CSL
     sizeof(struct csl_information)+
 #endif
-    sizeof(struct file_information)
+
+#ifndef NO_EPP
+    sizeof(struct epp_information)+
+#endif
+
+#ifndef NO_UNCORE
+    sizeof(struct uncore_information)+
+#endif
+#ifndef NO_PLACEMENT
+    sizeof(struct placement_information)+
+#endif
+#ifndef NO_MSR
+    sizeof(struct msr_information)+
+#endif
+#ifndef NO_CLOCK_MOD
+    sizeof(struct clock_mod_information)+
+#endif
+#ifndef NO_UCLAMP
+    sizeof(struct uclamp_information)+
+#endif
+#ifndef NO_SCHED_POLICY
+    sizeof(struct sched_policy_information)+
+#endif
+#ifndef NO_RESCTRL
+    sizeof(struct resctrl_information)+
+#endif
+#ifndef NO_POWERCAP
+    sizeof(struct powercap_information)+
+#endif
+#ifndef NO_TURBO
+    sizeof(struct turbo_information)+
+#endif
+#ifndef NO_MEMPOLICY
+    sizeof(struct mempolicy_information)+
+#endif
+#ifndef NO_MADVISE
+    sizeof(struct madvise_information)+
+#endif
+    sizeof(struct file_information)+
+    /* the scope of every knob type */
+    ADAPT_MAX * sizeof(uint8_t)
 ;
 
 #endif /* ADAPT_INTERNAL_H_ */
@@ -0,0 +1,112 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+/*************************************************************/
+/**
+* @file msr.h
+* @brief Header File for libadapts access to model specific registers
+*
+* MSRs are accessed via /dev/cpu/<nr>/msr (below sysfs_root, see
+* sysfs_file.h), which requires the msr kernel module. For a fake tree, a
+* sparse regular file can be used instead of the device.
+*
+* libadapt
+*
+* @version 0.4
+* 
+*************************************************************/
+#ifndef MSR_H_
+#define MSR_H_
+
+#include <stdint.h>
+
+#define MSR_IA32_PERF_CTL 0x199
+#define MSR_IA32_CLOCK_MODULATION 0x19A
+#define MSR_MISC_FEATURE_CONTROL 0x1A4
+#define MSR_IA32_ENERGY_PERF_BIAS 0x1B0
+
+/* a read-modify-write of the bits in mask */
+struct msr_update {
+  uint32_t reg;
+  uint64_t mask;
+  uint64_t value;
+};
+
+/**
+ * @brief Open the msr device of a cpu
+ *
+ * @param cpu the cpu
+ * @return a file descriptor or -1 on error (errno is set)
+ * */
+int msr_open(int cpu);
+
+/**
+ * @brief Read a register
+ *
+ * @param fd a file descriptor returned by msr_open
+ * @param reg the register
+ * @param value where the value is stored
+ * @return 0 or ErrorCode
+ * */
+int msr_read(int fd, uint32_t reg, uint64_t * value);
+
+/**
+ * @brief Write a register
+ *
+ * @param fd a file descriptor returned by msr_open
+ * @param reg the register
+ * @param value the value
+ * @return 0 or ErrorCode
+ * */
+int msr_write(int fd, uint32_t reg, uint64_t value);
+
+/**
+ * @brief Change registers of a cpu with cached read-modify-writes
+ *
+ * The msr device of the cpu is opened when it is used first and kept open.
+ * A register is only read when it is changed first, its value at that time
+ * is kept as original. Afterwards, the new value is computed from the last
+ * written value and only written if it changes. Updates of the same cpu
+ * should be passed in a single call.
+ * @param cpu the cpu
+ * @param nr the number of updates
+ * @param updates the updates, applied in this order
+ * @return 0 or ErrorCode
+ * */
+int msr_cached_update(int cpu, int nr, const struct msr_update * updates);
+
+/**
+ * @brief Restore the original value of a register on all cpus
+ *
+ * Only cpus where the register has been changed via msr_cached_update are
+ * written.
+ * @param reg the register
+ * @return 0 or ErrorCode
+ * */
+int msr_cached_restore(uint32_t reg);
+
+/**
+ * @brief Close the msr devices opened by msr_cached_update
+ *
+ * The cached values are dropped, registers that have not been restored keep
+ * their current values.
+ * */
+void msr_cached_close(void);
+
+#endif /* MSR_H_ */
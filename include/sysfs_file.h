@@ -0,0 +1,116 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+/*************************************************************/
+/**
+* @file sysfs_file.h
+* @brief Header File for libadapts cached access to sysfs files
+*
+* Knobs keep the files they write open and remember the last written value,
+* so writes that would not change anything are skipped. The value that was
+* found when the file has been opened can be restored later.
+*
+* libadapt
+*
+* @version 0.4
+* 
+*************************************************************/
+#ifndef SYSFS_FILE_H_
+#define SYSFS_FILE_H_
+
+#include <stddef.h>
+
+/* maximal length of a value (including the terminating 0) */
+#define SYSFS_FILE_VALUE_SIZE 64
+
+struct sysfs_file {
+    int fd;
+    /* the value that has been written last, 0-terminated */
+    char value[SYSFS_FILE_VALUE_SIZE];
+    size_t value_len;
+    /* the value that has been read when opening the file */
+    char original[SYSFS_FILE_VALUE_SIZE];
+    size_t original_len;
+    /* whether the file is not on sysfs, procfs, or resctrl (e.g., of a fake
+     * tree), so it has to be truncated when a shorter value is written */
+    int regular;
+};
+
+/**
+ * @brief Set a prefix for all sysfs, procfs, and device paths
+ *
+ * This allows to run libadapt against a fake tree, e.g., for testing.
+ * @param root the prefix, e.g., "/tmp/fake", NULL or "" for none
+ * @return 0 or ENAMETOOLONG
+ * */
+int sysfs_set_root(const char * root);
+
+/**
+ * @brief Build a path below the root
+ *
+ * @param buffer where the path is written to
+ * @param size the size of buffer
+ * @param format printf-like format for the path, e.g., "/sys/devices/system/cpu/cpu%d"
+ * @return 0 or ENAMETOOLONG
+ * */
+int sysfs_path(char * buffer, size_t size, const char * format, ...);
+
+/**
+ * @brief Check whether a file below the root exists
+ *
+ * @param format printf-like format for the path
+ * @return 1 if the file exists, otherwise 0
+ * */
+int sysfs_exists(const char * format, ...);
+
+/**
+ * @brief Open a file below the root and read its current value
+ *
+ * @param file the file structure that is initialized
+ * @param format printf-like format for the path
+ * @return 0 or ErrorCode, file->fd is -1 on error
+ * */
+int sysfs_file_open(struct sysfs_file * file, const char * format, ...);
+
+/**
+ * @brief Write a value, unless it has been written before
+ *
+ * @param file an opened file
+ * @param value the value to write
+ * @param len the length of value
+ * @return 0 or ErrorCode
+ * */
+int sysfs_file_write(struct sysfs_file * file, const char * value, size_t len);
+
+/**
+ * @brief Write the value that has been read when opening the file
+ *
+ * @param file an opened file
+ * @return 0 or ErrorCode
+ * */
+int sysfs_file_restore(struct sysfs_file * file);
+
+/**
+ * @brief Close the file
+ *
+ * @param file an opened file or a file with fd -1
+ * */
+void sysfs_file_close(struct sysfs_file * file);
+
+#endif /* SYSFS_FILE_H_ */
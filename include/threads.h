@@ -0,0 +1,127 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+/*************************************************************/
+/**
+* @file threads.h
+* @brief Header File for libadapts view on the threads of the process
+*
+* Knobs that act on a whole team of threads (OpenMP or pthreads) use this to
+* enumerate the threads via /proc/self/task.
+*
+* libadapt
+*
+* @version 0.4
+* 
+*************************************************************/
+#ifndef THREADS_H_
+#define THREADS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* flags of sched_setattr, see sched_setattr(2) */
+#ifndef SCHED_FLAG_RESET_ON_FORK
+#define SCHED_FLAG_RESET_ON_FORK 0x01
+#endif
+#ifndef SCHED_FLAG_KEEP_POLICY
+#define SCHED_FLAG_KEEP_POLICY 0x08
+#endif
+#ifndef SCHED_FLAG_KEEP_PARAMS
+#define SCHED_FLAG_KEEP_PARAMS 0x10
+#endif
+#ifndef SCHED_FLAG_UTIL_CLAMP_MIN
+#define SCHED_FLAG_UTIL_CLAMP_MIN 0x20
+#endif
+#ifndef SCHED_FLAG_UTIL_CLAMP_MAX
+#define SCHED_FLAG_UTIL_CLAMP_MAX 0x40
+#endif
+
+/* struct sched_attr of the kernel, which is not provided by every libc */
+struct threads_sched_attr {
+  uint32_t size;
+  uint32_t sched_policy;
+  uint64_t sched_flags;
+  int32_t sched_nice;
+  uint32_t sched_priority;
+  uint64_t sched_runtime;
+  uint64_t sched_deadline;
+  uint64_t sched_period;
+  uint32_t sched_util_min;
+  uint32_t sched_util_max;
+};
+
+/**
+ * @brief Get the thread ids of all threads of the process
+ *
+ * The ids are sorted ascending, i.e., usually in the order the threads have
+ * been created, so the main thread is the first one.
+ * @param tids where the list is stored, has to be freed by the caller
+ * @param nr where the number of threads is stored
+ * @return 0 or ErrorCode
+ * */
+int threads_list(pid_t ** tids, int * nr);
+
+/**
+ * @brief Get the thread id of the calling thread
+ * */
+pid_t threads_self(void);
+
+/**
+ * @brief Read the scheduling attributes of a thread via sched_getattr
+ *
+ * @param tid the thread id, 0 for the calling thread
+ * @param attr where the attributes are stored
+ * @return 0 or ErrorCode
+ * */
+int threads_get_sched_attr(pid_t tid, struct threads_sched_attr * attr);
+
+/**
+ * @brief Change the scheduling attributes of a thread via sched_setattr
+ *
+ * @param tid the thread id, 0 for the calling thread
+ * @param attr the attributes, attr->size is set by this function
+ * @return 0 or ErrorCode
+ * */
+int threads_set_sched_attr(pid_t tid, struct threads_sched_attr * attr);
+
+/**
+ * @brief Read the timer slack of a thread
+ *
+ * Uses PR_GET_TIMERSLACK for the calling thread and
+ * /proc/self/task/<tid>/timerslack_ns for other threads.
+ * @param tid the thread id, 0 for the calling thread
+ * @param slack where the timer slack in ns is stored
+ * @return 0 or ErrorCode
+ * */
+int threads_get_timerslack(pid_t tid, uint64_t * slack);
+
+/**
+ * @brief Change the timer slack of a thread
+ *
+ * Uses PR_SET_TIMERSLACK for the calling thread and
+ * /proc/self/task/<tid>/timerslack_ns for other threads, which needs
+ * CAP_SYS_NICE on older kernels.
+ * @param tid the thread id, 0 for the calling thread
+ * @param slack the timer slack in ns
+ * @return 0 or ErrorCode
+ * */
+int threads_set_timerslack(pid_t tid, uint64_t slack);
+
+#endif /* THREADS_H_ */
@@ -0,0 +1,117 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+/*************************************************************/
+/**
+* @file topology.h
+* @brief Header File for libadapts view on the cpu topology
+*
+* The topology is read once from sysfs (below sysfs_root, see sysfs_file.h),
+* knobs use it to map cpus to their core, die, package, or NUMA node.
+*
+* libadapt
+*
+* @version 0.4
+* 
+*************************************************************/
+#ifndef TOPOLOGY_H_
+#define TOPOLOGY_H_
+
+/* levels for topology_cpus */
+#define TOPOLOGY_LEVEL_CORE    0
+#define TOPOLOGY_LEVEL_DIE     1
+#define TOPOLOGY_LEVEL_PACKAGE 2
+#define TOPOLOGY_LEVEL_ALL     3
+#define TOPOLOGY_LEVEL_MAX     4
+
+/**
+ * @brief Read the topology of all cpus
+ *
+ * Can be called more than once, only the first call reads the topology.
+ * NOT thread safe!
+ * @return 0 or ErrorCode
+ * */
+int topology_init(void);
+
+/**
+ * @brief Free the topology
+ *
+ * The next topology_init reads it again, e.g., below another sysfs_root.
+ * NOT thread safe!
+ * */
+void topology_fini(void);
+
+/**
+ * @brief Get the number of cpus, including offline ones
+ * */
+int topology_nr_cpus(void);
+
+/**
+ * @brief Check whether a cpu is online
+ * @return 1 if the cpu is online, otherwise 0
+ * */
+int topology_cpu_online(int cpu);
+
+/**
+ * @brief Get the physical package id of a cpu
+ * @return package id or -1 if unknown
+ * */
+int topology_package(int cpu);
+
+/**
+ * @brief Get the die id of a cpu within its package
+ * @return die id, 0 if the system does not report dies, -1 if unknown
+ * */
+int topology_die(int cpu);
+
+/**
+ * @brief Get the core id of a cpu within its package
+ * @return core id or -1 if unknown
+ * */
+int topology_core(int cpu);
+
+/**
+ * @brief Get the NUMA node of a cpu
+ * @return node id, 0 if the system does not report nodes, -1 if unknown
+ * */
+int topology_node(int cpu);
+
+/**
+ * @brief Get the number of NUMA nodes, i.e., the highest online node + 1
+ * */
+int topology_nr_nodes(void);
+
+/**
+ * @brief Check whether a NUMA node is online
+ * @return 1 if the node is online, otherwise 0
+ * */
+int topology_node_online(int node);
+
+/**
+ * @brief Get the online cpus that share a core, die, or package with a cpu
+ *
+ * The list is computed in topology_init and includes cpu itself.
+ * @param level one of TOPOLOGY_LEVEL_CORE, _DIE, _PACKAGE, or _ALL
+ * @param cpu the cpu
+ * @param nr where the number of cpus is stored, 0 if cpu is not online
+ * @return the list of cpus or NULL
+ * */
+const int * topology_cpus(int level, int cpu, int * nr);
+
+#endif /* TOPOLOGY_H_ */
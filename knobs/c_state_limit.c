@@ -18,172 +18,264 @@
  ***********************************************************************/
 
 #include "c_state_limit.h"
+#include "sysfs_file.h"
+#include "topology.h"
 
-#include <dirent.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sched.h>
-#include <assert.h>
-#include <sys/types.h>
-#include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <inttypes.h>
 
+#define CPUIDLE_PATH "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/%s"
+#define PM_QOS_PATH "/sys/devices/system/cpu/cpu%d/power/pm_qos_resume_latency_us"
 
-/* an fd for every cstate from every cpu, and its original setting */
-struct c_state_file{
-  FILE * fd;
-  uint8_t default_setting;
-};
+/* the bitmap of disabled states limits the number of states */
+#define CSL_MAX_CSTATES 64
+
+/* disable deeper states via cpuidle/state<id>/disable */
+#define CSL_BACKEND_DISABLE 0
+/* limit the wake-up latency via power/pm_qos_resume_latency_us */
+#define CSL_BACKEND_PM_QOS  1
 
 /* all cstate information for a single cpu */
 struct per_cpu{
-  struct c_state_file * c_state_files;
-  int current_max;
   int nr_cstates;
+  /* the deepest allowed state, -1 for the original settings */
+  int limit;
+  /* for CSL_BACKEND_DISABLE, an fd for the disable file of every state and
+   * bitmaps of the states that are currently and were originally disabled */
+  int * disable_fds;
+  uint64_t disabled;
+  uint64_t original_disabled;
+  /* for CSL_BACKEND_PM_QOS, the exit latency of every state in us */
+  struct sysfs_file pm_qos;
+  int * latencies;
 };
 
 static struct per_cpu * per_cpu_cstates = NULL;
 static int nr_per_cpu_cstates = 0;
+static int backend = CSL_BACKEND_DISABLE;
+
+int csl_read_global_config(struct config_t * cfg, char * buffer)
+{
+  config_setting_t *setting;
+  const char * name;
+  sprintf(buffer, "%s_backend", CSTATE_LIMIT_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting == NULL)
+    return 0;
+  name = config_setting_get_string(setting);
+  if (name == NULL) {
+    fprintf(stderr, "%s has to be a string\n", buffer);
+    return EINVAL;
+  }
+  if (strcmp(name, "disable") == 0)
+    backend = CSL_BACKEND_DISABLE;
+  else if (strcmp(name, "pm_qos") == 0)
+    backend = CSL_BACKEND_PM_QOS;
+  else {
+    fprintf(stderr, "Unknown %s \"%s\", use disable or pm_qos\n", buffer, name);
+    return EINVAL;
+  }
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %s\n",buffer,name);
+#endif
+  return 0;
+}
+
+/* read a small integer from a cpuidle file */
+static int read_state_int(int cpu, int state, const char * file, int * value)
+{
+  char path[512];
+  char buffer[32];
+  ssize_t nr_read;
+  int fd, ret;
+  ret = sysfs_path(path, sizeof(path), CPUIDLE_PATH, cpu, state, file);
+  if (ret)
+    return ret;
+  fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return errno;
+  nr_read = pread(fd, buffer, sizeof(buffer) - 1, 0);
+  ret = nr_read < 0 ? errno : 0;
+  close(fd);
+  if (ret)
+    return ret;
+  buffer[nr_read] = '\0';
+  *value = atoi(buffer);
+  return 0;
+}
+
+static int init_cpu_disable(int cpu, struct per_cpu * current)
+{
+  char path[512];
+  int state, ret, disabled;
+  current->disable_fds = calloc(current->nr_cstates, sizeof(int));
+  if (current->disable_fds == NULL)
+    return ENOMEM;
+  for (state = 0; state < current->nr_cstates; state++)
+    current->disable_fds[state] = -1;
+  for (state = 0; state < current->nr_cstates; state++)
+  {
+    ret = read_state_int(cpu, state, "disable", &disabled);
+    if (ret)
+      return ret;
+    if (disabled)
+      current->original_disabled |= 1ULL << state;
+    ret = sysfs_path(path, sizeof(path), CPUIDLE_PATH, cpu, state, "disable");
+    if (ret)
+      return ret;
+    current->disable_fds[state] = open(path, O_WRONLY);
+    if (current->disable_fds[state] == -1)
+      return errno;
+  }
+  current->disabled = current->original_disabled;
+  return 0;
+}
+
+static int init_cpu_pm_qos(int cpu, struct per_cpu * current)
+{
+  int state, ret;
+  current->latencies = calloc(current->nr_cstates, sizeof(int));
+  if (current->latencies == NULL)
+    return ENOMEM;
+  for (state = 0; state < current->nr_cstates; state++)
+  {
+    ret = read_state_int(cpu, state, "latency", &current->latencies[state]);
+    if (ret)
+      return ret;
+  }
+  return sysfs_file_open(&current->pm_qos, PM_QOS_PATH, cpu);
+}
 
 int csl_init(void) {
-  unsigned int current_cpu, num_cpus;
-  int nr_chars;
+  int cpu, ret;
 
-  /* get number of CPUs */
-  num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+  ret = topology_init();
+  if (ret)
+    return ret;
+  nr_per_cpu_cstates = topology_nr_cpus();
 
   /* calloc is a lot faster than malloc + memset */
-  per_cpu_cstates = calloc(num_cpus, sizeof(struct per_cpu));
+  per_cpu_cstates = calloc(nr_per_cpu_cstates, sizeof(struct per_cpu));
   /* alloc ok? */
   if (per_cpu_cstates == NULL)
   {
     return ENOMEM;
   }
+  for (cpu = 0; cpu < nr_per_cpu_cstates; cpu++)
+  {
+    per_cpu_cstates[cpu].pm_qos.fd = -1;
+    per_cpu_cstates[cpu].limit = -1;
+  }
 
-  nr_per_cpu_cstates=num_cpus;
-
-  /* get number of cstates */
-  for (current_cpu=0;current_cpu<num_cpus;current_cpu++){
-    char path_string[256];
-    struct dirent **namelist;
-    int cpuidle_file;
-
-    nr_chars = snprintf(path_string,256,"/sys/devices/system/cpu/cpu%d/cpuidle/",current_cpu);
-
-    if (nr_chars >= 256)
-    {
-      free(per_cpu_cstates);
-      return ENOMEM;
-    }
-
-    /* get array with all possibile states */
-    int number_cpuidle_files = scandir(path_string, &namelist, NULL, alphasort);
-    /* scandir return -1 if someting went wrong */
-    /* namelist shouldn't be a NULL Pointer */
-    if (number_cpuidle_files <= 0 && namelist == NULL)
+  for (cpu = 0; cpu < nr_per_cpu_cstates; cpu++)
+  {
+    struct per_cpu * current = &per_cpu_cstates[cpu];
+    /* states are numbered continuously, offline cpus have none */
+    while (current->nr_cstates < CSL_MAX_CSTATES &&
+           sysfs_exists("/sys/devices/system/cpu/cpu%d/cpuidle/state%d", cpu, current->nr_cstates))
+      current->nr_cstates++;
+    if (current->nr_cstates == 0)
+      continue;
+    if (backend == CSL_BACKEND_PM_QOS)
+      ret = init_cpu_pm_qos(cpu, current);
+    else
+      ret = init_cpu_disable(cpu, current);
+    if (ret)
     {
-      /* if we are here something went wrong */
-      free(per_cpu_cstates);
-      return EPERM;
+      csl_fini();
+      return ret;
     }
+  }
+  return 0;
+}
 
-    for (cpuidle_file=0;cpuidle_file<number_cpuidle_files;cpuidle_file++){
-      /* check if file name is state* */
-      if (strstr(namelist[cpuidle_file]->d_name,"state")==namelist[cpuidle_file]->d_name){
-        /* found a state */
-        /* get the state id */
-        int state_id=atoi(&(namelist[cpuidle_file]->d_name[5]));
-        /* allocate space for state information*/
-        if (per_cpu_cstates[current_cpu].nr_cstates < (state_id + 1)){
-          per_cpu_cstates[current_cpu].c_state_files=realloc(per_cpu_cstates[current_cpu].c_state_files,(state_id+1)*sizeof(struct c_state_file));
-          if (per_cpu_cstates[current_cpu].c_state_files == NULL)
-              /* not enough space for an integer?
-               * so we schould break here */
-              return ENOMEM;
-          per_cpu_cstates[current_cpu].nr_cstates=state_id;
-        }
-
-        /* now open the "disabled" file and store its value */
-
-        nr_chars = snprintf(path_string,256,"/sys/devices/system/cpu/cpu%d/cpuidle/state%d/disable",current_cpu,state_id);
-
-        if (nr_chars >= 256)
-        {
-          free(per_cpu_cstates);
-          for (cpuidle_file=0;cpuidle_file<number_cpuidle_files;cpuidle_file++){
-            free(namelist[cpuidle_file]);
-          }
-          return ENOMEM;
-        }
-
-        per_cpu_cstates[current_cpu].c_state_files[state_id].fd = fopen(path_string,"rw");
-
-        if ( per_cpu_cstates[current_cpu].c_state_files[state_id].fd == NULL )
-        {
-          int error = errno;
-          free(per_cpu_cstates);
-          for (cpuidle_file=0;cpuidle_file<number_cpuidle_files;cpuidle_file++){
-            free(namelist[cpuidle_file]);
-          }
-          return error;
-        }
-
-        /* read disabled to path_string */
-        while(fgets(path_string,256,per_cpu_cstates[current_cpu].c_state_files[state_id].fd)!=NULL || errno ==EAGAIN);
-        per_cpu_cstates[current_cpu].c_state_files->default_setting=atoi(path_string);
-
-        /* set current_max */
-        if (state_id > per_cpu_cstates[current_cpu].current_max )
-          per_cpu_cstates[current_cpu].current_max = state_id;
-
-        /* free memory that has been allocated in scandir */
-        free(namelist[cpuidle_file]);
-      }
-    }
+/* only write the disable files of states that change */
+static inline int write_disabled(struct per_cpu * current, uint64_t target)
+{
+  uint64_t changed = target ^ current->disabled;
+  while (changed)
+  {
+    int id = __builtin_ctzll(changed);
+    uint64_t bit = 1ULL << id;
+    if (pwrite(current->disable_fds[id], target & bit ? "1" : "0", 1, 0) != 1)
+      return errno ? errno : EIO;
+    current->disabled ^= bit;
+    changed &= ~bit;
   }
   return 0;
 }
 
-static inline int set_max_cstate(int cpu, int state){
-  if ( ( cpu < 0 ) || ( cpu > nr_per_cpu_cstates) || ( state > per_cpu_cstates[cpu].nr_cstates ) || ( state < 0 ) )
-    return EINVAL;
+static inline int set_max_cstate_disable(struct per_cpu * current, int state)
+{
+  uint64_t target = ~((2ULL << state) - 1);
+  if (current->nr_cstates < CSL_MAX_CSTATES)
+    target &= (1ULL << current->nr_cstates) - 1;
+  return write_disabled(current, target);
+}
 
-  if ( state > per_cpu_cstates[cpu].current_max ){
-    /* enable everything from per_cpu_cstates[cpu].current_max to state */
-    int current_state;
-    for (current_state = per_cpu_cstates[cpu].current_max;current_state <=state;current_state++){
-      /* write 0 to per_cpu_cstates[cpu].c_state_files[current.state].fd */
-      rewind(per_cpu_cstates[cpu].c_state_files[current_state].fd);
-      if (fputs("0",per_cpu_cstates[cpu].c_state_files[current_state].fd))
-        return ferror(per_cpu_cstates[cpu].c_state_files[current_state].fd);
-      if (fflush(per_cpu_cstates[cpu].c_state_files[current_state].fd))
-        return ferror(per_cpu_cstates[cpu].c_state_files[current_state].fd);
-    }
+/* allow all states with an exit latency up to the one of state. "0"
+ * removes the constraint, "n/a" is a latency of 0 and only allows polling */
+static inline int set_max_cstate_pm_qos(struct per_cpu * current, int state)
+{
+  char value[16];
+  int len;
+  if (state == current->nr_cstates - 1)
+    return sysfs_file_write(&current->pm_qos, "0", 1);
+  /* a latency of 0 would be read as no constraint */
+  if (state == 0 || current->latencies[state] <= 0)
+    return sysfs_file_write(&current->pm_qos, "n/a", 3);
+  len = snprintf(value, sizeof(value), "%d", current->latencies[state]);
+  return sysfs_file_write(&current->pm_qos, value, len);
+}
 
-  } else if (state < per_cpu_cstates[cpu].current_max){
-    /* disable everything from per_cpu_cstates[cpu].current_max to state */
-    int current_state;
-    for (current_state = state+1 ;current_state <=per_cpu_cstates[cpu].current_max;current_state++){
-      /* write 1 to per_cpu_cstates[cpu].c_state_files[current.state].fd */
-      rewind(per_cpu_cstates[cpu].c_state_files[current_state].fd);
-      if (fputs("1",per_cpu_cstates[cpu].c_state_files[current_state].fd))
-        return ferror(per_cpu_cstates[cpu].c_state_files[current_state].fd);
-      if (fflush(per_cpu_cstates[cpu].c_state_files[current_state].fd))
-        return ferror(per_cpu_cstates[cpu].c_state_files[current_state].fd);
-    }
+static inline int set_max_cstate(int cpu, int state){
+  int ret;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  if ( ( cpu < 0 ) || ( cpu >= nr_per_cpu_cstates) || ( state >= per_cpu_cstates[cpu].nr_cstates ) || ( state < 0 ) )
+    return EINVAL;
 
-  }
-  /* if state == per_cpu_cstates[cpu].current_max do nothing :) */
-  
-  per_cpu_cstates[cpu].current_max = state;
+  if (backend == CSL_BACKEND_PM_QOS)
+    ret = set_max_cstate_pm_qos(&per_cpu_cstates[cpu], state);
+  else
+    ret = set_max_cstate_disable(&per_cpu_cstates[cpu], state);
+  if (ret == 0)
+    per_cpu_cstates[cpu].limit = state;
+  return ret;
+}
 
-  return 0;
+int csl_get_max_cstate(int cpu)
+{
+  if (cpu < 0 || cpu >= nr_per_cpu_cstates)
+    return -1;
+  return per_cpu_cstates[cpu].limit;
 }
 
+int csl_set_max_cstate(int cpu, int state)
+{
+  struct per_cpu * current;
+  int ret;
+  if (state >= 0)
+    return set_max_cstate(cpu, state);
+  if (cpu < 0 || cpu >= nr_per_cpu_cstates)
+    return EINVAL;
+  current = &per_cpu_cstates[cpu];
+  if (backend == CSL_BACKEND_PM_QOS)
+    ret = sysfs_file_restore(&current->pm_qos);
+  else if (current->disable_fds != NULL)
+    ret = write_disabled(current, current->original_disabled);
+  else
+    ret = 0;
+  if (ret == 0)
+    current->limit = -1;
+  return ret;
+}
 int csl_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
 {
   int was_set = 0;
@@ -250,24 +342,34 @@ int csl_process_after(void * vp, int32_t cpu){
 }
 
 int csl_fini(void){
-  /* reset original max_cstate and free structures */
+  /* reset the original settings of every state and free structures */
   int state = 0, cpu = 0;
   int error = 0;
+  if (per_cpu_cstates == NULL)
+    return 0;
   for ( cpu = 0 ; cpu < nr_per_cpu_cstates ; cpu++ )
   {
-    for ( state = 0 ; state < per_cpu_cstates[cpu].nr_cstates ; state++ )
+    struct per_cpu * current = &per_cpu_cstates[cpu];
+    if (current->disable_fds != NULL)
     {
-      char buffer[8];
-      snprintf(buffer, 8, "%"PRIu8 , per_cpu_cstates[cpu].c_state_files[state].default_setting);
-      rewind(per_cpu_cstates[cpu].c_state_files[state].fd);
-      fputs(buffer,per_cpu_cstates[cpu].c_state_files[state].fd);
-      error |= ferror(per_cpu_cstates[cpu].c_state_files[state].fd);
-      fflush(per_cpu_cstates[cpu].c_state_files[state].fd);
-      error |= ferror(per_cpu_cstates[cpu].c_state_files[state].fd);
-      fclose(per_cpu_cstates[cpu].c_state_files[state].fd);
+      for ( state = 0 ; state < current->nr_cstates ; state++ )
+      {
+        uint64_t bit = 1ULL << state;
+        if (current->disable_fds[state] == -1)
+          continue;
+        if ((current->disabled ^ current->original_disabled) & bit)
+          if (pwrite(current->disable_fds[state], current->original_disabled & bit ? "1" : "0", 1, 0) != 1)
+            error |= errno ? errno : EIO;
+        close(current->disable_fds[state]);
+      }
+      free(current->disable_fds);
     }
-    free(per_cpu_cstates[cpu].c_state_files);
+    error |= sysfs_file_restore(&current->pm_qos);
+    sysfs_file_close(&current->pm_qos);
+    free(current->latencies);
   }
   free(per_cpu_cstates);
+  per_cpu_cstates = NULL;
+  nr_per_cpu_cstates = 0;
   return error;
 }
@@ -40,6 +40,8 @@ struct csl_information{
 
 int csl_init(void);
 
+int csl_read_global_config(struct config_t * cfg, char * buffer);
+
 int csl_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
 
 int csl_process_before(void * info, int32_t cpu);
@@ -47,4 +49,9 @@ int csl_process_after(void * info, int32_t cpu);
 
 int csl_fini(void);
 
+/* get the deepest allowed state of a cpu, -1 if it has not been changed */
+int csl_get_max_cstate(int cpu);
+/* set the deepest allowed state of a cpu, -1 restores the original settings */
+int csl_set_max_cstate(int cpu, int state);
+
 #endif /* CSTATE_LIMIT_H_ */
@@ -0,0 +1,131 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "clock_mod.h"
+#include "msr.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+/* bit 4 enables clock modulation, bits 3:1 (or 3:0 with the extended
+ * resolution) select the duty cycle */
+#define CLOCK_MOD_ENABLE 0x10
+#define CLOCK_MOD_MASK 0x1F
+
+/* duty cycle steps, 12.5% or 6.25% with the extended resolution */
+static int steps = 8;
+
+int clock_mod_init(void)
+{
+  int fd;
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  /* CPUID.06H:EAX[5] extended clock modulation duty cycle */
+  if (__get_cpuid(6, &eax, &ebx, &ecx, &edx) && (eax & (1 << 5)))
+    steps = 16;
+#endif
+  /* the msr device should be there at least for cpu 0 */
+  fd = msr_open(0);
+  if (fd < 0)
+    return errno;
+  close(fd);
+  return 0;
+}
+
+/* translate a duty cycle in percent to the register bits */
+static int32_t duty_cycle_bits(int percent)
+{
+  int level;
+  if (percent >= 100)
+    return 0;
+  level = (percent * steps + 50) / 100;
+  if (level < 1)
+    level = 1;
+  if (level >= steps)
+    return 0;
+  /* 12.5% steps are stored in bits 3:1 */
+  return CLOCK_MOD_ENABLE | (steps == 16 ? level : level << 1);
+}
+
+static int read_duty_cycle(struct config_t * cfg, char * buffer, int32_t * value)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  int percent;
+  *value = -1;
+  if (setting == NULL)
+    return 0;
+  percent = config_setting_get_int(setting);
+  if (percent <= 0)
+  {
+    fprintf(stderr, "%s has to be a duty cycle between 1 and 100 %%\n", buffer);
+    return 0;
+  }
+  *value = duty_cycle_bits(percent);
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %d (0x%" PRIx32 ")\n",buffer,percent,*value);
+#endif
+  return 1;
+}
+
+int clock_mod_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  struct clock_mod_information * info = vp;
+  int was_set = 0;
+  sprintf(buffer, "%s.%s_before", prefix, CLOCK_MOD_CONFIG_STRING);
+  was_set |= read_duty_cycle(cfg, buffer, &info->clock_mod_before);
+  sprintf(buffer, "%s.%s_after", prefix, CLOCK_MOD_CONFIG_STRING);
+  was_set |= read_duty_cycle(cfg, buffer, &info->clock_mod_after);
+  return was_set;
+}
+
+static int set_duty_cycle(int32_t value, int32_t cpu)
+{
+  struct msr_update update;
+  if (value < 0)
+    return 0;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  update.reg = MSR_IA32_CLOCK_MODULATION;
+  update.mask = CLOCK_MOD_MASK;
+  update.value = value;
+  return msr_cached_update(cpu, 1, &update);
+}
+
+int clock_mod_process_before(void * vp, int32_t cpu)
+{
+  struct clock_mod_information * info = vp;
+  return set_duty_cycle(info->clock_mod_before, cpu);
+}
+
+int clock_mod_process_after(void * vp, int32_t cpu)
+{
+  struct clock_mod_information * info = vp;
+  return set_duty_cycle(info->clock_mod_after, cpu);
+}
+
+int clock_mod_fini(void)
+{
+  return msr_cached_restore(MSR_IA32_CLOCK_MODULATION);
+}
@@ -0,0 +1,44 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef CLOCK_MOD_H_
+#define CLOCK_MOD_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#define CLOCK_MOD_CONFIG_STRING "clock_mod"
+
+/* -1 if not set, otherwise the value of the duty cycle bits of
+ * IA32_CLOCK_MODULATION */
+struct clock_mod_information{
+  int32_t clock_mod_before;
+  int32_t clock_mod_after;
+};
+
+int clock_mod_init(void);
+
+int clock_mod_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int clock_mod_process_before(void * info, int32_t cpu);
+int clock_mod_process_after(void * info, int32_t cpu);
+
+int clock_mod_fini(void);
+
+#endif /* CLOCK_MOD_H_ */
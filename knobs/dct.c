@@ -25,6 +25,8 @@
  */
 
 #include "dct.h"
+#include "dct_idle.h"
+#include "dct_tune.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <dlfcn.h>
@@ -44,6 +46,9 @@ static int last_set_threads = 0;
 static int initial_num_threads = 0;
 /* save the number of threads from the last dct_process_after call */
 static int last_exit_threads = 0;
+/* upper bound for tuning the number of threads, the maximal number of
+ * threads when the first region with dct_tune is read */
+static int tune_max_threads = 0;
 
 /* The OMP runtime does not have to support dynamic, but we do */
 /* Therefor we have to disable their dynamic and return true */
@@ -129,6 +134,7 @@ void omp_dct_set_num_threads(int num){
   if (omp_dct_orig_set_num_threads.vp){
     last_set_threads = num;
     omp_dct_orig_set_num_threads.function(num);
+    dct_idle_set_threads(num);
   }
 }
 
@@ -207,15 +213,40 @@ int init_dct_information(){
   return 0;
 }
 
+/* read the top-level settings for idle cpus and tuning */
+int dct_read_global_config(struct config_t * cfg, char * buffer){
+  int ret = dct_idle_read_global_config(cfg, buffer);
+  if (ret)
+    return ret;
+  return dct_tune_read_global_config(cfg, buffer);
+}
+
 /* get the information from our config file */
 int dct_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix){
   config_setting_t *setting;
   struct dct_information * info = vp;
   info->threads_before = -1;
   info->threads_after = -1;
+  info->tune = 0;
   init_dct_information();
   initial_num_threads = omp_dct_get_max_threads();
 
+  /* search settings for tuning */
+  sprintf(buffer, "%s.%s_tune",
+      prefix, DCT_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting && config_setting_get_int(setting))
+  {
+    info->tune = 1;
+#ifdef VERBOSE
+    fprintf(stderr, "%s = %" PRId32 "\n",buffer,info->tune);
+#endif
+    if (tune_max_threads == 0)
+      tune_max_threads = initial_num_threads;
+    dct_tune_enable();
+    omp_set_dynamic(1);
+  }
+
   /* search settings for threads_before declarations */
   sprintf(buffer, "%s.%s_threads_before",
       prefix, DCT_CONFIG_STRING);
@@ -274,8 +305,16 @@ int dct_read_from_config(void * vp,struct config_t * cfg, char * buffer, char *
 /* change the number of threads before the function will called like configured */
 int dct_process_before(void * vp,int ignore){
   struct dct_information * info = vp;
-  if (omp_get_dynamic())
-    if (info->threads_before > 0) {
+  /* within a team (e.g., via OMPT), only the primary thread selects the
+   * number of threads */
+  if (omp_get_dynamic() && info->tune && omp_dct_get_thread_num() == 0) {
+    /* the number of threads is selected by the tuning */
+    int threads = dct_tune_begin(tune_max_threads);
+    if (threads > 0)
+      omp_dct_set_num_threads(threads);
+  }
+  else if (omp_get_dynamic())
+    if (info->threads_before > 0 && omp_dct_get_thread_num() == 0) {
         /* then we get a number of threads from the config so use it */
 #ifdef VERBOSE
       fprintf(stderr,"Adapting threads before to %d\n",info->threads_before);
@@ -297,8 +336,10 @@ int dct_process_before(void * vp,int ignore){
 /* change the number of threads after the function will called like configured */
 int dct_process_after(void * vp,int ignore){
   struct dct_information * info = vp;
+  if (omp_get_dynamic() && info->tune && omp_dct_get_thread_num() == 0)
+    dct_tune_end();
   if (omp_get_dynamic())
-    if (info->threads_after > 0) {
+    if (info->threads_after > 0 && omp_dct_get_thread_num() == 0) {
 #ifdef VERBOSE
       fprintf(stderr,"Adapting threads after to %d\n",info->threads_after);
 #endif
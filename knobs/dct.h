@@ -36,9 +36,12 @@
 struct dct_information{
   int32_t threads_before;
   int32_t threads_after;
+  /* select threads_before online, see dct_tune.h */
+  int32_t tune;
 };
 int init_dct_information(void);
 
+int dct_read_global_config(struct config_t * cfg, char * buffer);
 int dct_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
 int dct_process_before(void * info,int ignored);
 int dct_process_after(void * info,int ignored);
@@ -47,6 +50,8 @@ int omp_dct_get_set_threads(void);
 
 int omp_dct_get_max_threads(void);
 
+int omp_dct_get_thread_num(void);
+
 void omp_dct_set_num_threads(int num);
 
 void omp_dct_repeat_exit(void);
@@ -0,0 +1,187 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "dct.h"
+#include "dct_idle.h"
+#ifndef NO_CPUFREQ
+#include "fastcpufreq.h"
+#endif
+#ifndef NO_CSL
+#include "c_state_limit.h"
+#endif
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* a parked cpu and the settings it had before */
+struct idle_cpu{
+  int cpu;
+  int parked;
+  int down_clocked;
+  unsigned long saved_freq;
+  int saved_csl;
+};
+
+/* frequency (kHz) and deepest C-state of idle cpus, 0 / -1 if not set */
+static long idle_freq = 0;
+static int idle_csl = -1;
+
+/* the cpus of the affinity mask in ascending order */
+static struct idle_cpu * cpus = NULL;
+static int nr_cpus = 0;
+/* cpufreq policies that are used by active cpus */
+static char * active_policies = NULL;
+
+static int read_affinity(void)
+{
+  cpu_set_t mask;
+  int cpu, max_policies = 0;
+  if (sched_getaffinity(0, sizeof(mask), &mask))
+    return errno;
+  cpus = calloc(CPU_COUNT(&mask), sizeof(struct idle_cpu));
+  if (cpus == NULL)
+    return ENOMEM;
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    if (CPU_ISSET(cpu, &mask))
+    {
+      cpus[nr_cpus].cpu = cpu;
+      cpus[nr_cpus].saved_csl = -1;
+      nr_cpus++;
+      max_policies = cpu + 1;
+    }
+  /* policy ids are cpu numbers at most */
+  active_policies = calloc(max_policies, 1);
+  if (active_policies == NULL)
+    return ENOMEM;
+  return 0;
+}
+
+int dct_idle_read_global_config(struct config_t * cfg, char * buffer)
+{
+  config_setting_t *setting;
+  sprintf(buffer, "%s_idle_freq", DCT_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting) {
+    idle_freq = config_setting_get_int(setting);
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %ld\n",buffer,idle_freq);
+#endif
+  }
+  sprintf(buffer, "%s_idle_csl", DCT_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting) {
+    idle_csl = config_setting_get_int(setting);
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %d\n",buffer,idle_csl);
+#endif
+  }
+  if (idle_freq <= 0 && idle_csl < 0)
+    return 0;
+  /* read the mask now, before the OpenMP runtime binds the master thread */
+  return read_affinity();
+}
+
+static void park(struct idle_cpu * current)
+{
+#ifndef NO_CPUFREQ
+  int policy = fcf_get_policy(current->cpu);
+  /* cpus that share a frequency with active cpus are not down-clocked */
+  if (idle_freq > 0 && policy >= 0 && !active_policies[policy])
+  {
+    current->saved_freq = fcf_get_frequency(current->cpu);
+    current->down_clocked = fcf_set_frequency(current->cpu, idle_freq) >= 0;
+  }
+#endif
+#ifndef NO_CSL
+  if (idle_csl >= 0)
+  {
+    current->saved_csl = csl_get_max_cstate(current->cpu);
+    csl_set_max_cstate(current->cpu, idle_csl);
+  }
+#endif
+#ifdef VERBOSE
+  fprintf(stderr,"Parking idle cpu %d\n",current->cpu);
+#endif
+  current->parked = 1;
+}
+
+static void unpark(struct idle_cpu * current, unsigned long active_freq)
+{
+#ifndef NO_CPUFREQ
+  /* without an earlier request, use the one of the first active cpu. If
+   * there is none, the idle request must not be kept, since it would pull
+   * down the other cpus of the policy with dvfs_domain_policy = "min" */
+  if (current->down_clocked && (current->saved_freq > 0 || active_freq > 0))
+    fcf_set_frequency(current->cpu, current->saved_freq > 0 ? current->saved_freq : active_freq);
+  else if (current->down_clocked)
+    fcf_clear_request(current->cpu);
+  current->down_clocked = 0;
+  current->saved_freq = 0;
+#endif
+#ifndef NO_CSL
+  if (idle_csl >= 0)
+    csl_set_max_cstate(current->cpu, current->saved_csl);
+#endif
+#ifdef VERBOSE
+  fprintf(stderr,"Unparking cpu %d\n",current->cpu);
+#endif
+  current->parked = 0;
+}
+
+/* The OpenMP team is assumed to use the first cpus of the affinity mask
+ * (e.g., OMP_PROC_BIND=close), the remaining cpus are idle. */
+void dct_idle_set_threads(int threads)
+{
+  unsigned long active_freq = 0;
+  int i;
+  if (cpus == NULL || threads <= 0)
+    return;
+#ifndef NO_CPUFREQ
+  for (i = 0; i < nr_cpus; i++)
+  {
+    int policy = fcf_get_policy(cpus[i].cpu);
+    if (policy >= 0)
+      active_policies[policy] = 0;
+  }
+  for (i = 0; i < threads && i < nr_cpus; i++)
+  {
+    int policy = fcf_get_policy(cpus[i].cpu);
+    if (policy >= 0)
+      active_policies[policy] = 1;
+  }
+  active_freq = fcf_get_frequency(cpus[0].cpu);
+  /* parked cpus of policies that become active are excluded from the
+   * arbitration, their frequency is restored when they are unparked */
+  for (i = threads; i < nr_cpus; i++)
+  {
+    int policy = fcf_get_policy(cpus[i].cpu);
+    if (cpus[i].down_clocked && policy >= 0 && active_policies[policy])
+      fcf_clear_request(cpus[i].cpu);
+  }
+#endif
+  for (i = 0; i < nr_cpus; i++)
+  {
+    if (i < threads && cpus[i].parked)
+      unpark(&cpus[i], active_freq);
+    else if (i >= threads && !cpus[i].parked)
+      park(&cpus[i]);
+  }
+}
@@ -0,0 +1,38 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef DCT_IDLE_H_
+#define DCT_IDLE_H_
+
+#include <libconfig.h>
+
+/*
+ * Coordination of concurrency throttling with the DVFS and C-state limit
+ * knobs: cpus that are not used by the OpenMP team anymore get an idle
+ * frequency and C-state limit (top-level settings dct_idle_freq and
+ * dct_idle_csl) and are restored when they are used again.
+ */
+
+/* read dct_idle_freq and dct_idle_csl, returns 0 or ErrorCode */
+int dct_idle_read_global_config(struct config_t * cfg, char * buffer);
+
+/* called whenever the number of threads is changed */
+void dct_idle_set_threads(int threads);
+
+#endif /* DCT_IDLE_H_ */
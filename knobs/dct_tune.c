@@ -0,0 +1,503 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "dct_tune.h"
+#include "sysfs_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TUNE_BUCKETS 256
+/* nesting depth of tuned regions per thread */
+#define TUNE_MAX_DEPTH 32
+/* powercap zones that are summed up for the energy metric */
+#define TUNE_MAX_ZONES 16
+
+#define TUNE_METRIC_TIME 0
+#define TUNE_METRIC_ENERGY 1
+
+struct tune_region {
+  uint64_t binary_id;
+  uint32_t rid;
+  /* constant id of the region name, 0 if the region has not been defined */
+  uint64_t crid;
+  /* the number of threads that is used after tuning, 0 while tuning */
+  int best;
+  /* the search interval */
+  int lower;
+  int upper;
+  /* the number of threads that is currently measured, 0 for none */
+  int measuring;
+  int warmup;
+  int nr_samples;
+  double sum;
+  /* mean result per number of threads, negative if not measured */
+  double * results;
+  struct tune_region * next;
+};
+
+/* a measurement that has been started by a thread */
+struct tune_measurement {
+  struct tune_region * region;
+  int threads;
+  uint64_t start;
+};
+
+static int tune_enabled = 0;
+static char tune_dir[1024] = "";
+static int tune_samples = 3;
+static int tune_metric = TUNE_METRIC_TIME;
+
+/* regions with a known rid, hashed by rid */
+static struct tune_region * buckets[TUNE_BUCKETS];
+/* results of former runs for regions that have not been defined yet */
+static struct tune_region * pending = NULL;
+static volatile int tune_lock = 0;
+
+static __thread uint64_t current_binary_id = 0;
+static __thread uint32_t current_rid = 0;
+static __thread struct tune_measurement measurements[TUNE_MAX_DEPTH];
+static __thread int depth = 0;
+
+/* powercap zones for the energy metric */
+static int zone_fds[TUNE_MAX_ZONES];
+static uint64_t zone_ranges[TUNE_MAX_ZONES];
+static uint64_t zone_last[TUNE_MAX_ZONES];
+static int nr_zones = 0;
+static uint64_t energy_total = 0;
+
+static void lock(void)
+{
+  while (__sync_lock_test_and_set(&tune_lock, 1))
+    ;
+}
+
+static void unlock(void)
+{
+  __sync_lock_release(&tune_lock);
+}
+
+static uint64_t read_uint64(int fd)
+{
+  char buffer[32];
+  ssize_t len = pread(fd, buffer, sizeof(buffer) - 1, 0);
+  if (len <= 0)
+    return 0;
+  buffer[len] = '\0';
+  return strtoull(buffer, NULL, 10);
+}
+
+static int open_zones(void)
+{
+  char path[1024];
+  int fd;
+  for (nr_zones = 0; nr_zones < TUNE_MAX_ZONES; nr_zones++)
+  {
+    if (sysfs_path(path, sizeof(path), "/sys/class/powercap/intel-rapl:%d/max_energy_range_uj", nr_zones))
+      break;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+      break;
+    zone_ranges[nr_zones] = read_uint64(fd);
+    close(fd);
+    if (sysfs_path(path, sizeof(path), "/sys/class/powercap/intel-rapl:%d/energy_uj", nr_zones))
+      break;
+    zone_fds[nr_zones] = open(path, O_RDONLY);
+    if (zone_fds[nr_zones] < 0)
+      break;
+    zone_last[nr_zones] = read_uint64(zone_fds[nr_zones]);
+  }
+  return nr_zones ? 0 : ENODEV;
+}
+
+/* consumed energy in uJ since open_zones, called with tune_lock held */
+static uint64_t read_energy(void)
+{
+  int zone;
+  for (zone = 0; zone < nr_zones; zone++)
+  {
+    uint64_t value = read_uint64(zone_fds[zone]);
+    if (value >= zone_last[zone])
+      energy_total += value - zone_last[zone];
+    else
+      /* the counter wrapped around */
+      energy_total += zone_ranges[zone] - zone_last[zone] + value;
+    zone_last[zone] = value;
+  }
+  return energy_total;
+}
+
+static uint64_t read_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* returns 0 or ENAMETOOLONG */
+static int tune_file_path(char * buffer, size_t size)
+{
+  int len = snprintf(buffer, size, "%s/%s.dct", tune_dir, program_invocation_short_name);
+  if (len < 0 || (size_t) len >= size)
+    return ENAMETOOLONG;
+  return 0;
+}
+
+static void load_results(void)
+{
+  char path[1024];
+  uint64_t binary_id, crid;
+  int threads;
+  FILE * file;
+
+  if (tune_file_path(path, sizeof(path)))
+    return;
+  file = fopen(path, "r");
+  if (file == NULL)
+    return;
+  while (fscanf(file, "%" SCNu64 " %" SCNu64 " %d", &binary_id, &crid, &threads) == 3)
+  {
+    struct tune_region * region = calloc(1, sizeof(struct tune_region));
+    if (region == NULL || threads <= 0)
+    {
+      free(region);
+      continue;
+    }
+    region->binary_id = binary_id;
+    region->crid = crid;
+    region->best = threads;
+    region->next = pending;
+    pending = region;
+  }
+#ifdef VERBOSE
+  fprintf(stderr,"Read tuned number of threads from %s\n",path);
+#endif
+  fclose(file);
+}
+
+int dct_tune_read_global_config(struct config_t * cfg, char * buffer)
+{
+  config_setting_t *setting;
+  const char * value;
+
+  sprintf(buffer, "dct_tune_dir");
+  setting = config_lookup(cfg, buffer);
+  if (setting && (value = config_setting_get_string(setting)) != NULL)
+  {
+    if (strlen(value) >= sizeof(tune_dir))
+      return ENAMETOOLONG;
+    strcpy(tune_dir, value);
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %s\n",buffer,tune_dir);
+#endif
+  }
+  sprintf(buffer, "dct_tune_samples");
+  setting = config_lookup(cfg, buffer);
+  if (setting)
+  {
+    tune_samples = config_setting_get_int(setting);
+    if (tune_samples < 1)
+      tune_samples = 1;
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %d\n",buffer,tune_samples);
+#endif
+  }
+  sprintf(buffer, "dct_tune_metric");
+  setting = config_lookup(cfg, buffer);
+  if (setting && (value = config_setting_get_string(setting)) != NULL)
+  {
+    if (strcmp(value, "energy") == 0)
+      tune_metric = TUNE_METRIC_ENERGY;
+    else if (strcmp(value, "time") != 0)
+      fprintf(stderr, "Unknown %s %s, use time or energy\n", buffer, value);
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %s\n",buffer,value);
+#endif
+  }
+  if (tune_metric == TUNE_METRIC_ENERGY && open_zones())
+  {
+    fprintf(stderr, "No powercap energy counters found, tuning for time instead\n");
+    tune_metric = TUNE_METRIC_TIME;
+  }
+  if (tune_dir[0] != '\0')
+    load_results();
+  return 0;
+}
+
+void dct_tune_enable(void)
+{
+  tune_enabled = 1;
+}
+
+static struct tune_region * find_region(uint64_t binary_id, uint32_t rid)
+{
+  struct tune_region * region;
+  for (region = buckets[rid % TUNE_BUCKETS]; region != NULL; region = region->next)
+    if (region->rid == rid && region->binary_id == binary_id)
+      return region;
+  return NULL;
+}
+
+void dct_tune_def_region(uint64_t binary_id, uint32_t rid, uint64_t crid)
+{
+  struct tune_region * region;
+  struct tune_region ** prev;
+
+  if (!tune_enabled)
+    return;
+  lock();
+  if (find_region(binary_id, rid) != NULL)
+  {
+    unlock();
+    return;
+  }
+  /* results of a former run */
+  for (prev = &pending; *prev != NULL; prev = &(*prev)->next)
+    if ((*prev)->crid == crid && (*prev)->binary_id == binary_id)
+      break;
+  region = *prev;
+  if (region != NULL)
+    *prev = region->next;
+  else
+    region = calloc(1, sizeof(struct tune_region));
+  if (region != NULL)
+  {
+    region->binary_id = binary_id;
+    region->rid = rid;
+    region->crid = crid;
+    region->next = buckets[rid % TUNE_BUCKETS];
+    buckets[rid % TUNE_BUCKETS] = region;
+  }
+  unlock();
+}
+
+void dct_tune_set_region(uint64_t binary_id, uint32_t rid)
+{
+  current_binary_id = binary_id;
+  current_rid = rid;
+}
+
+/*
+ * Select the next number of threads that has to be measured, or finish
+ * tuning. This is a golden-section search over the number of threads,
+ * assuming a single minimum. Results are kept per number of threads, so
+ * points are not measured twice.
+ */
+static int next_threads(struct tune_region * region)
+{
+  int threads, c, d, step;
+  while (region->upper - region->lower > 2)
+  {
+    step = (int) ((region->upper - region->lower) * 0.381966 + 0.5);
+    c = region->lower + step;
+    d = region->upper - step;
+    if (d <= c)
+      d = c + 1;
+    if (region->results[c] < 0)
+      return c;
+    if (region->results[d] < 0)
+      return d;
+    if (region->results[c] <= region->results[d])
+      region->upper = d;
+    else
+      region->lower = c;
+  }
+  /* at most three candidates left */
+  region->best = region->lower;
+  for (threads = region->lower; threads <= region->upper; threads++)
+  {
+    if (region->results[threads] < 0)
+      return threads;
+    if (region->results[threads] < region->results[region->best])
+      region->best = threads;
+  }
+#ifdef VERBOSE
+  fprintf(stderr,"Tuned region %" PRIu32 " to %d threads\n",region->rid,region->best);
+#endif
+  free(region->results);
+  region->results = NULL;
+  return 0;
+}
+
+int dct_tune_begin(int max_threads)
+{
+  struct tune_region * region;
+  struct tune_measurement * measurement;
+  int threads = 0, i;
+
+  if (depth >= TUNE_MAX_DEPTH)
+  {
+    depth++;
+    return 0;
+  }
+  measurement = &measurements[depth++];
+  measurement->region = NULL;
+  if (max_threads < 1)
+    return 0;
+  lock();
+  region = find_region(current_binary_id, current_rid);
+  if (region == NULL)
+  {
+    /* the region has not been defined, so results can not be stored */
+    region = calloc(1, sizeof(struct tune_region));
+    if (region == NULL)
+    {
+      unlock();
+      return 0;
+    }
+    region->binary_id = current_binary_id;
+    region->rid = current_rid;
+    region->next = buckets[current_rid % TUNE_BUCKETS];
+    buckets[current_rid % TUNE_BUCKETS] = region;
+  }
+  if (region->best > 0)
+  {
+    unlock();
+    return region->best;
+  }
+  if (region->results == NULL)
+  {
+    region->results = malloc((max_threads + 1) * sizeof(double));
+    if (region->results == NULL)
+    {
+      unlock();
+      return 0;
+    }
+    for (i = 0; i <= max_threads; i++)
+      region->results[i] = -1.0;
+    region->lower = 1;
+    region->upper = max_threads;
+  }
+  if (region->measuring == 0)
+  {
+    region->measuring = next_threads(region);
+    region->warmup = 1;
+    region->nr_samples = 0;
+    region->sum = 0.0;
+  }
+  threads = region->measuring ? region->measuring : region->best;
+  if (region->measuring)
+  {
+    measurement->region = region;
+    measurement->threads = threads;
+    measurement->start = tune_metric == TUNE_METRIC_ENERGY ? read_energy() : read_time();
+  }
+  unlock();
+  return threads;
+}
+
+void dct_tune_end(void)
+{
+  struct tune_measurement * measurement;
+  struct tune_region * region;
+  uint64_t end = 0;
+
+  if (depth == 0)
+    return;
+  depth--;
+  if (depth >= TUNE_MAX_DEPTH)
+    return;
+  measurement = &measurements[depth];
+  region = measurement->region;
+  if (region == NULL)
+    return;
+  if (tune_metric == TUNE_METRIC_TIME)
+    end = read_time();
+  lock();
+  if (tune_metric == TUNE_METRIC_ENERGY)
+    end = read_energy();
+  /* another thread could have finished this number of threads already */
+  if (region->measuring == measurement->threads)
+  {
+    /* the first invocation also measures changing the team */
+    if (region->warmup)
+      region->warmup = 0;
+    else
+    {
+      region->sum += end - measurement->start;
+      region->nr_samples++;
+    }
+    if (region->nr_samples >= tune_samples)
+    {
+      region->results[region->measuring] = region->sum / region->nr_samples;
+#ifdef VERBOSE
+      fprintf(stderr,"Region %" PRIu32 " with %d threads: %f\n",region->rid,region->measuring,region->results[region->measuring]);
+#endif
+      region->measuring = 0;
+    }
+  }
+  unlock();
+}
+
+static void write_region(FILE * file, struct tune_region * region)
+{
+  if (region->crid != 0 && region->best > 0)
+    fprintf(file, "%" PRIu64 " %" PRIu64 " %d\n", region->binary_id, region->crid, region->best);
+}
+
+int dct_tune_fini(void)
+{
+  char path[1024];
+  FILE * file = NULL;
+  struct tune_region * region;
+  int bucket, zone;
+  int error = 0;
+
+  lock();
+  if (tune_enabled && tune_dir[0] != '\0')
+  {
+    error = tune_file_path(path, sizeof(path));
+    if (error == 0)
+      file = fopen(path, "w");
+    if (error == 0 && file == NULL)
+      error = errno;
+  }
+  for (bucket = 0; bucket < TUNE_BUCKETS; bucket++)
+    while (buckets[bucket] != NULL)
+    {
+      region = buckets[bucket];
+      buckets[bucket] = region->next;
+      if (file != NULL)
+        write_region(file, region);
+      free(region->results);
+      free(region);
+    }
+  while (pending != NULL)
+  {
+    region = pending;
+    pending = region->next;
+    if (file != NULL)
+      write_region(file, region);
+    free(region);
+  }
+  if (file != NULL)
+    fclose(file);
+  for (zone = 0; zone < nr_zones; zone++)
+    close(zone_fds[zone]);
+  nr_zones = 0;
+  tune_enabled = 0;
+  unlock();
+  return error;
+}
@@ -0,0 +1,58 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef DCT_TUNE_H_
+#define DCT_TUNE_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+/*
+ * Online selection of the number of threads for regions with dct_tune = 1.
+ * The first invocations of such a region are run with different numbers of
+ * threads (golden-section search between 1 and the maximal number of
+ * threads), and the number with the lowest time (or energy) is used
+ * afterwards. Results are stored in <dct_tune_dir>/<program>.dct and used
+ * directly in later runs.
+ */
+
+/* read dct_tune_dir, dct_tune_samples, and dct_tune_metric,
+ * returns 0 or ErrorCode */
+int dct_tune_read_global_config(struct config_t * cfg, char * buffer);
+
+/* called when a region uses dct_tune */
+void dct_tune_enable(void);
+
+/* relate a region id to the constant id of its name, called by adapt_def_region */
+void dct_tune_def_region(uint64_t binary_id, uint32_t rid, uint64_t crid);
+
+/* the region that the calling thread enters next */
+void dct_tune_set_region(uint64_t binary_id, uint32_t rid);
+
+/* start a measurement of the current region, returns the number of threads
+ * that should be used for it */
+int dct_tune_begin(int max_threads);
+
+/* end the measurement that has been started last by this thread */
+void dct_tune_end(void);
+
+/* store the results, returns 0 or ErrorCode */
+int dct_tune_fini(void);
+
+#endif /* DCT_TUNE_H_ */
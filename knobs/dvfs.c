@@ -25,7 +25,6 @@
  */
 
 #include "fastcpufreq.h"
-#include <cpufreq.h>
 #include "dvfs.h"
 #include <unistd.h>
 #include <stdio.h>
@@ -36,42 +35,30 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 
-static unsigned int num_cpus = 0;
-
-static struct cpufreq_policy ** saved_policies = NULL;
-
-static int save_before_settings(void) {
-    unsigned int i;
-    assert(saved_policies == NULL);
-    saved_policies = calloc(num_cpus, sizeof(*saved_policies));
-    if (saved_policies == NULL)
-      return ENOMEM;
-    for (i = 0; i < num_cpus; i++) {
-        saved_policies[i] = cpufreq_get_policy(i);
-        if (saved_policies[i] == NULL)
-        {
-            free(saved_policies);
-            saved_policies=NULL;
-            return EACCES;
-        }
-    }
-    return 0;
-}
+/* frequency while waiting, 0 if disabled, and the minimal wait time (ns).
+ * Waits that are not much longer than two frequency transitions (tens to
+ * hundreds of microseconds) only add latency, so the default is 500 us */
+static long wait_freq = 0;
+static uint64_t wait_threshold = 500000;
 
-static int restore_before_settings() {
-    for (int cpu = 0; cpu < num_cpus; cpu++) {
-        int ret;
-        if ( ret = cpufreq_set_policy(cpu, saved_policies[cpu]) )
-            return ret;
+/* number of synchronization sites a thread remembers, power of 2 */
+#define DVFS_WAIT_HISTORY 64
 
-        cpufreq_put_policy(saved_policies[cpu]);
-    }
-    free(saved_policies);
-    return 0;
-}
+/* the duration of the last wait at a site */
+struct wait_history{
+  const void * site;
+  uint64_t duration;
+};
 
+static __thread struct wait_history wait_histories[DVFS_WAIT_HISTORY];
+static __thread uint64_t wait_start = 0;
+/* the cpu whose frequency has been lowered, -1 if none, and its earlier
+ * request, 0 if there was none */
+static __thread int wait_cpu = -1;
+static __thread unsigned long wait_saved_freq = 0;
 
 static long dvfs_set_freq(int32_t frequency, int32_t cpu) {
 #ifdef VERBOSE
@@ -85,21 +72,126 @@ static long dvfs_set_freq(int32_t frequency, int32_t cpu) {
 }
 
 int init_dvfs() {
-  int ret;
-  num_cpus = sysconf(_SC_NPROCESSORS_CONF);
-  ret = save_before_settings();
-  if (ret)
-      return ret;
-  ret = fcf_init_once();
-  return ret;
-
+  /* the original governors and limits are saved by fastcpufreq */
+  return fcf_init_once();
 }
 
 int fini_dvfs() {
   fcf_finalize();
-  if (saved_policies) {
-    restore_before_settings();
+  return 0;
+}
+
+static inline uint64_t wait_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline struct wait_history * wait_history_of(const void * site) {
+  return &wait_histories[((uintptr_t) site >> 4) & (DVFS_WAIT_HISTORY - 1)];
+}
+
+/* The wait time is not known when it begins, it is predicted from the last
+ * wait of the thread at the same site */
+void dvfs_wait_begin(const void * site) {
+  struct wait_history * history;
+  int cpu;
+  if (wait_freq == 0)
+    return;
+  wait_start = wait_now();
+  history = wait_history_of(site);
+  if (history->site != site || history->duration < wait_threshold)
+    return;
+  cpu = sched_getcpu();
+  if (cpu < 0)
+    return;
+  wait_saved_freq = fcf_get_frequency(cpu);
+  if (wait_saved_freq == (unsigned long) wait_freq)
+    return;
+  if (fcf_set_frequency(cpu, wait_freq) >= 0)
+    wait_cpu = cpu;
+}
+
+void dvfs_wait_end(const void * site) {
+  struct wait_history * history;
+  if (wait_freq == 0 || wait_start == 0)
+    return;
+  if (wait_cpu >= 0) {
+    /* without an earlier request, the policy returns to its prior state */
+    if (wait_saved_freq)
+      fcf_set_frequency(wait_cpu, wait_saved_freq);
+    else
+      fcf_release_request(wait_cpu);
+    wait_cpu = -1;
+  }
+  history = wait_history_of(site);
+  history->site = site;
+  history->duration = wait_now() - wait_start;
+  wait_start = 0;
+}
+
+int dvfs_read_global_config(struct config_t * cfg, char * buffer) {
+  config_setting_t *setting;
+  const char * policy;
+  const char * backend;
+  sprintf(buffer, "%s_wait_freq", DVFS_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting) {
+    wait_freq = config_setting_get_int(setting);
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %ld\n",buffer,wait_freq);
+#endif
   }
+  sprintf(buffer, "%s_wait_threshold", DVFS_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting) {
+    wait_threshold = (uint64_t) config_setting_get_int(setting) * 1000;
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %" PRIu64 " ns\n",buffer,wait_threshold);
+#endif
+  }
+  sprintf(buffer, "%s_backend", DVFS_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting) {
+    backend = config_setting_get_string(setting);
+    if (backend == NULL) {
+      fprintf(stderr, "%s has to be a string\n", buffer);
+      return EINVAL;
+    }
+    if (strcmp(backend, "sysfs") == 0)
+      fcf_set_backend(FCF_BACKEND_SYSFS);
+    else if (strcmp(backend, "msr") == 0)
+      fcf_set_backend(FCF_BACKEND_MSR);
+    else {
+      fprintf(stderr, "Unknown %s \"%s\", use sysfs or msr\n", buffer, backend);
+      return EINVAL;
+    }
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %s\n",buffer,backend);
+#endif
+  }
+  sprintf(buffer, "%s_domain_policy", DVFS_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting == NULL)
+    return 0;
+  policy = config_setting_get_string(setting);
+  if (policy == NULL) {
+    fprintf(stderr, "%s has to be a string\n", buffer);
+    return EINVAL;
+  }
+  if (strcmp(policy, "last") == 0)
+    fcf_set_arbitration(FCF_ARBITRATE_LAST);
+  else if (strcmp(policy, "max") == 0)
+    fcf_set_arbitration(FCF_ARBITRATE_MAX);
+  else if (strcmp(policy, "min") == 0)
+    fcf_set_arbitration(FCF_ARBITRATE_MIN);
+  else {
+    fprintf(stderr, "Unknown %s \"%s\", use last, max, or min\n", buffer, policy);
+    return EINVAL;
+  }
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %s\n",buffer,policy);
+#endif
   return 0;
 }
 
@@ -144,7 +236,8 @@ int dvfs_process_before(void * vp, int32_t cpu) {
 
   ok = dvfs_set_freq(info->freq_before, cpu);
 
-  if (ok != info->freq_before) {
+  /* the frequency might have been snapped to an available one */
+  if (ok < 0) {
     fprintf(stderr,"Setting frequency failed before %li!\n",ok);
     return ok;
   }
@@ -162,7 +255,7 @@ int dvfs_process_after(void * vp, int32_t cpu) {
 #endif
   ok = dvfs_set_freq(info->freq_after, cpu);
 
-  if (ok != info->freq_after) {
+  if (ok < 0) {
     fprintf(stderr, "Setting frequency failed after %li!\n", ok);
     return ok;
   }
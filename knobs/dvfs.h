@@ -38,6 +38,7 @@ struct dvfs_information{
   int32_t freq_after;
 };
 
+int dvfs_read_global_config(struct config_t * cfg, char * buffer);
 int dvfs_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
 
 int dvfs_process_before(void * info, int32_t cpu);
@@ -49,4 +50,11 @@ void dvfs_set_freq_id(uint16_t id);
 int init_dvfs(void);
 int fini_dvfs(void);
 
+/* a thread starts / stops waiting at a synchronization site (e.g., an
+ * OpenMP barrier). If its last wait at this site took longer than
+ * dvfs_wait_threshold (us), its cpu is set to dvfs_wait_freq until the wait
+ * ends. */
+void dvfs_wait_begin(const void * site);
+void dvfs_wait_end(const void * site);
+
 #endif /* DVFS_H_ */
@@ -0,0 +1,166 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "epp.h"
+#include "sysfs_file.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EPP_PATH "/sys/devices/system/cpu/cpu%d/cpufreq/energy_performance_preference"
+#define EPB_PATH "/sys/devices/system/cpu/cpu%d/power/energy_perf_bias"
+
+/* the files of a cpu are opened on first use. lock serializes the open and
+ * the writes of the threads that change the same cpu */
+struct epp_per_cpu{
+  struct sysfs_file epp;
+  struct sysfs_file epb;
+  int epp_opened;
+  int epb_opened;
+  volatile int lock;
+};
+
+static struct epp_per_cpu * per_cpu_epp = NULL;
+static int nr_per_cpu_epp = 0;
+
+int epp_init(void)
+{
+  int cpu;
+  /* HWP or EPB should be there at least for cpu 0 */
+  if (!sysfs_exists(EPP_PATH, 0) && !sysfs_exists(EPB_PATH, 0))
+    return ENODEV;
+  nr_per_cpu_epp = sysconf(_SC_NPROCESSORS_CONF);
+  per_cpu_epp = calloc(nr_per_cpu_epp, sizeof(struct epp_per_cpu));
+  if (per_cpu_epp == NULL)
+    return ENOMEM;
+  for (cpu = 0; cpu < nr_per_cpu_epp; cpu++)
+  {
+    per_cpu_epp[cpu].epp.fd = -1;
+    per_cpu_epp[cpu].epb.fd = -1;
+  }
+  return 0;
+}
+
+/* read a setting that can be a string (e.g., "balance_power") or a number */
+static int read_value(struct config_t * cfg, char * buffer, char * value)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  value[0] = '\0';
+  if (setting == NULL)
+    return 0;
+  if (config_setting_type(setting) == CONFIG_TYPE_STRING)
+    snprintf(value, EPP_VALUE_SIZE, "%s", config_setting_get_string(setting));
+  else
+    snprintf(value, EPP_VALUE_SIZE, "%d", config_setting_get_int(setting));
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %s\n",buffer,value);
+#endif
+  return 1;
+}
+
+int epp_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  int was_set = 0;
+  struct epp_information * info = vp;
+
+  sprintf(buffer, "%s.%s_before", prefix, EPP_CONFIG_STRING);
+  was_set |= read_value(cfg, buffer, info->epp_before);
+  sprintf(buffer, "%s.%s_after", prefix, EPP_CONFIG_STRING);
+  was_set |= read_value(cfg, buffer, info->epp_after);
+  sprintf(buffer, "%s.%s_before", prefix, EPB_CONFIG_STRING);
+  was_set |= read_value(cfg, buffer, info->epb_before);
+  sprintf(buffer, "%s.%s_after", prefix, EPB_CONFIG_STRING);
+  was_set |= read_value(cfg, buffer, info->epb_after);
+  return was_set;
+}
+
+/* open the file on first use and write value if it changed */
+static int write_value(struct sysfs_file * file, int * opened, const char * format, int cpu, const char * value)
+{
+  int ret;
+  if (!*opened)
+  {
+    *opened = 1;
+    ret = sysfs_file_open(file, format, cpu);
+    if (ret)
+      return ret;
+  }
+  if (file->fd == -1)
+    return ENODEV;
+  return sysfs_file_write(file, value, strlen(value));
+}
+
+static int set_epp(const char * epp, const char * epb, int32_t cpu)
+{
+  struct epp_per_cpu * current;
+  int ok = 0;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  if (cpu < 0 || cpu >= nr_per_cpu_epp)
+    return EINVAL;
+  if (epp[0] == '\0' && epb[0] == '\0')
+    return 0;
+  current = &per_cpu_epp[cpu];
+  while (__sync_lock_test_and_set(&current->lock, 1))
+    ;
+  if (epp[0] != '\0')
+    ok |= write_value(&current->epp, &current->epp_opened, EPP_PATH, cpu, epp);
+  if (epb[0] != '\0')
+    ok |= write_value(&current->epb, &current->epb_opened, EPB_PATH, cpu, epb);
+  __sync_lock_release(&current->lock);
+#ifdef VERBOSE
+  if (ok)
+    fprintf(stderr,"Setting energy performance preference failed %i!\n",ok);
+#endif
+  return ok;
+}
+
+int epp_process_before(void * vp, int32_t cpu)
+{
+  struct epp_information * info = vp;
+  return set_epp(info->epp_before, info->epb_before, cpu);
+}
+
+int epp_process_after(void * vp, int32_t cpu)
+{
+  struct epp_information * info = vp;
+  return set_epp(info->epp_after, info->epb_after, cpu);
+}
+
+int epp_fini(void)
+{
+  /* reset original values and close files */
+  int cpu;
+  int error = 0;
+  for (cpu = 0; cpu < nr_per_cpu_epp; cpu++)
+  {
+    error |= sysfs_file_restore(&per_cpu_epp[cpu].epp);
+    sysfs_file_close(&per_cpu_epp[cpu].epp);
+    error |= sysfs_file_restore(&per_cpu_epp[cpu].epb);
+    sysfs_file_close(&per_cpu_epp[cpu].epb);
+  }
+  free(per_cpu_epp);
+  per_cpu_epp = NULL;
+  nr_per_cpu_epp = 0;
+  return error;
+}
@@ -0,0 +1,49 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef EPP_H_
+#define EPP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libconfig.h>
+
+#define EPP_CONFIG_STRING "epp"
+#define EPB_CONFIG_STRING "epb"
+
+/* the value strings are written directly, an empty string means not set */
+#define EPP_VALUE_SIZE 32
+
+struct epp_information{
+  char epp_before[EPP_VALUE_SIZE];
+  char epp_after[EPP_VALUE_SIZE];
+  char epb_before[EPP_VALUE_SIZE];
+  char epb_after[EPP_VALUE_SIZE];
+};
+
+int epp_init(void);
+
+int epp_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int epp_process_before(void * info, int32_t cpu);
+int epp_process_after(void * info, int32_t cpu);
+
+int epp_fini(void);
+
+#endif /* EPP_H_ */
@@ -23,13 +23,18 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
-#include <cpufreq.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdint.h>
+
+#include "fastcpufreq.h"
+#include "msr.h"
+#include "sysfs_file.h"
+#include "topology.h"
 
 
 /* find the greatest common divisor, if x == 0 it returns y */
@@ -44,86 +49,333 @@ static unsigned long gcd(unsigned long x, unsigned long y) {
     return y;
 }
 
+/* upper bound for the number of lookup bins of a single policy */
+#define FREQ_MAX_BINS 65536
+/* step width if a policy only reports a frequency range (e.g., amd-pstate) */
+#define FREQ_RANGE_STEP 100000
+
+/* all paths are below the sysfs root (see sysfs_file.h) */
+#define PATH_TO_CPU "/sys/devices/system/cpu"
+
+/* ratios of IA32_PERF_CTL are multiples of the 100 MHz bus clock */
+#define FREQ_MSR_BUS_CLOCK 100000
+
 typedef struct lenstr {
-    char*         str;
+    char          str[16];
     size_t        len;
     unsigned long freq;
+    uint64_t      ratio;
 } lenstr;
 
+/* all cpus of a cpufreq policy share one frequency domain and one table of
+ * available frequencies.
+ * bins[f / resolution] holds the index of the largest table entry that is
+ * lower than or equal to f, so a lookup needs at most a few comparisons.
+ * The frequency is written once per policy, applied caches the last write.
+ * lock serializes the requests of the cpus, the arbitration, and the write. */
+typedef struct freq_policy {
+    unsigned int  first_cpu;
+    lenstr*       table;
+    size_t        num_freqs;
+    unsigned long resolution;
+    size_t        num_bins;
+    unsigned int* bins;
+    unsigned int* cpus;
+    unsigned int  num_cpus;
+    int           backend;
+    struct sysfs_file governor;
+    struct sysfs_file setspeed;
+    struct sysfs_file min;
+    struct sysfs_file max;
+    unsigned long min_freq;
+    unsigned long max_freq;
+    /* the ratio in IA32_PERF_CTL before the first write */
+    uint64_t      msr_ratio;
+    const lenstr* applied;
+    volatile int  lock;
+} freq_policy;
+
+/* userspace governor, frequency is written to scaling_setspeed */
+#define FREQ_BACKEND_SETSPEED 0
+/* any other governor (e.g., intel_pstate, amd-pstate), the frequency is
+ * pinned via scaling_min_freq and scaling_max_freq */
+#define FREQ_BACKEND_MINMAX   1
+/* userspace governor, the ratio is written to IA32_PERF_CTL of every cpu */
+#define FREQ_BACKEND_MSR      2
+
 static unsigned int num_cpus = 0;
-static lenstr* freq_lenstr_map      = NULL;
-int *freq_fds                       = NULL;
-static unsigned long *freq_settings = NULL;
-static unsigned long freq_gcd       = 0;
-static size_t num_freq_bins         = 0;
-static unsigned long freq_turbo     = 0;
+static freq_policy* freq_policies   = NULL;
+static unsigned int num_policies    = 0;
+/* policy index of every cpu, -1 if the cpu is not handled by cpufreq */
+static int* cpu_policy              = NULL;
+/* the last frequency that has been requested for every cpu */
+static const lenstr** freq_requests = NULL;
+static int arbitration              = FCF_ARBITRATE_LAST;
+static int requested_backend        = FCF_BACKEND_SYSFS;
+/* whether a policy uses FREQ_BACKEND_MSR, IA32_PERF_CTL is restored then */
+static int msr_used                 = 0;
 
 static int initialized = 0;
 
-static size_t freq_index(const unsigned long frequency) {
-    if (frequency == freq_turbo) {
+/* snap frequency to the nearest available one of the policy */
+static inline const lenstr* freq_lookup(const freq_policy* policy, const unsigned long frequency) {
+    size_t bin = frequency / policy->resolution;
+    size_t idx;
+    if (bin >= policy->num_bins) {
+        return &policy->table[policy->num_freqs - 1];
+    }
+    if (frequency <= policy->table[0].freq) {
+        return &policy->table[0];
+    }
+    idx = policy->bins[bin];
+    while (idx + 1 < policy->num_freqs && policy->table[idx + 1].freq <= frequency) {
+        idx++;
+    }
+    if (idx + 1 < policy->num_freqs &&
+        policy->table[idx + 1].freq - frequency < frequency - policy->table[idx].freq) {
+        idx++;
+    }
+    return &policy->table[idx];
+}
+
+static int compare_freq(const void* a, const void* b) {
+    const unsigned long fa = *(const unsigned long*)a;
+    const unsigned long fb = *(const unsigned long*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+/* read a file of the cpufreq directory of cpu into buffer, returns the
+ * number of read bytes or -1 */
+static ssize_t freq_read(unsigned int cpu, const char* file, char* buffer, size_t size) {
+    char path[255];
+    ssize_t len;
+    int fd;
+    if (sysfs_path(path, sizeof(path), PATH_TO_CPU "/cpu%u/cpufreq/%s", cpu, file)) {
+        return -1;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    len = read(fd, buffer, size - 1);
+    close(fd);
+    if (len < 0) {
+        return -1;
+    }
+    buffer[len] = '\0';
+    return len;
+}
+
+/* read a list of numbers that are separated by spaces (e.g., frequencies or
+ * cpus), returns the number of values, 0 on error. *values has to be freed */
+static size_t freq_read_list(unsigned int cpu, const char* file, unsigned long** values) {
+    char buffer[4096];
+    char* position = buffer;
+    char* end;
+    size_t n = 0;
+    ssize_t len = freq_read(cpu, file, buffer, sizeof(buffer));
+    if (len <= 0) {
         return 0;
     }
-    assert(frequency % freq_gcd == 0);
-    size_t idx = frequency / freq_gcd;
-    assert(idx < num_freq_bins);
-    return idx;
-}
-
-static void freq_str_init() {
-    /* TODO: Check if other cpus have same frequencies */
-    char freq_str[10];
-    struct cpufreq_available_frequencies* caf_first = cpufreq_get_available_frequencies(0);
-    assert(caf_first);
-    struct cpufreq_available_frequencies* caf = caf_first;
-    unsigned long max_frequency = 0;
-    for (; caf != NULL; caf = caf->next) {
-        if (caf->frequency % 10000 == 1000) {
-            assert(0 == freq_turbo);
-            freq_turbo = caf->frequency;
-#ifdef VERBOSE
-            printf("fcf: turbo %lu\n", freq_turbo);
-#endif            
+    /* every value needs at least two characters */
+    *values = calloc(len / 2 + 1, sizeof(**values));
+    if (*values == NULL) {
+        return 0;
+    }
+    for (;;) {
+        unsigned long value = strtoul(position, &end, 10);
+        if (end == position) {
+            break;
         }
-        else {
-            if (caf->frequency > max_frequency) {
-                max_frequency = caf->frequency;
+        (*values)[n++] = value;
+        position = end;
+    }
+    if (n == 0) {
+        free(*values);
+    }
+    return n;
+}
+
+static int freq_read_value(unsigned int cpu, const char* file, unsigned long* value) {
+    char buffer[32];
+    char* end;
+    if (freq_read(cpu, file, buffer, sizeof(buffer)) <= 0) {
+        return -1;
+    }
+    *value = strtoul(buffer, &end, 10);
+    return end == buffer ? -1 : 0;
+}
+
+/* read the available frequencies of cpu, sorted and without duplicates.
+ * Drivers without a list only report limits, these are split into steps. */
+static unsigned long* freq_read_available(unsigned int cpu, size_t* num) {
+    unsigned long* freqs = NULL;
+    size_t n, i, j;
+
+    n = freq_read_list(cpu, "scaling_available_frequencies", &freqs);
+    if (n > 0) {
+        /* drop zeros */
+        for (i = 0, j = 0; i < n; i++) {
+            if (freqs[i] > 0) {
+                freqs[j++] = freqs[i];
             }
-            freq_gcd = gcd(freq_gcd, caf->frequency);
-#ifdef VERBOSE
-            printf("fcf: freq %lu, gcd %lu\n", caf->frequency, freq_gcd);
-#endif
         }
+        n = j;
+    }
+    else {
+        unsigned long min, max, freq;
+        if (freq_read_value(cpu, "cpuinfo_min_freq", &min) ||
+            freq_read_value(cpu, "cpuinfo_max_freq", &max) || min == 0 || max < min) {
+            return NULL;
+        }
+        n = 2 + (max - min) / FREQ_RANGE_STEP;
+        freqs = calloc(n, sizeof(*freqs));
+        if (freqs == NULL) {
+            return NULL;
+        }
+        n = 0;
+        for (freq = min; freq < max; freq += FREQ_RANGE_STEP) {
+            freqs[n++] = freq;
+        }
+        freqs[n++] = max;
+    }
+    if (n == 0) {
+        free(freqs);
+        return NULL;
+    }
+    qsort(freqs, n, sizeof(*freqs), compare_freq);
+    for (i = 1, j = 1; i < n; i++) {
+        if (freqs[i] != freqs[j - 1]) {
+            freqs[j++] = freqs[i];
+        }
+    }
+    *num = j;
+    return freqs;
+}
+
+static int freq_policy_init(freq_policy* policy, unsigned int cpu) {
+    unsigned long max_frequency;
+    unsigned long* freqs;
+    size_t num, i, bin;
+
+    freqs = freq_read_available(cpu, &num);
+    if (freqs == NULL) {
+        return EINVAL;
+    }
+    policy->first_cpu = cpu;
+    policy->num_freqs = num;
+    policy->table = calloc(num, sizeof(*policy->table));
+    if (policy->table == NULL) {
+        free(freqs);
+        return ENOMEM;
+    }
+    policy->resolution = 0;
+    for (i = 0; i < num; i++) {
+        snprintf(policy->table[i].str, sizeof(policy->table[i].str), "%lu", freqs[i]);
+        policy->table[i].len = strlen(policy->table[i].str);
+        policy->table[i].freq = freqs[i];
+        policy->table[i].ratio = (freqs[i] + FREQ_MSR_BUS_CLOCK / 2) / FREQ_MSR_BUS_CLOCK;
+        policy->resolution = gcd(policy->resolution, freqs[i]);
+    }
+    free(freqs);
+    max_frequency = policy->table[num - 1].freq;
+    /* frequencies with odd values (e.g., turbo at max+1000) lead to a fine
+     * resolution, limit the memory for these */
+    if (max_frequency / policy->resolution >= FREQ_MAX_BINS) {
+        policy->resolution = max_frequency / (FREQ_MAX_BINS - 1) + 1;
+    }
+    policy->num_bins = 1 + max_frequency / policy->resolution;
+    policy->bins = calloc(policy->num_bins, sizeof(*policy->bins));
+    if (policy->bins == NULL) {
+        return ENOMEM;
+    }
+    for (bin = 0, i = 0; bin < policy->num_bins; bin++) {
+        while (i + 1 < num && policy->table[i + 1].freq <= bin * policy->resolution) {
+            i++;
+        }
+        policy->bins[bin] = i;
     }
-    num_freq_bins = 1 + (max_frequency / freq_gcd);
 #ifdef VERBOSE
-    printf("fcf: detected %zu frequency bins (gdc %lu) with maximum of %lu and %lu turbo\n", num_freq_bins, freq_gcd, max_frequency, freq_turbo);
+    printf("fcf: policy of cpu %u: %zu frequencies from %lu to %lu, %zu bins of %lu\n",
+           cpu, num, policy->table[0].freq, max_frequency, policy->num_bins, policy->resolution);
 #endif
-    freq_lenstr_map = calloc(num_freq_bins, sizeof(*freq_lenstr_map));
-    assert(freq_lenstr_map);
-    for (caf = caf_first; caf != NULL; caf = caf->next) {
-        snprintf(freq_str, sizeof(freq_str), "%lu", caf->frequency);
-        char* str = strdup(freq_str);
-        size_t idx = freq_index(caf->frequency);
-        freq_lenstr_map[idx].str = str;
-        freq_lenstr_map[idx].len = strlen(str);
-        freq_lenstr_map[idx].freq = caf->frequency;
+    return 0;
+}
+
+static void freq_policies_cleanup() {
+    for (unsigned int i = 0; i < num_policies; i++) {
+        free(freq_policies[i].table);
+        free(freq_policies[i].bins);
+        free(freq_policies[i].cpus);
     }
-    cpufreq_put_available_frequencies(caf_first);
+    free(freq_policies);
+    freq_policies = NULL;
+    num_policies = 0;
+    free(cpu_policy);
+    cpu_policy = NULL;
 }
 
-static void freq_str_cleanup() {
-    for (size_t i = 0; i < num_freq_bins; i++) {
-        if (freq_lenstr_map[i].str) {
-            free(freq_lenstr_map[i].str);
-            freq_lenstr_map[i].str = 0;
-            freq_lenstr_map[i].len = 0;
+/* group the cpus by their cpufreq policy and read a frequency table for each
+ * policy. Policies can differ, e.g., on hybrid processors. */
+static int freq_policies_init() {
+    unsigned long* related;
+    size_t num_related;
+    int ret;
+
+    cpu_policy = calloc(num_cpus, sizeof(*cpu_policy));
+    freq_policies = calloc(num_cpus, sizeof(*freq_policies));
+    if (cpu_policy == NULL || freq_policies == NULL) {
+        freq_policies_cleanup();
+        return ENOMEM;
+    }
+    for (unsigned cpu = 0; cpu < num_cpus; cpu++) {
+        cpu_policy[cpu] = -1;
+    }
+    for (unsigned cpu = 0; cpu < num_cpus; cpu++) {
+        if (cpu_policy[cpu] != -1) {
+            continue;
+        }
+        /* offline cpus or cpus without cpufreq support are skipped */
+        num_related = freq_read_list(cpu, "related_cpus", &related);
+        if (num_related == 0) {
+            continue;
+        }
+        ret = freq_policy_init(&freq_policies[num_policies], cpu);
+        if (ret) {
+            free(related);
+            num_policies++;
+            freq_policies_cleanup();
+            return ret;
+        }
+        for (size_t i = 0; i < num_related; i++) {
+            if (related[i] < num_cpus) {
+                cpu_policy[related[i]] = num_policies;
+            }
         }
+        /* related_cpus should always contain the cpu itself */
+        cpu_policy[cpu] = num_policies;
+        free(related);
+        num_policies++;
     }
-    free(freq_lenstr_map);
-    freq_lenstr_map = NULL;
-    freq_gcd        = 0;
-    num_freq_bins       = 0;
+    /* collect the cpus of every policy for arbitration */
+    for (unsigned int i = 0; i < num_policies; i++) {
+        freq_policies[i].governor.fd = -1;
+        freq_policies[i].setspeed.fd = -1;
+        freq_policies[i].min.fd = -1;
+        freq_policies[i].max.fd = -1;
+        freq_policies[i].cpus = calloc(num_cpus, sizeof(*freq_policies[i].cpus));
+        if (freq_policies[i].cpus == NULL) {
+            freq_policies_cleanup();
+            return ENOMEM;
+        }
+    }
+    for (unsigned cpu = 0; cpu < num_cpus; cpu++) {
+        if (cpu_policy[cpu] >= 0) {
+            freq_policy* policy = &freq_policies[cpu_policy[cpu]];
+            policy->cpus[policy->num_cpus++] = cpu;
+        }
+    }
+    return 0;
 }
 
 
@@ -131,35 +383,264 @@ static void freq_str_cleanup() {
  * The state of the initialization is checked in fcf_set_frequency() as single entry point 
  */
 
-static inline const lenstr* freq_get_lenstr(const unsigned long freq) {
-    const lenstr* ls = &freq_lenstr_map[freq_index(freq)];
-    return ls;
+static inline const lenstr* freq_get_lenstr(const unsigned int cpu, const unsigned long freq) {
+    return freq_lookup(&freq_policies[cpu_policy[cpu]], freq);
 }
 
-static inline int freq_get_fd(const int cpu) {
-    const int fd = freq_fds[cpu];
-    return fd;
+/* select the frequency of a policy from the requests of its cpus */
+static inline const lenstr* freq_arbitrate(const freq_policy* policy, const lenstr* last) {
+    const lenstr* result = last;
+    if (arbitration == FCF_ARBITRATE_LAST) {
+        return last;
+    }
+    for (unsigned int i = 0; i < policy->num_cpus; i++) {
+        const lenstr* request = freq_requests[policy->cpus[i]];
+        if (request == NULL) {
+            continue;
+        }
+        if (arbitration == FCF_ARBITRATE_MAX ? request->freq > result->freq
+                                             : request->freq < result->freq) {
+            result = request;
+        }
+    }
+    return result;
 }
 
-#define PATH_TO_CPU "/sys/devices/system/cpu"
-static void freq_fds_init() {
+static int freq_open(freq_policy* policy, struct sysfs_file* file, const char* name) {
+    /* cpu<first_cpu>/cpufreq links to policy<first_cpu> */
+    return sysfs_file_open(file, PATH_TO_CPU "/cpu%u/cpufreq/%s", policy->first_cpu, name);
+}
+
+/* select the userspace governor, the original governor is restored by
+ * fcf_finalize. Returns 0 if it is active afterwards */
+static int freq_select_userspace(freq_policy* policy) {
+    char current[SYSFS_FILE_VALUE_SIZE];
+    ssize_t len;
+    int ret;
+    if (policy->governor.fd == -1) {
+        ret = freq_open(policy, &policy->governor, "scaling_governor");
+        if (ret) {
+            return ret;
+        }
+    }
+    ret = sysfs_file_write(&policy->governor, "userspace", strlen("userspace"));
+    if (ret) {
+        return ret;
+    }
+    /* the driver may not support it */
+    len = freq_read(policy->first_cpu, "scaling_governor", current, sizeof(current));
+    if (len < 0) {
+        return errno;
+    }
+    return strncmp(current, "userspace", strlen("userspace")) == 0 ? 0 : EPERM;
+}
+
+/* the layout of IA32_PERF_CTL is only known for Intel processors. The vendor
+ * is read from /proc/cpuinfo below the sysfs root instead of cpuid, so a
+ * fake tree can provide it for testing */
+static int freq_msr_supported() {
     char path[255];
-    freq_fds = calloc(num_cpus, sizeof(*freq_fds));
-    assert(freq_fds);
-    for (unsigned cpu = 0; cpu < num_cpus; cpu++) {
-        snprintf(path, sizeof(path),
-                 PATH_TO_CPU "/cpu%u/cpufreq/scaling_setspeed",
-                 cpu);
-        freq_fds[cpu] = open(path, O_WRONLY);
-        assert(freq_fds[cpu] != -1);
+    char line[256];
+    FILE* cpuinfo;
+    int intel = 0;
+    if (sysfs_path(path, sizeof(path), "/proc/cpuinfo")) {
+        return 0;
+    }
+    cpuinfo = fopen(path, "r");
+    if (cpuinfo == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), cpuinfo)) {
+        if (strncmp(line, "vendor_id", strlen("vendor_id")) == 0) {
+            intel = strstr(line, "GenuineIntel") != NULL;
+            break;
+        }
     }
+    fclose(cpuinfo);
+    return intel;
 }
 
-static void freq_fds_cleanup() {
-    for (unsigned cpu = 0; cpu < num_cpus; cpu++) {
-        close(freq_fds[cpu]);
+/* writing IA32_PERF_CTL is only safe if no governor changes it as well,
+ * i.e., the userspace governor is active */
+static int freq_msr_init(freq_policy* policy) {
+    /* an empty mask only reads and caches the register */
+    const struct msr_update probe = { MSR_IA32_PERF_CTL, 0, 0 };
+    uint64_t value;
+    int fd;
+    int ret = freq_select_userspace(policy);
+    if (ret) {
+        return ret;
+    }
+    for (unsigned int i = 0; i < policy->num_cpus; i++) {
+        int ret = msr_cached_update(policy->cpus[i], 1, &probe);
+        if (ret) {
+            return ret;
+        }
+    }
+    fd = msr_open(policy->first_cpu);
+    if (fd < 0) {
+        return errno;
+    }
+    ret = msr_read(fd, MSR_IA32_PERF_CTL, &value);
+    close(fd);
+    policy->msr_ratio = (value >> 8) & 0xFF;
+    return ret;
+}
+
+/* select the backend of every policy: IA32_PERF_CTL if requested, otherwise
+ * scaling_setspeed if the userspace governor can be used, otherwise
+ * scaling_min_freq and scaling_max_freq */
+static int freq_fds_init() {
+    int use_msr = requested_backend == FCF_BACKEND_MSR;
+    if (use_msr && !freq_msr_supported()) {
+        fprintf(stderr, "libadapt: IA32_PERF_CTL is only used on Intel processors, using sysfs\n");
+        use_msr = 0;
+    }
+    for (unsigned int i = 0; i < num_policies; i++) {
+        freq_policy* policy = &freq_policies[i];
+        if (use_msr) {
+            int ret = freq_msr_init(policy);
+            if (ret == 0) {
+                policy->backend = FREQ_BACKEND_MSR;
+                msr_used = 1;
+                continue;
+            }
+            fprintf(stderr, "libadapt: policy%u can not use IA32_PERF_CTL (%s), using sysfs\n",
+                    policy->first_cpu, strerror(ret));
+        }
+        if (freq_select_userspace(policy) == 0 &&
+            freq_open(policy, &policy->setspeed, "scaling_setspeed") == 0) {
+            policy->backend = FREQ_BACKEND_SETSPEED;
+            continue;
+        }
+        /* the governor is kept */
+        sysfs_file_restore(&policy->governor);
+        policy->backend = FREQ_BACKEND_MINMAX;
+        int ret = freq_open(policy, &policy->min, "scaling_min_freq");
+        if (ret == 0) {
+            ret = freq_open(policy, &policy->max, "scaling_max_freq");
+        }
+        if (ret) {
+            return ret;
+        }
+        policy->min_freq = strtoul(policy->min.original, NULL, 10);
+        policy->max_freq = strtoul(policy->max.original, NULL, 10);
+#ifdef VERBOSE
+        printf("fcf: policy%u uses scaling_min_freq/scaling_max_freq\n", policy->first_cpu);
+#endif
+    }
+    return 0;
+}
+
+/* restore scaling_min_freq and scaling_max_freq in the order that keeps
+ * min <= max */
+static int freq_restore_limits(freq_policy* policy) {
+    int ret = 0;
+    if (sysfs_file_restore(&policy->max)) {
+        if (sysfs_file_restore(&policy->min) || sysfs_file_restore(&policy->max)) {
+            ret = -1;
+        }
+    }
+    else if (sysfs_file_restore(&policy->min)) {
+        ret = -1;
+    }
+    policy->min_freq = strtoul(policy->min.original, NULL, 10);
+    policy->max_freq = strtoul(policy->max.original, NULL, 10);
+    return ret;
+}
+
+/* restore the governor and the limits of every policy and close the files */
+static int freq_fds_cleanup() {
+    int ret = 0;
+    for (unsigned int i = 0; i < num_policies; i++) {
+        freq_policy* policy = &freq_policies[i];
+        if (sysfs_file_restore(&policy->governor)) {
+            ret = -1;
+        }
+        if (freq_restore_limits(policy)) {
+            ret = -1;
+        }
+        sysfs_file_close(&policy->governor);
+        sysfs_file_close(&policy->setspeed);
+        sysfs_file_close(&policy->min);
+        sysfs_file_close(&policy->max);
+    }
+    return ret;
+}
+
+static inline int freq_write(struct sysfs_file* file, const lenstr* ls) {
+    int ret = sysfs_file_write(file, ls->str, ls->len);
+    if (ret) {
+        errno = ret;
+        return -1;
+    }
+    return 0;
+}
+
+/* pin the policy to the frequency. For the min/max backend the order of
+ * writes keeps scaling_min_freq <= scaling_max_freq at any time */
+static inline int freq_write_policy(freq_policy* policy, const lenstr* ls) {
+    if (policy->backend == FREQ_BACKEND_SETSPEED) {
+        return freq_write(&policy->setspeed, ls);
+    }
+    if (policy->backend == FREQ_BACKEND_MSR) {
+        /* bits 15:8 hold the ratio, the other bits are kept */
+        const struct msr_update update = { MSR_IA32_PERF_CTL, 0xFF00, (ls->ratio & 0xFF) << 8 };
+        for (unsigned int i = 0; i < policy->num_cpus; i++) {
+            int ret = msr_cached_update(policy->cpus[i], 1, &update);
+            if (ret) {
+                errno = ret;
+                return -1;
+            }
+        }
+        return 0;
+    }
+    if (ls->freq > policy->max_freq) {
+        if (freq_write(&policy->max, ls)) {
+            return -1;
+        }
+        policy->max_freq = ls->freq;
+        if (freq_write(&policy->min, ls)) {
+            return -1;
+        }
+        policy->min_freq = ls->freq;
+    }
+    else {
+        if (freq_write(&policy->min, ls)) {
+            return -1;
+        }
+        policy->min_freq = ls->freq;
+        if (freq_write(&policy->max, ls)) {
+            return -1;
+        }
+        policy->max_freq = ls->freq;
     }
-    free(freq_fds);
+    return 0;
+}
+
+/* return the policy to the frequency it had before the first write. The
+ * min/max backend restores the range of the governor */
+static int freq_restore_policy(freq_policy* policy) {
+    if (policy->backend == FREQ_BACKEND_SETSPEED) {
+        int ret = sysfs_file_restore(&policy->setspeed);
+        if (ret) {
+            errno = ret;
+            return -1;
+        }
+        return 0;
+    }
+    if (policy->backend == FREQ_BACKEND_MSR) {
+        const struct msr_update update = { MSR_IA32_PERF_CTL, 0xFF00, policy->msr_ratio << 8 };
+        for (unsigned int i = 0; i < policy->num_cpus; i++) {
+            int ret = msr_cached_update(policy->cpus[i], 1, &update);
+            if (ret) {
+                errno = ret;
+                return -1;
+            }
+        }
+        return 0;
+    }
+    return freq_restore_limits(policy);
 }
 
 
@@ -168,29 +649,113 @@ long fcf_set_frequency(unsigned int cpu, unsigned long target_frequency) {
     if (!initialized) {
         return -1;
     }
-    if (cpu >= num_cpus) {
+    if (cpu >= num_cpus || cpu_policy[cpu] < 0) {
         return -2;
     }
-    
-    if (freq_settings[cpu] == target_frequency) {
-        return target_frequency;
+
+    freq_policy* policy = &freq_policies[cpu_policy[cpu]];
+    const lenstr* ls = freq_lookup(policy, target_frequency);
+
+    /* other cpus of the policy could change their requests or write the
+     * frequency in between */
+    while (__sync_lock_test_and_set(&policy->lock, 1))
+        ;
+    freq_requests[cpu] = ls;
+
+    const lenstr* domain = freq_arbitrate(policy, ls);
+    if (policy->applied == domain) {
+        __sync_lock_release(&policy->lock);
+        return ls->freq;
     }
 
-    const int fd     = freq_get_fd(cpu);
-    const lenstr* ls = freq_get_lenstr(target_frequency);
 #ifdef VERBOSE
-    fprintf(stderr,"Setting frequency to %li %s!\n",target_frequency,ls->str);
+    fprintf(stderr,"Setting frequency of policy%u to %s for %li!\n",policy->first_cpu,domain->str,target_frequency);
 #endif
-    const ssize_t ret    = pwrite(fd, ls->str, ls->len, 0);
-    if (ret != (ssize_t)ls->len) {
-        fprintf(stderr, "libadapt ERROR: Failed to set frequency for cpu %d to %lu/'%s' (%zu): %s\n", cpu, target_frequency, ls->str, ls->len, strerror(errno));
+    if (freq_write_policy(policy, domain)) {
+        fprintf(stderr, "libadapt ERROR: Failed to set frequency for cpu %d to %lu/'%s' (%zu): %s\n", cpu, target_frequency, domain->str, domain->len, strerror(errno));
+        /* the state of a partial min/max write is unknown */
+        policy->applied = NULL;
+        __sync_lock_release(&policy->lock);
         return -1;
     }
-    freq_settings[cpu] = target_frequency;
+    policy->applied = domain;
+    __sync_lock_release(&policy->lock);
 #ifdef VERBOSE
-    fprintf(stderr,"Return %li!\n",target_frequency);
+    fprintf(stderr,"Return %lu!\n",ls->freq);
 #endif
-    return target_frequency;
+    return ls->freq;
+}
+
+void fcf_set_arbitration(int policy) {
+    arbitration = policy;
+}
+
+void fcf_clear_request(unsigned int cpu) {
+    if (!initialized || cpu >= num_cpus || cpu_policy[cpu] < 0) {
+        return;
+    }
+    freq_policy* policy = &freq_policies[cpu_policy[cpu]];
+    while (__sync_lock_test_and_set(&policy->lock, 1))
+        ;
+    freq_requests[cpu] = NULL;
+    __sync_lock_release(&policy->lock);
+}
+
+long fcf_release_request(unsigned int cpu) {
+    if (!initialized) {
+        return -1;
+    }
+    if (cpu >= num_cpus || cpu_policy[cpu] < 0) {
+        return -2;
+    }
+    freq_policy* policy = &freq_policies[cpu_policy[cpu]];
+    const lenstr* domain = NULL;
+    long ret = 0;
+    while (__sync_lock_test_and_set(&policy->lock, 1))
+        ;
+    freq_requests[cpu] = NULL;
+    for (unsigned int i = 0; i < policy->num_cpus && domain == NULL; i++) {
+        domain = freq_requests[policy->cpus[i]];
+    }
+    if (domain == NULL) {
+        if (policy->applied != NULL && freq_restore_policy(policy)) {
+            fprintf(stderr, "libadapt ERROR: Failed to restore the frequency of policy%u: %s\n", policy->first_cpu, strerror(errno));
+            ret = -1;
+        }
+        policy->applied = NULL;
+        __sync_lock_release(&policy->lock);
+        return ret;
+    }
+    domain = freq_arbitrate(policy, domain);
+    if (policy->applied != domain) {
+        if (freq_write_policy(policy, domain)) {
+            fprintf(stderr, "libadapt ERROR: Failed to set frequency of policy%u to '%s': %s\n", policy->first_cpu, domain->str, strerror(errno));
+            policy->applied = NULL;
+            __sync_lock_release(&policy->lock);
+            return -1;
+        }
+        policy->applied = domain;
+    }
+    __sync_lock_release(&policy->lock);
+    return domain->freq;
+}
+
+unsigned long fcf_get_frequency(unsigned int cpu) {
+    if (!initialized || cpu >= num_cpus || freq_requests[cpu] == NULL) {
+        return 0;
+    }
+    return freq_requests[cpu]->freq;
+}
+
+int fcf_get_policy(unsigned int cpu) {
+    if (!initialized || cpu >= num_cpus) {
+        return -1;
+    }
+    return cpu_policy[cpu];
+}
+
+void fcf_set_backend(int backend) {
+    requested_backend = backend;
 }
 
 
@@ -202,32 +767,41 @@ int fcf_init_once() {
     }
     called = 1;
     
-    /* TODO: what to do with broken setups, e.g. the Haswell platform, 
-     * where CPUs are not continuously numbered?
-     *
-     * Possible solution to parse /proc/cpuinfo
-     * No Computer with discontinously cpu numbers found */
-    num_cpus = sysconf(_SC_NPROCESSORS_CONF);
-    for (unsigned cpu = 0; cpu < num_cpus; cpu++) {
-        /* Missing cpu numbers are no problem for 
-         * cpufreq_modify_policy_governor */
-        ret = cpufreq_modify_policy_governor(cpu, "userspace");
-        if (ret)
-          return ret;
-    }
-    freq_settings = calloc(num_cpus, sizeof(*freq_settings));
-    if (freq_settings == NULL)
+    /* the possible cpus below the sysfs root, which also covers cpus that
+     * are not continuously numbered */
+    num_cpus = topology_init() == 0 ? topology_nr_cpus() : sysconf(_SC_NPROCESSORS_CONF);
+    freq_requests = calloc(num_cpus, sizeof(*freq_requests));
+    if (freq_requests == NULL)
         return ENOMEM;
-    freq_str_init();
-    freq_fds_init();
+    ret = freq_policies_init();
+    if (ret) {
+        free(freq_requests);
+        return ret;
+    }
+    /* the governor is selected per policy */
+    ret = freq_fds_init();
+    if (ret) {
+        freq_fds_cleanup();
+        freq_policies_cleanup();
+        free(freq_requests);
+        return ret;
+    }
     initialized = 1;
     return 0;
 }
 
 int fcf_finalize() {
-    freq_fds_cleanup();
-    freq_str_cleanup();
-    free(freq_settings);
+    int ret = 0;
+    /* IA32_PERF_CTL is not restored by restoring the cpufreq policy */
+    if (msr_used && msr_cached_restore(MSR_IA32_PERF_CTL)) {
+        ret = -1;
+    }
+    msr_used = 0;
+    if (freq_fds_cleanup()) {
+        ret = -1;
+    }
+    freq_policies_cleanup();
+    free(freq_requests);
     initialized = 0;
-    return 0;
+    return ret;
 }
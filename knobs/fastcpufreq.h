@@ -17,34 +17,107 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.*
  ***********************************************************************/
 
+#ifndef FASTCPUFREQ_H_
+#define FASTCPUFREQ_H_
+
+/* how the frequency of a cpufreq policy is selected if its cpus request
+ * different frequencies */
+#define FCF_ARBITRATE_LAST 0
+#define FCF_ARBITRATE_MAX  1
+#define FCF_ARBITRATE_MIN  2
+
+/* how the frequency is written */
+#define FCF_BACKEND_SYSFS  0
+#define FCF_BACKEND_MSR    1
+
 /*
  * The function assumes the following:
- * - the userspace governor is always set (done by fcf_init_once)
- * - no two threads will call fcf_set_frequency on the same cpu concurrently
- *   nothing really bad will happen if you do, but you might not set the right frequency
+ * - the governor is not changed by others after fcf_init_once, which selects
+ *   the userspace governor where possible and otherwise pins the frequency
+ *   via scaling_min_freq and scaling_max_freq
+ * - fcf_set_frequency may be called concurrently, calls for cpus of the same
+ *   cpufreq policy are serialized by a lock of the policy
  * - cpu is an actual cpu number, never -1 or something stupid
- * - target_frequency is an actual available frequency number
  * - init is called at least once before
  * - finalize will be called once after
- * 
+ *
+ * target_frequency is snapped to the nearest frequency that is available
+ * for the cpufreq policy of cpu. Policies can have different frequencies.
+ * All cpus of a policy share one frequency. The request of cpu is stored and
+ * the frequency of the policy is selected from the requests of its cpus (see
+ * fcf_set_arbitration). It is only written if it changes.
+ *
  * returns the set frequency on success, negative number on error:
- *   -1: not initialized
- *   -2: invalid cpu selected
+ *   -1: not initialized or writing failed
+ *   -2: invalid cpu selected or cpu not handled by cpufreq
  */
 long fcf_set_frequency(unsigned int cpu, unsigned long target_frequency);
 
+/*
+ * Select how requests of the cpus of a policy are combined, one of
+ * FCF_ARBITRATE_LAST (default), FCF_ARBITRATE_MAX, FCF_ARBITRATE_MIN
+ */
+void fcf_set_arbitration(int policy);
+
+/*
+ * Remove the request of cpu, so it is ignored by the arbitration until the
+ * next fcf_set_frequency for cpu. The frequency is not written.
+ */
+void fcf_clear_request(unsigned int cpu);
+
+/*
+ * Remove the request of cpu and write the frequency that the remaining
+ * requests of its policy select. Without remaining requests, the policy
+ * returns to its state before the first fcf_set_frequency (scaling_setspeed
+ * or the ratio in IA32_PERF_CTL, or the range of scaling_min_freq and
+ * scaling_max_freq).
+ *
+ * returns the set frequency, 0 if the policy has been restored, or the
+ * errors of fcf_set_frequency
+ */
+long fcf_release_request(unsigned int cpu);
+
+/*
+ * returns the frequency that has been requested last for cpu, 0 if there was
+ * no request or cpu is not handled by cpufreq
+ */
+unsigned long fcf_get_frequency(unsigned int cpu);
+
+/*
+ * returns an id of the cpufreq policy of cpu, which is the same for all cpus
+ * that share a frequency, -1 if cpu is not handled by cpufreq
+ */
+int fcf_get_policy(unsigned int cpu);
+
+/*
+ * Select how the frequency is written, one of
+ * FCF_BACKEND_SYSFS (default): scaling_setspeed or scaling_min_freq/scaling_max_freq
+ * FCF_BACKEND_MSR: the ratio (frequency / 100 MHz) is written to IA32_PERF_CTL
+ *   of every cpu via /dev/cpu/<nr>/msr (see msr.h). This is only used on
+ *   Intel processors and for policies where the userspace governor is active
+ *   after fcf_init_once, other policies use sysfs. The original values are
+ *   restored by fcf_finalize.
+ * Has to be called before fcf_init_once.
+ */
+void fcf_set_backend(int backend);
+
 /*
  * May be called more than one time, but only has an effect once.
  * NOT thread safe!
+ *
+ * All cpufreq files, /proc/cpuinfo, and /dev/cpu/<nr>/msr are accessed below
+ * the sysfs root (see sysfs_file.h), so a fake tree can be used for testing.
  * 
  * returns 0 on success, -1 on error
  */
 int fcf_init_once();
 
 /*
+ * Restores the governor, scaling_min_freq and scaling_max_freq of every
+ * policy, and IA32_PERF_CTL with FCF_BACKEND_MSR.
+ *
  * returns 0 on success, -1 on error
- * 
- * Note: There is no cleanup of the set frequency.
- * It is your own responsibility to restore the settings if you want to.
  */
 int fcf_finalize();
+
+#endif /* FASTCPUFREQ_H_ */
@@ -18,6 +18,8 @@
  ***********************************************************************/
 
 #include "file.h"
+#include <errno.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -27,145 +29,363 @@
 
 #include <string.h>
 
+/* placeholder in file names that is replaced by the cpu */
+#define FILE_CPU_TEMPLATE "{cpu}"
 
-/* if realloc fail something is particular fail 
- * but we're going on and process the settings there fit in the memory
- * */
-#define BREAK_REALLOC_FAIL(ptr,size) \
-    tmp = realloc(ptr,size); \
-    if (tmp == NULL) \
-        break; \
-    else \
-        ptr = tmp; \
-    tmp = NULL;
+static const char * format_names[] =
+{
+  "text", "hex", "u8", "u16", "u32", "u64"
+};
+#define NR_FORMATS (sizeof(format_names)/sizeof(format_names[0]))
+
+/* a file_<nr> definition while reading the config */
+struct file_entry{
+  int target;
+  off_t offset;
+  struct iovec before;
+  struct iovec after;
+};
+
+static int open_file(const char * filename, int positional)
+{
+  /* with O_APPEND, pwrite would ignore the offset */
+  return open(filename, positional ? O_CREAT | O_RDWR : O_CREAT | O_RDWR | O_APPEND, S_IRUSR | S_IWUSR);
+}
+
+/* get the index of the target for a file name, add it if it is new */
+static int get_target(struct file_information * info, const char * filename, int positional)
+{
+  struct file_target * targets;
+  struct file_target * target;
+  int i;
+  for (i = 0; i < info->nr_targets; i++)
+    if (info->targets[i].positional == positional && strcmp(info->targets[i].filename, filename) == 0)
+      return i;
+  targets = realloc(info->targets, (info->nr_targets + 1) * sizeof(struct file_target));
+  if (targets == NULL)
+    return -1;
+  info->targets = targets;
+  target = &targets[info->nr_targets];
+  memset(target, 0, sizeof(struct file_target));
+  target->filename = strdup(filename);
+  target->positional = positional;
+  target->fd = -1;
+  if (strstr(filename, FILE_CPU_TEMPLATE) != NULL)
+  {
+    /* opened when the cpu is used first */
+    long nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    target->cpu_fds = malloc(nr_cpus * sizeof(int));
+    if (target->cpu_fds != NULL)
+    {
+      target->nr_cpu_fds = nr_cpus;
+      for (i = 0; i < nr_cpus; i++)
+        target->cpu_fds[i] = -2;
+    }
+  }
+  else
+    /* open file for later write */
+    target->fd = open_file(filename, positional);
+  return info->nr_targets++;
+}
+
+/* the fd of a target for a cpu (the current one if negative), -1 on error */
+static int get_fd(struct file_target * target, int32_t cpu)
+{
+  char path[1024];
+  const char * template;
+  int len = 0;
+  int fd;
+  const char * name = target->filename;
+
+  if (target->cpu_fds == NULL)
+    return target->fd;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  if (cpu < 0 || cpu >= target->nr_cpu_fds)
+    return -1;
+  if (target->cpu_fds[cpu] != -2)
+    return target->cpu_fds[cpu];
+  /* replace every {cpu} */
+  while ((template = strstr(name, FILE_CPU_TEMPLATE)) != NULL && len < sizeof(path))
+  {
+    len += snprintf(path + len, sizeof(path) - len, "%.*s%d", (int) (template - name), name, cpu);
+    name = template + strlen(FILE_CPU_TEMPLATE);
+  }
+  if (len < sizeof(path))
+    len += snprintf(path + len, sizeof(path) - len, "%s", name);
+  if (len >= sizeof(path))
+    fd = -1;
+  else
+    fd = open_file(path, target->positional);
+  /* another thread could have opened it in between */
+  if (!__sync_bool_compare_and_swap(&target->cpu_fds[cpu], -2, fd) && fd >= 0)
+    close(fd);
+  return target->cpu_fds[cpu];
+}
+
+static int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+/* convert a before or after setting to the bytes that are written, returns 0 on success */
+static int read_value(config_setting_t * setting, int format, struct iovec * iov)
+{
+  const char * string = NULL;
+  unsigned long long value = 0;
+  size_t i;
+
+  if (config_setting_type(setting) == CONFIG_TYPE_STRING)
+    string = config_setting_get_string(setting);
+  else
+    value = config_setting_get_int64(setting);
+
+  switch (format)
+  {
+  case FILE_FORMAT_TEXT:
+    if (string == NULL)
+    {
+      char number[32];
+      sprintf(number, "%lld", (long long) value);
+      iov->iov_base = strdup(number);
+    }
+    else
+      iov->iov_base = strdup(string);
+    if (iov->iov_base == NULL)
+      return 1;
+    iov->iov_len = strlen(iov->iov_base);
+    return 0;
+  case FILE_FORMAT_HEX:
+    /* "0a1b..." is written as the bytes 0x0a 0x1b ... */
+    if (string == NULL)
+      return 1;
+    if (strncmp(string, "0x", 2) == 0)
+      string += 2;
+    if (strlen(string) % 2)
+      return 1;
+    iov->iov_len = strlen(string) / 2;
+    iov->iov_base = malloc(iov->iov_len);
+    if (iov->iov_base == NULL)
+      return 1;
+    for (i = 0; i < iov->iov_len; i++)
+    {
+      int high = hex_digit(string[2 * i]);
+      int low = hex_digit(string[2 * i + 1]);
+      if (high < 0 || low < 0)
+      {
+        free(iov->iov_base);
+        iov->iov_base = NULL;
+        return 1;
+      }
+      ((unsigned char *) iov->iov_base)[i] = high << 4 | low;
+    }
+    return 0;
+  default:
+    /* integers in the byte order of the cpu, e.g., for /dev/cpu/<nr>/msr */
+    if (string != NULL)
+    {
+      char * end;
+      value = strtoull(string, &end, 0);
+      if (*end != '\0')
+        return 1;
+    }
+    iov->iov_len = 1 << (format - FILE_FORMAT_U8);
+    iov->iov_base = malloc(sizeof(uint64_t));
+    if (iov->iov_base == NULL)
+      return 1;
+    switch (format)
+    {
+    case FILE_FORMAT_U8:  *(uint8_t *) iov->iov_base = value; break;
+    case FILE_FORMAT_U16: *(uint16_t *) iov->iov_base = value; break;
+    case FILE_FORMAT_U32: *(uint32_t *) iov->iov_base = value; break;
+    default:              *(uint64_t *) iov->iov_base = value; break;
+    }
+    return 0;
+  }
+}
+
+/*
+ * Combine the values of one phase (before or after) into writes: all values
+ * that are appended to a file are written with a single writev, values at
+ * adjacent offsets with a single pwritev.
+ */
+static int build_writes(struct file_information * info, struct file_entry * entries, int nr_entries, int after, struct file_write ** writes_out)
+{
+  struct file_write * writes = NULL;
+  int nr_writes = 0;
+  int target, i, j;
+
+  *writes_out = NULL;
+  if (nr_entries == 0)
+    return 0;
+  for (target = 0; target < info->nr_targets; target++)
+  {
+    struct file_entry * sorted[nr_entries];
+    int nr_sorted = 0;
+    for (i = 0; i < nr_entries; i++)
+    {
+      struct iovec * iov = after ? &entries[i].after : &entries[i].before;
+      if (entries[i].target != target || iov->iov_base == NULL)
+        continue;
+      /* insertion sort by offset, appended values keep their order */
+      for (j = nr_sorted; j > 0 && sorted[j - 1]->offset > entries[i].offset; j--)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = &entries[i];
+      nr_sorted++;
+    }
+    for (i = 0; i < nr_sorted; i++)
+    {
+      struct iovec * iov = after ? &sorted[i]->after : &sorted[i]->before;
+      struct file_write * write = nr_writes ? &writes[nr_writes - 1] : NULL;
+      if (write == NULL || write->target != target ||
+          (write->offset >= 0 && write->offset + write->len != sorted[i]->offset))
+      {
+        struct file_write * tmp = realloc(writes, (nr_writes + 1) * sizeof(struct file_write));
+        if (tmp == NULL)
+          break;
+        writes = tmp;
+        write = &writes[nr_writes++];
+        memset(write, 0, sizeof(struct file_write));
+        write->target = target;
+        write->offset = sorted[i]->offset;
+      }
+      write->iov = realloc(write->iov, (write->nr_iov + 1) * sizeof(struct iovec));
+      if (write->iov == NULL)
+      {
+        nr_writes--;
+        break;
+      }
+      write->iov[write->nr_iov++] = *iov;
+      write->len += iov->iov_len;
+    }
+  }
+  *writes_out = writes;
+  return nr_writes;
+}
 
 int file_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix){
 
   int i;
   int was_set = 0;
   struct file_information * info = vp;
+  struct file_entry * entries = NULL;
+  int nr_entries = 0;
   config_setting_t *setting;
   /* Resetting Memory */
   memset(info,0,sizeof(struct file_information));
 
   for (i=0;i<32000;i++){
     /* TODO: Find better way to parse all the file container */
+    struct file_entry * entry;
+    const char * filename;
+    int format = FILE_FORMAT_TEXT;
 
     /* we need the name of the file */
     sprintf(buffer, "%s.%s_%d.name", prefix, FILE_CONFIG_STRING,i);
     setting = config_lookup(cfg, buffer);
+    if (setting == NULL || (filename = config_setting_get_string(setting)) == NULL)
+      break;
 
-    if (setting) {
-      /* another setting :) */
-      /* make an "array" with all the filenames and the string that should
-       * be wrtitten to the files */
-      /* temporary void pointer for the macro
-       * realloc gives us a void pointer back, so there is no problem*/
-      void *tmp;
-      BREAK_REALLOC_FAIL(info->filename,(i+1)*sizeof(char*));
-      BREAK_REALLOC_FAIL(info->fd,(i+1)*sizeof(int));
-      BREAK_REALLOC_FAIL(info->value_before,(i+1)*sizeof(char*));
-      BREAK_REALLOC_FAIL(info->value_before_len,(i+1)*sizeof(size_t));
-      BREAK_REALLOC_FAIL(info->value_after,(i+1)*sizeof(char*));
-      BREAK_REALLOC_FAIL(info->value_after_len,(i+1)*sizeof(size_t));
-      info->nr_files=i+1;
-
-
-      /* get the settings */
-      info->filename[i]=strdup(config_setting_get_string(setting));
-      /* open file for later write */
-      info->fd[i]=open(info->filename[i],O_CREAT | O_RDWR | O_APPEND,S_IRUSR| S_IWUSR);
-
-      /* string to write in file before */
-      sprintf(buffer, "%s.%s_%d.before", prefix, FILE_CONFIG_STRING,i);
-      setting = config_lookup(cfg, buffer);
-
-      if (setting){
-        info->value_before[i]=strdup(config_setting_get_string(setting));
-        info->value_before_len[i]=strlen(info->value_before[i]);
-        was_set=1;
-      }
-      else
-        info->value_before[i]=NULL;
+    entry = realloc(entries, (nr_entries + 1) * sizeof(struct file_entry));
+    if (entry == NULL)
+      break;
+    entries = entry;
+    entry = &entries[nr_entries];
+    memset(entry, 0, sizeof(struct file_entry));
 
-      /* string to write in file after */
-      sprintf(buffer, "%s.%s_%d.after", prefix, FILE_CONFIG_STRING,i);
-      setting = config_lookup(cfg, buffer);
+    /* write at an offset instead of appending */
+    sprintf(buffer, "%s.%s_%d.offset", prefix, FILE_CONFIG_STRING,i);
+    setting = config_lookup(cfg, buffer);
+    entry->offset = setting ? config_setting_get_int64(setting) : -1;
 
-      if (setting){
-        info->value_after[i]=strdup(config_setting_get_string(setting));
-        info->value_after_len[i]=strlen(info->value_after[i]);
-        was_set=1;
+    sprintf(buffer, "%s.%s_%d.format", prefix, FILE_CONFIG_STRING,i);
+    setting = config_lookup(cfg, buffer);
+    if (setting){
+      const char * name = config_setting_get_string(setting);
+      for (format = 0; format < NR_FORMATS; format++)
+        if (name != NULL && strcmp(name, format_names[format]) == 0)
+          break;
+      if (format == NR_FORMATS){
+        fprintf(stderr, "Unknown %s, use text, hex, u8, u16, u32, or u64\n", buffer);
+        continue;
       }
-      else
-        info->value_after[i]=NULL;
-
     }
-    else
+
+    entry->target = get_target(info, filename, entry->offset >= 0);
+    if (entry->target < 0)
       break;
+    nr_entries++;
 
+    /* value to write in file before */
+    sprintf(buffer, "%s.%s_%d.before", prefix, FILE_CONFIG_STRING,i);
+    setting = config_lookup(cfg, buffer);
+    if (setting){
+      if (read_value(setting, format, &entry->before))
+        fprintf(stderr, "Invalid value for %s\n", buffer);
+      else
+        was_set=1;
+    }
+
+    /* value to write in file after */
+    sprintf(buffer, "%s.%s_%d.after", prefix, FILE_CONFIG_STRING,i);
+    setting = config_lookup(cfg, buffer);
+    if (setting){
+      if (read_value(setting, format, &entry->after))
+        fprintf(stderr, "Invalid value for %s\n", buffer);
+      else
+        was_set=1;
+    }
   }
+  info->nr_before = build_writes(info, entries, nr_entries, 0, &info->before);
+  info->nr_after = build_writes(info, entries, nr_entries, 1, &info->after);
+  free(entries);
   /* retrun if there was set any file writings */
   return was_set;
 }
 
-int file_process_before(void * vp, int ignored){
+static int process(struct file_information * info, struct file_write * writes, int nr_writes, int32_t cpu){
   int i;
-  struct file_information * info = vp;
-  if (info->value_before == NULL) return 0;
+  int ok = 0;
 
-  for (i=0; i<info->nr_files; i++){
-    if (info->value_before[i] != NULL){
-#ifdef VERBOSE
-      fprintf(stderr, "Write to file %s: %s\n", info->filename[i], info->value_before[i]);
-#endif
-      if(write(info->fd[i], info->value_before[i], info->value_before_len[i]) != info->value_before_len[i]) {
+  for (i = 0; i < nr_writes; i++){
+    struct file_target * target = &info->targets[writes[i].target];
+    int fd = get_fd(target, cpu);
+    ssize_t written;
+    if (fd < 0){
+      ok = ENOENT;
+      continue;
+    }
 #ifdef VERBOSE
-        fprintf(stderr, "Writing before process failed for file %s\n", *(info->filename));
+    fprintf(stderr, "Write %zu bytes in %d parts to file %s (cpu %d) at offset %lld\n", writes[i].len, writes[i].nr_iov, target->filename, cpu, (long long) writes[i].offset);
 #endif
-        return 1;
-      }
+    if (writes[i].offset < 0)
+      written = writev(fd, writes[i].iov, writes[i].nr_iov);
+    else if (writes[i].nr_iov == 1)
+      written = pwrite(fd, writes[i].iov[0].iov_base, writes[i].len, writes[i].offset);
+    else
+      written = pwritev(fd, writes[i].iov, writes[i].nr_iov, writes[i].offset);
+    if (written != writes[i].len){
 #ifdef VERBOSE
-      char * buffer;
-      buffer = calloc(info->value_before_len[i] + 1, sizeof(char));
-      lseek(info->fd[i], -info->value_before_len[i], SEEK_CUR);
-      read(info->fd[i], buffer, info->value_before_len[i]);
-      buffer[info->value_after_len[i]] = '\0';
-      fprintf(stderr, "Value in file: %s", buffer);
-      free(buffer);
+      fprintf(stderr, "Writing failed for file %s\n", target->filename);
 #endif
+      ok = written < 0 ? errno : EIO;
     }
   }
-  return 0;
+  return ok;
 }
 
-int file_process_after(void * vp, int ignored){
-  int i;
+int file_process_before(void * vp, int32_t cpu){
   struct file_information * info = vp;
-  if (info->value_after == NULL) return 0;
-
-  for (i=0;i<info->nr_files;i++){
-    if (info->value_after[i] != NULL){
-#ifdef VERBOSE
-      fprintf(stderr, "Write to file %s: %s\n", info->filename[i], info->value_after[i]);
-#endif
-      if (write(info->fd[i], info->value_after[i], info->value_after_len[i]) != info->value_after_len[i]) {
-#ifdef VERBOSE
-        fprintf(stderr, "Writing after process failed for file %s\n", *(info->filename));
-#endif
-        return 1;
-      }
-#ifdef VERBOSE
-      char * buffer;
-      buffer = calloc(info->value_after_len[i] + 1, sizeof(char));
-      lseek(info->fd[i], -info->value_after_len[i], SEEK_CUR);
-      read(info->fd[i], buffer, info->value_after_len[i]);
-      buffer[info->value_after_len[i]] = '\0';
-      fprintf(stderr, "Value in file: %s", buffer);
-      free(buffer);
-#endif
-    }
-  }
-  return 0;
+  return process(info, info->before, info->nr_before, cpu);
 }
 
+int file_process_after(void * vp, int32_t cpu){
+  struct file_information * info = vp;
+  return process(info, info->after, info->nr_after, cpu);
+}
@@ -22,24 +22,54 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <libconfig.h>
 
 #define FILE_CONFIG_STRING "file"
 
+/* how before and after are written */
+#define FILE_FORMAT_TEXT 0
+#define FILE_FORMAT_HEX  1
+#define FILE_FORMAT_U8   2
+#define FILE_FORMAT_U16  3
+#define FILE_FORMAT_U32  4
+#define FILE_FORMAT_U64  5
+
+/* a file that is written, names with {cpu} have one fd per cpu */
+struct file_target{
+  char * filename;
+  /* written at offsets instead of appended */
+  int positional;
+  int fd;
+  /* per cpu, -2 if not opened yet, -1 if opening failed */
+  int * cpu_fds;
+  int nr_cpu_fds;
+};
+
+/* values that are written with a single (p)writev */
+struct file_write{
+  int target;
+  /* -1 to append */
+  off_t offset;
+  struct iovec * iov;
+  int nr_iov;
+  size_t len;
+};
+
 struct file_information{
-  char ** filename;
-  int * fd;
-  char ** value_before;
-  size_t * value_before_len;
-  char ** value_after;
-  size_t * value_after_len;
-  int nr_files;
+  struct file_target * targets;
+  int nr_targets;
+  struct file_write * before;
+  int nr_before;
+  struct file_write * after;
+  int nr_after;
 };
 
 int file_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
 
-int file_process_before(void * info,int ignored);
-int file_process_after(void * info,int ignored);
+int file_process_before(void * info,int32_t cpu);
+int file_process_after(void * info,int32_t cpu);
 
 
 #endif /* FILE_H_ */
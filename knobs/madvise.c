@@ -0,0 +1,351 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "madvise.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* advice of newer kernels, which is not provided by every libc */
+#ifndef MADV_COLD
+#define MADV_COLD 20
+#endif
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+/* maximal number of pending prefault requests */
+#define MADVISE_QUEUE_SIZE 64
+
+static const struct {
+  const char * name;
+  int32_t advice;
+} advice_names[] = {
+  {"normal", MADV_NORMAL},
+  {"random", MADV_RANDOM},
+  {"sequential", MADV_SEQUENTIAL},
+  {"willneed", MADV_WILLNEED},
+  {"dontneed", MADV_DONTNEED},
+  {"hugepage", MADV_HUGEPAGE},
+  {"nohugepage", MADV_NOHUGEPAGE},
+  {"cold", MADV_COLD},
+  {"pageout", MADV_PAGEOUT},
+  {"populate_read", MADV_POPULATE_READ},
+  {"populate_write", MADV_POPULATE_WRITE}
+};
+
+/* a memory range, the length is 0 until it is registered */
+struct memory_range{
+  char name[64];
+  uintptr_t address;
+  size_t length;
+};
+
+static struct memory_range ranges[MADVISE_MAX_RANGES];
+static int nr_ranges = 0;
+static volatile int ranges_lock = 0;
+
+/* a range that is prefaulted by the helper thread */
+struct prefault_request{
+  uintptr_t address;
+  size_t length;
+  int32_t advice;
+};
+
+/* ring buffer of pending prefault requests, protected by queue_mutex */
+static struct prefault_request queue[MADVISE_QUEUE_SIZE];
+static int queue_first = 0;
+static int queue_size = 0;
+static int helper_stop = 0;
+static int helper_started = 0;
+static pthread_t helper;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static void lock(void)
+{
+  while (__sync_lock_test_and_set(&ranges_lock, 1))
+    ;
+}
+
+static void unlock(void)
+{
+  __sync_lock_release(&ranges_lock);
+}
+
+/* find a range by name or add an unregistered one, called with ranges_lock
+ * held */
+static int32_t get_range(const char * name)
+{
+  int32_t i;
+  for (i = 0; i < nr_ranges; i++)
+    if (strcmp(ranges[i].name, name) == 0)
+      return i;
+  if (nr_ranges == MADVISE_MAX_RANGES || strlen(name) >= sizeof(ranges[0].name))
+    return -1;
+  strcpy(ranges[nr_ranges].name, name);
+  ranges[nr_ranges].address = 0;
+  ranges[nr_ranges].length = 0;
+  return nr_ranges++;
+}
+
+int madvise_register_range(const char * name, void * address, size_t length)
+{
+  uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t start, end;
+  int32_t range;
+
+  if (name == NULL)
+    return EINVAL;
+  /* only whole pages within the range are advised, so data next to it is
+   * not affected by destructive advice like dontneed */
+  start = ((uintptr_t) address + page_size - 1) & ~(page_size - 1);
+  end = ((uintptr_t) address + length) & ~(page_size - 1);
+  lock();
+  range = get_range(name);
+  if (range >= 0)
+  {
+    ranges[range].address = start;
+    ranges[range].length = end > start ? end - start : 0;
+  }
+  unlock();
+#ifdef VERBOSE
+  fprintf(stderr, "Registered memory range %s: %p + %zu\n", name, address, length);
+#endif
+  return range < 0 ? ENOMEM : 0;
+}
+
+static int read_advice(struct config_t * cfg, char * buffer, int32_t * advice, int prefault)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  const char * name;
+  int i;
+  *advice = -1;
+  if (setting == NULL)
+    return 0;
+  name = config_setting_get_string(setting);
+  if (name != NULL && prefault)
+  {
+    if (strcmp(name, "read") == 0)
+      *advice = MADV_POPULATE_READ;
+    else if (strcmp(name, "write") == 0)
+      *advice = MADV_POPULATE_WRITE;
+  }
+  for (i = 0; name != NULL && !prefault && i < sizeof(advice_names) / sizeof(advice_names[0]); i++)
+    if (strcmp(name, advice_names[i].name) == 0)
+      *advice = advice_names[i].advice;
+  if (*advice < 0)
+  {
+    fprintf(stderr, "Unknown %s %s\n", buffer, name ? name : "");
+    return 0;
+  }
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %s\n",buffer,name);
+#endif
+  return 1;
+}
+
+static void add_action(struct madvise_action ** actions, int * nr, int32_t range,
+    int32_t advice, int32_t prefault)
+{
+  struct madvise_action * tmp;
+  if (advice < 0 && prefault < 0)
+    return;
+  tmp = realloc(*actions, (*nr + 1) * sizeof(struct madvise_action));
+  if (tmp == NULL)
+    return;
+  *actions = tmp;
+  tmp[*nr].range = range;
+  tmp[*nr].advice = advice;
+  tmp[*nr].prefault = prefault;
+  (*nr)++;
+}
+
+int madvise_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  struct madvise_information * info = vp;
+  config_setting_t *setting;
+  int i;
+  memset(info, 0, sizeof(struct madvise_information));
+
+  for (i = 0; i < 32000; i++)
+  {
+    const char * name;
+    int32_t range, advice, prefault;
+
+    sprintf(buffer, "%s.%s_%d.range", prefix, MADVISE_CONFIG_STRING, i);
+    setting = config_lookup(cfg, buffer);
+    if (setting == NULL)
+      break;
+    name = config_setting_get_string(setting);
+    lock();
+    range = name ? get_range(name) : -1;
+    unlock();
+    if (range < 0)
+    {
+      fprintf(stderr, "%s has to be a valid range name\n", buffer);
+      continue;
+    }
+
+    sprintf(buffer, "%s.%s_%d.before", prefix, MADVISE_CONFIG_STRING, i);
+    read_advice(cfg, buffer, &advice, 0);
+    sprintf(buffer, "%s.%s_%d.prefault_before", prefix, MADVISE_CONFIG_STRING, i);
+    read_advice(cfg, buffer, &prefault, 1);
+    add_action(&info->before, &info->nr_before, range, advice, prefault);
+
+    sprintf(buffer, "%s.%s_%d.after", prefix, MADVISE_CONFIG_STRING, i);
+    read_advice(cfg, buffer, &advice, 0);
+    sprintf(buffer, "%s.%s_%d.prefault_after", prefix, MADVISE_CONFIG_STRING, i);
+    read_advice(cfg, buffer, &prefault, 1);
+    add_action(&info->after, &info->nr_after, range, advice, prefault);
+  }
+  return info->nr_before > 0 || info->nr_after > 0;
+}
+
+static void * helper_main(void * arg)
+{
+  struct prefault_request request;
+  pthread_mutex_lock(&queue_mutex);
+  while (1)
+  {
+    while (queue_size == 0 && !helper_stop)
+      pthread_cond_wait(&queue_cond, &queue_mutex);
+    if (helper_stop)
+      break;
+    request = queue[queue_first];
+    queue_first = (queue_first + 1) % MADVISE_QUEUE_SIZE;
+    queue_size--;
+    pthread_mutex_unlock(&queue_mutex);
+    /* EINVAL on kernels before 5.14, EFAULT if the range has been unmapped */
+    if (madvise((void *) request.address, request.length, request.advice))
+    {
+#ifdef VERBOSE
+      fprintf(stderr, "Prefaulting %p + %zu failed: %d\n", (void *) request.address,
+          request.length, errno);
+#endif
+    }
+    pthread_mutex_lock(&queue_mutex);
+  }
+  pthread_mutex_unlock(&queue_mutex);
+  return NULL;
+}
+
+/* pass a range to the helper thread, which is started on first use */
+static int prefault(uintptr_t address, size_t length, int32_t advice)
+{
+  int i, ret = 0;
+  pthread_mutex_lock(&queue_mutex);
+  if (!helper_started)
+  {
+    ret = pthread_create(&helper, NULL, helper_main, NULL);
+    if (ret == 0)
+      helper_started = 1;
+  }
+  /* a range that is still pending is not queued again */
+  for (i = 0; ret == 0 && i < queue_size; i++)
+  {
+    struct prefault_request * pending = &queue[(queue_first + i) % MADVISE_QUEUE_SIZE];
+    if (pending->address == address && pending->length == length && pending->advice == advice)
+      break;
+  }
+  if (ret == 0 && i == queue_size)
+  {
+    if (queue_size < MADVISE_QUEUE_SIZE)
+    {
+      struct prefault_request * request = &queue[(queue_first + queue_size) % MADVISE_QUEUE_SIZE];
+      request->address = address;
+      request->length = length;
+      request->advice = advice;
+      queue_size++;
+      pthread_cond_signal(&queue_cond);
+    }
+    else
+      ret = EBUSY;
+  }
+  pthread_mutex_unlock(&queue_mutex);
+  return ret;
+}
+
+static int apply(struct madvise_action * actions, int nr)
+{
+  int i, ok = 0;
+  for (i = 0; i < nr; i++)
+  {
+    uintptr_t address;
+    size_t length;
+    lock();
+    address = ranges[actions[i].range].address;
+    length = ranges[actions[i].range].length;
+    unlock();
+    /* the range has not been registered (yet) */
+    if (length == 0)
+      continue;
+    if (actions[i].advice >= 0 && madvise((void *) address, length, actions[i].advice))
+      ok |= errno;
+    if (actions[i].prefault >= 0)
+      ok |= prefault(address, length, actions[i].prefault);
+  }
+#ifdef VERBOSE
+  if (ok)
+    fprintf(stderr,"Applying memory advice failed %i!\n",ok);
+#endif
+  return ok;
+}
+
+int madvise_process_before(void * vp, int32_t cpu)
+{
+  struct madvise_information * info = vp;
+  return apply(info->before, info->nr_before);
+}
+
+int madvise_process_after(void * vp, int32_t cpu)
+{
+  struct madvise_information * info = vp;
+  return apply(info->after, info->nr_after);
+}
+
+int madvise_fini(void)
+{
+  /* pending requests are dropped, a running one is finished */
+  pthread_mutex_lock(&queue_mutex);
+  helper_stop = 1;
+  queue_size = 0;
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_mutex);
+  if (helper_started)
+    pthread_join(helper, NULL);
+  helper_started = 0;
+  helper_stop = 0;
+  lock();
+  nr_ranges = 0;
+  unlock();
+  return 0;
+}
@@ -0,0 +1,60 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef MADVISE_H_
+#define MADVISE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libconfig.h>
+
+#define MADVISE_CONFIG_STRING "madvise"
+
+/* maximal number of memory ranges */
+#define MADVISE_MAX_RANGES 256
+
+/* the advice for one registered memory range */
+struct madvise_action{
+  /* index of the range */
+  int32_t range;
+  /* MADV_* advice that is applied directly, -1 if not set */
+  int32_t advice;
+  /* MADV_POPULATE_* advice that is applied by the helper thread, -1 if not
+   * set */
+  int32_t prefault;
+};
+
+struct madvise_information{
+  struct madvise_action * before;
+  int nr_before;
+  struct madvise_action * after;
+  int nr_after;
+};
+
+/* see adapt_register_range */
+int madvise_register_range(const char * name, void * address, size_t length);
+
+int madvise_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int madvise_process_before(void * info, int32_t cpu);
+int madvise_process_after(void * info, int32_t cpu);
+
+int madvise_fini(void);
+
+#endif /* MADVISE_H_ */
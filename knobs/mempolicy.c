@@ -0,0 +1,337 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "mempolicy.h"
+#include "sysfs_file.h"
+#include "topology.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define NUMA_BALANCING_PATH "/proc/sys/kernel/numa_balancing"
+
+/* nested regions up to this depth restore the policy of the enclosing
+ * region on exit */
+#define MEMPOLICY_MAX_DEPTH 16
+
+/* size of the node masks that are passed to the kernel, which has to be at
+ * least the number of possible nodes of the kernel */
+#define MEMPOLICY_KERNEL_NODES 1024
+#define MEMPOLICY_KERNEL_WORDS (MEMPOLICY_KERNEL_NODES / (8 * sizeof(unsigned long)))
+
+static const struct {
+  const char * name;
+  int32_t mode;
+} mode_names[] = {
+  {"default", MPOL_DEFAULT},
+  {"local", MPOL_LOCAL},
+  {"preferred", MPOL_PREFERRED},
+  {"bind", MPOL_BIND},
+  {"interleave", MPOL_INTERLEAVE}
+};
+
+/* the memory policy of a thread */
+struct policy{
+  int mode;
+  unsigned long nodes[MEMPOLICY_KERNEL_WORDS];
+};
+
+/* the policy of the calling thread */
+static __thread int own_valid = 0;
+static __thread struct policy own;
+/* policies before the enclosing regions of the calling thread */
+static __thread int own_depth = 0;
+static __thread struct policy own_previous[MEMPOLICY_MAX_DEPTH];
+
+/* numa_balancing is changed while at least one thread is in a region that
+ * sets it */
+static struct sysfs_file numa_balancing;
+static int numa_balancing_users = 0;
+static volatile int numa_balancing_lock = 0;
+
+int mempolicy_init(void)
+{
+  unsigned long nodes[MEMPOLICY_KERNEL_WORDS];
+  int mode, ret;
+
+  ret = topology_init();
+  if (ret)
+    return ret;
+  /* fails with ENOSYS if the kernel does not support NUMA */
+  if (syscall(SYS_get_mempolicy, &mode, nodes, MEMPOLICY_KERNEL_NODES, NULL, 0))
+    return errno;
+  /* may fail if not running as root, which is reported when it is used */
+  numa_balancing.fd = -1;
+  if (sysfs_exists(NUMA_BALANCING_PATH))
+    sysfs_file_open(&numa_balancing, NUMA_BALANCING_PATH);
+  return 0;
+}
+
+static int read_mode(struct config_t * cfg, char * buffer, int32_t * mode)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  const char * name;
+  int i;
+  *mode = -1;
+  if (setting == NULL)
+    return 0;
+  name = config_setting_get_string(setting);
+  for (i = 0; name != NULL && i < sizeof(mode_names) / sizeof(mode_names[0]); i++)
+    if (strcmp(name, mode_names[i].name) == 0)
+      *mode = mode_names[i].mode;
+  if (*mode < 0)
+  {
+    fprintf(stderr, "%s has to be one of default, local, preferred, bind or interleave\n", buffer);
+    return 0;
+  }
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %s\n",buffer,name);
+#endif
+  return 1;
+}
+
+static void read_nodes(struct config_t * cfg, char * buffer, uint64_t * nodes)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  int i;
+  memset(nodes, 0, MEMPOLICY_MAX_NODES / 8);
+  if (setting == NULL)
+    return;
+  if (config_setting_type(setting) != CONFIG_TYPE_ARRAY)
+  {
+    fprintf(stderr, "%s has to be an array of NUMA nodes\n", buffer);
+    return;
+  }
+  for (i = 0; i < config_setting_length(setting); i++)
+  {
+    int node = config_setting_get_int_elem(setting, i);
+    if (node < 0 || node >= MEMPOLICY_MAX_NODES || !topology_node_online(node))
+    {
+      fprintf(stderr, "%s: node %d is not online\n", buffer, node);
+      continue;
+    }
+    nodes[node / 64] |= 1ULL << (node % 64);
+#ifdef VERBOSE
+    fprintf(stderr,"%s[%d] = %d\n",buffer,i,node);
+#endif
+  }
+}
+
+int mempolicy_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  struct mempolicy_information * info = vp;
+  config_setting_t *setting;
+  int was_set = 0;
+
+  sprintf(buffer, "%s.%s_before", prefix, MEMPOLICY_CONFIG_STRING);
+  was_set |= read_mode(cfg, buffer, &info->mode_before);
+  sprintf(buffer, "%s.%s_nodes_before", prefix, MEMPOLICY_CONFIG_STRING);
+  read_nodes(cfg, buffer, info->nodes_before);
+  sprintf(buffer, "%s.%s_after", prefix, MEMPOLICY_CONFIG_STRING);
+  was_set |= read_mode(cfg, buffer, &info->mode_after);
+  sprintf(buffer, "%s.%s_nodes_after", prefix, MEMPOLICY_CONFIG_STRING);
+  read_nodes(cfg, buffer, info->nodes_after);
+
+  info->numa_balancing = -1;
+  sprintf(buffer, "%s.%s_numa_balancing", prefix, MEMPOLICY_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting)
+  {
+    info->numa_balancing = config_setting_get_int(setting);
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %" PRId32 "\n",buffer,info->numa_balancing);
+#endif
+    was_set = 1;
+  }
+  return was_set;
+}
+
+/* the policy for a mode and the configured nodes, relative to cpu */
+static void build_policy(struct policy * policy, int32_t mode, const uint64_t * nodes, int32_t cpu)
+{
+  int node, nr_set = 0;
+  memset(policy, 0, sizeof(struct policy));
+  policy->mode = mode;
+  if (mode == MPOL_DEFAULT || mode == MPOL_LOCAL)
+    return;
+  for (node = 0; node < MEMPOLICY_MAX_NODES; node++)
+    if (nodes[node / 64] & (1ULL << (node % 64)))
+    {
+      /* preferred only uses the first node */
+      if (mode == MPOL_PREFERRED && nr_set > 0)
+        break;
+      policy->nodes[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+      nr_set++;
+    }
+  if (nr_set > 0)
+    return;
+  if (mode == MPOL_PREFERRED)
+  {
+    /* the node of the cpu */
+    if (cpu < 0)
+      cpu = sched_getcpu();
+    node = topology_node(cpu);
+    if (node < 0)
+      node = 0;
+    policy->nodes[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    return;
+  }
+  /* all online nodes */
+  for (node = 0; node < topology_nr_nodes() && node < MEMPOLICY_KERNEL_NODES; node++)
+    if (topology_node_online(node))
+      policy->nodes[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+}
+
+/* read the policy of the calling thread on first use */
+static int sync_self(void)
+{
+  if (own_valid)
+    return 0;
+  memset(&own, 0, sizeof(own));
+  if (syscall(SYS_get_mempolicy, &own.mode, own.nodes, MEMPOLICY_KERNEL_NODES, NULL, 0))
+    return errno;
+  own_valid = 1;
+  return 0;
+}
+
+static int set_self(const struct policy * policy)
+{
+  int uses_nodes = policy->mode != MPOL_DEFAULT && policy->mode != MPOL_LOCAL;
+  /* nothing changes, no syscall needed */
+  if (memcmp(&own, policy, sizeof(struct policy)) == 0)
+    return 0;
+  /* the kernel ignores the last bit of maxnode */
+  if (syscall(SYS_set_mempolicy, policy->mode, uses_nodes ? policy->nodes : NULL,
+      uses_nodes ? MEMPOLICY_KERNEL_NODES + 1 : 0))
+    return errno;
+  own = *policy;
+  return 0;
+}
+
+static int apply(int32_t mode, const uint64_t * nodes, int32_t cpu, int keep_previous)
+{
+  struct policy policy;
+  int ret = sync_self();
+  if (ret)
+    return ret;
+  if (keep_previous)
+  {
+    if (own_depth < MEMPOLICY_MAX_DEPTH)
+      own_previous[own_depth] = own;
+    own_depth++;
+  }
+  build_policy(&policy, mode, nodes, cpu);
+  return set_self(&policy);
+}
+
+static int restore(void)
+{
+  if (own_depth == 0)
+    return 0;
+  own_depth--;
+  if (own_depth >= MEMPOLICY_MAX_DEPTH)
+    return 0;
+  return set_self(&own_previous[own_depth]);
+}
+
+static void lock(void)
+{
+  while (__sync_lock_test_and_set(&numa_balancing_lock, 1))
+    ;
+}
+
+static void unlock(void)
+{
+  __sync_lock_release(&numa_balancing_lock);
+}
+
+static int numa_balancing_enter(int32_t value)
+{
+  char buffer[16];
+  int len, ret = 0;
+  if (numa_balancing.fd == -1)
+    return ENODEV;
+  lock();
+  if (numa_balancing_users++ == 0)
+  {
+    len = sprintf(buffer, "%" PRId32, value);
+    ret = sysfs_file_write(&numa_balancing, buffer, len);
+  }
+  unlock();
+  return ret;
+}
+
+static int numa_balancing_exit(void)
+{
+  int ret = 0;
+  if (numa_balancing.fd == -1)
+    return ENODEV;
+  lock();
+  if (numa_balancing_users > 0 && --numa_balancing_users == 0)
+    ret = sysfs_file_restore(&numa_balancing);
+  unlock();
+  return ret;
+}
+
+int mempolicy_process_before(void * vp, int32_t cpu)
+{
+  struct mempolicy_information * info = vp;
+  int ok = 0;
+  if (info->numa_balancing >= 0)
+    ok |= numa_balancing_enter(info->numa_balancing);
+  /* without a policy for the exit, the previous policy is restored */
+  if (info->mode_before >= 0)
+    ok |= apply(info->mode_before, info->nodes_before, cpu, info->mode_after < 0);
+  return ok;
+}
+
+int mempolicy_process_after(void * vp, int32_t cpu)
+{
+  struct mempolicy_information * info = vp;
+  int ok = 0;
+  if (info->mode_after >= 0)
+    ok |= apply(info->mode_after, info->nodes_after, cpu, 0);
+  else if (info->mode_before >= 0)
+    ok |= restore();
+  if (info->numa_balancing >= 0)
+    ok |= numa_balancing_exit();
+  return ok;
+}
+
+int mempolicy_fini(void)
+{
+  int error = 0;
+  lock();
+  if (numa_balancing.fd != -1)
+  {
+    error |= sysfs_file_restore(&numa_balancing);
+    sysfs_file_close(&numa_balancing);
+  }
+  numa_balancing_users = 0;
+  unlock();
+  own_depth = 0;
+  return error;
+}
@@ -0,0 +1,52 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef MEMPOLICY_H_
+#define MEMPOLICY_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#define MEMPOLICY_CONFIG_STRING "mempolicy"
+
+/* maximal number of NUMA nodes that can be given in the configuration */
+#define MEMPOLICY_MAX_NODES 256
+
+struct mempolicy_information{
+  /* MPOL_* mode, -1 if not set */
+  int32_t mode_before;
+  int32_t mode_after;
+  /* value of /proc/sys/kernel/numa_balancing while the region runs, -1 if
+   * not set */
+  int32_t numa_balancing;
+  /* nodes of the policy, all online nodes if none is set */
+  uint64_t nodes_before[MEMPOLICY_MAX_NODES / 64];
+  uint64_t nodes_after[MEMPOLICY_MAX_NODES / 64];
+};
+
+int mempolicy_init(void);
+
+int mempolicy_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int mempolicy_process_before(void * info, int32_t cpu);
+int mempolicy_process_after(void * info, int32_t cpu);
+
+int mempolicy_fini(void);
+
+#endif /* MEMPOLICY_H_ */
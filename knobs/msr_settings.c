@@ -0,0 +1,158 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "msr_settings.h"
+
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* registers that may be written. The list is fixed at build time (cmake
+ * -DMSR_ALLOWLIST=...), since the config file is provided by the user whose
+ * register accesses it should restrict */
+static const uint32_t allowlist[] =
+{
+  MSR_MISC_FEATURE_CONTROL,
+  MSR_IA32_ENERGY_PERF_BIAS,
+  MSR_IA32_CLOCK_MODULATION,
+#ifdef MSR_EXTRA_ALLOWLIST
+  MSR_EXTRA_ALLOWLIST
+#endif
+};
+static const int nr_allowed = sizeof(allowlist) / sizeof(allowlist[0]);
+
+int msr_settings_read_global_config(struct config_t * cfg, char * buffer)
+{
+  sprintf(buffer, "%s_allowlist", MSR_CONFIG_STRING);
+  if (config_lookup(cfg, buffer) != NULL)
+    fprintf(stderr, "%s is ignored, allowed registers are set with cmake -DMSR_ALLOWLIST=...\n", buffer);
+  return 0;
+}
+
+static int is_allowed(uint32_t reg)
+{
+  int i;
+  for (i = 0; i < nr_allowed; i++)
+    if (allowlist[i] == reg)
+      return 1;
+  return 0;
+}
+
+/* add an update or merge it with an update of the same register */
+static void add_update(struct msr_update ** updates, int * nr, uint32_t reg, uint64_t mask, uint64_t value)
+{
+  struct msr_update * tmp;
+  int i;
+  for (i = 0; i < *nr; i++)
+    if ((*updates)[i].reg == reg)
+    {
+      (*updates)[i].value = ((*updates)[i].value & ~mask) | (value & mask);
+      (*updates)[i].mask |= mask;
+      return;
+    }
+  tmp = realloc(*updates, (*nr + 1) * sizeof(struct msr_update));
+  if (tmp == NULL)
+    return;
+  *updates = tmp;
+  tmp[*nr].reg = reg;
+  tmp[*nr].mask = mask;
+  tmp[*nr].value = value;
+  (*nr)++;
+}
+
+int msr_settings_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  struct msr_information * info = vp;
+  config_setting_t *setting;
+  int i;
+  memset(info, 0, sizeof(struct msr_information));
+
+  for (i = 0; i < 32000; i++)
+  {
+    uint32_t reg;
+    uint64_t mask = ~0ULL;
+
+    sprintf(buffer, "%s.%s_%d.address", prefix, MSR_CONFIG_STRING, i);
+    setting = config_lookup(cfg, buffer);
+    if (setting == NULL)
+      break;
+    reg = config_setting_get_int64(setting);
+    if (!is_allowed(reg))
+    {
+      fprintf(stderr, "%s: register 0x%" PRIx32 " is not allowed\n", buffer, reg);
+      continue;
+    }
+    sprintf(buffer, "%s.%s_%d.mask", prefix, MSR_CONFIG_STRING, i);
+    setting = config_lookup(cfg, buffer);
+    if (setting)
+      mask = config_setting_get_int64(setting);
+
+    sprintf(buffer, "%s.%s_%d.before", prefix, MSR_CONFIG_STRING, i);
+    setting = config_lookup(cfg, buffer);
+    if (setting)
+    {
+      add_update(&info->before, &info->nr_before, reg, mask, config_setting_get_int64(setting));
+#ifdef VERBOSE
+      fprintf(stderr, "%s = 0x%llx (0x%" PRIx32 ", mask 0x%" PRIx64 ")\n", buffer, config_setting_get_int64(setting), reg, mask);
+#endif
+    }
+    sprintf(buffer, "%s.%s_%d.after", prefix, MSR_CONFIG_STRING, i);
+    setting = config_lookup(cfg, buffer);
+    if (setting)
+    {
+      add_update(&info->after, &info->nr_after, reg, mask, config_setting_get_int64(setting));
+#ifdef VERBOSE
+      fprintf(stderr, "%s = 0x%llx (0x%" PRIx32 ", mask 0x%" PRIx64 ")\n", buffer, config_setting_get_int64(setting), reg, mask);
+#endif
+    }
+  }
+  return info->nr_before > 0 || info->nr_after > 0;
+}
+
+int msr_settings_process_before(void * vp, int32_t cpu)
+{
+  struct msr_information * info = vp;
+  if (info->nr_before == 0)
+    return 0;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  return msr_cached_update(cpu, info->nr_before, info->before);
+}
+
+int msr_settings_process_after(void * vp, int32_t cpu)
+{
+  struct msr_information * info = vp;
+  if (info->nr_after == 0)
+    return 0;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  return msr_cached_update(cpu, info->nr_after, info->after);
+}
+
+int msr_settings_fini(void)
+{
+  int i;
+  int error = 0;
+  /* only registers that have been changed are written */
+  for (i = 0; i < nr_allowed; i++)
+    error |= msr_cached_restore(allowlist[i]);
+  return error;
+}
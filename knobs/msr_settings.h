@@ -0,0 +1,49 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef MSR_SETTINGS_H_
+#define MSR_SETTINGS_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#include "msr.h"
+
+#define MSR_CONFIG_STRING "msr"
+
+struct msr_information{
+  /* one update per register, msr_<nr> entries for the same register are
+   * merged */
+  struct msr_update * before;
+  int nr_before;
+  struct msr_update * after;
+  int nr_after;
+};
+
+/* warn about an msr_allowlist setting, which is not supported, returns 0 */
+int msr_settings_read_global_config(struct config_t * cfg, char * buffer);
+
+int msr_settings_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int msr_settings_process_before(void * info, int32_t cpu);
+int msr_settings_process_after(void * info, int32_t cpu);
+
+int msr_settings_fini(void);
+
+#endif /* MSR_SETTINGS_H_ */
@@ -0,0 +1,205 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+/*
+ * omp_sched.c
+ *
+ * Changes the schedule of loops with schedule(runtime) via omp_set_schedule
+ * and, if the runtime supports it (e.g., LLVM/Intel libomp), the time threads
+ * spin before they sleep via kmp_set_blocktime.
+ */
+
+#include "omp_sched.h"
+#include "dct.h"
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+
+/* values of omp_sched_t */
+static const char * schedule_names[] =
+{
+  NULL, "static", "dynamic", "guided", "auto"
+};
+#define NR_SCHEDULES (sizeof(schedule_names)/sizeof(schedule_names[0]))
+
+static union{
+  void * vp;
+  void (*function)(int,int);
+}omp_sched_orig_set_schedule;
+
+static union{
+  void * vp;
+  void (*function)(int*,int*);
+}omp_sched_orig_get_schedule;
+
+static union{
+  void * vp;
+  void (*function)(int);
+}omp_sched_orig_set_blocktime;
+
+static union{
+  void * vp;
+  int (*function)(void);
+}omp_sched_orig_get_blocktime;
+
+/* the settings of the runtime, read at the first change */
+static int settings_known = 0;
+static int current_schedule = 0;
+static int current_chunk = 0;
+static int current_blocktime = -1;
+
+static void * load_function(const char * name)
+{
+  void * vp = dlsym(RTLD_DEFAULT, name);
+  if (vp == NULL)
+    vp = dlsym(RTLD_NEXT, name);
+  return vp;
+}
+
+int omp_sched_init(void)
+{
+  omp_sched_orig_set_schedule.vp = load_function("omp_set_schedule");
+  omp_sched_orig_get_schedule.vp = load_function("omp_get_schedule");
+  if (omp_sched_orig_set_schedule.vp == NULL || omp_sched_orig_get_schedule.vp == NULL)
+  {
+    fprintf(stderr,"Error loading function %s (%s)\n","omp_set_schedule",dlerror());
+    return 1;
+  }
+  /* optional, only provided by some runtimes */
+  omp_sched_orig_set_blocktime.vp = load_function("kmp_set_blocktime");
+  omp_sched_orig_get_blocktime.vp = load_function("kmp_get_blocktime");
+  if (omp_sched_orig_get_blocktime.vp == NULL)
+    omp_sched_orig_set_blocktime.vp = NULL;
+  return 0;
+}
+
+static int read_schedule(struct config_t * cfg, char * buffer, int32_t * schedule)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  const char * name;
+  int i;
+  *schedule = -1;
+  if (setting == NULL)
+    return 0;
+  name = config_setting_get_string(setting);
+  for (i = 1; i < NR_SCHEDULES; i++)
+    if (name != NULL && strcmp(name, schedule_names[i]) == 0)
+      break;
+  if (i == NR_SCHEDULES)
+  {
+    fprintf(stderr, "Unknown %s, use static, dynamic, guided, or auto\n", buffer);
+    return 0;
+  }
+  *schedule = i;
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %s\n",buffer,name);
+#endif
+  return 1;
+}
+
+static int read_int(struct config_t * cfg, char * buffer, int32_t * value)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  *value = -1;
+  if (setting == NULL)
+    return 0;
+  *value = config_setting_get_int(setting);
+#ifdef VERBOSE
+  fprintf(stderr, "%s = %" PRId32 "\n",buffer,*value);
+#endif
+  return *value >= 0;
+}
+
+int omp_sched_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  struct omp_sched_information * info = vp;
+  int was_set = 0;
+
+  sprintf(buffer, "%s.%s_schedule_before", prefix, OMP_SCHED_CONFIG_STRING);
+  was_set |= read_schedule(cfg, buffer, &info->schedule_before);
+  sprintf(buffer, "%s.%s_chunk_before", prefix, OMP_SCHED_CONFIG_STRING);
+  was_set |= read_int(cfg, buffer, &info->chunk_before);
+  sprintf(buffer, "%s.%s_blocktime_before", prefix, OMP_SCHED_CONFIG_STRING);
+  was_set |= read_int(cfg, buffer, &info->blocktime_before);
+  sprintf(buffer, "%s.%s_schedule_after", prefix, OMP_SCHED_CONFIG_STRING);
+  was_set |= read_schedule(cfg, buffer, &info->schedule_after);
+  sprintf(buffer, "%s.%s_chunk_after", prefix, OMP_SCHED_CONFIG_STRING);
+  was_set |= read_int(cfg, buffer, &info->chunk_after);
+  sprintf(buffer, "%s.%s_blocktime_after", prefix, OMP_SCHED_CONFIG_STRING);
+  was_set |= read_int(cfg, buffer, &info->blocktime_after);
+
+  if ((info->blocktime_before >= 0 || info->blocktime_after >= 0) &&
+      omp_sched_orig_set_blocktime.vp == NULL)
+    fprintf(stderr, "The OpenMP runtime does not support kmp_set_blocktime, %s blocktime is ignored\n", prefix);
+  return was_set;
+}
+
+static void apply(int32_t schedule, int32_t chunk, int32_t blocktime)
+{
+  /* within a team (e.g., via OMPT), only the primary thread changes the
+   * settings */
+  if (schedule < 0 && chunk < 0 && blocktime < 0)
+    return;
+  if (omp_dct_get_thread_num() != 0)
+    return;
+  if (!settings_known)
+  {
+    omp_sched_orig_get_schedule.function(&current_schedule, &current_chunk);
+    if (omp_sched_orig_get_blocktime.vp)
+      current_blocktime = omp_sched_orig_get_blocktime.function();
+    settings_known = 1;
+  }
+  /* a chunk size without a schedule changes the chunk of the current
+   * schedule, a schedule without a chunk uses the default chunk */
+  if (schedule < 0 && chunk >= 0)
+    schedule = current_schedule;
+  else if (schedule >= 0 && chunk < 0)
+    chunk = 0;
+  if (schedule >= 0 && (schedule != current_schedule || chunk != current_chunk))
+  {
+#ifdef VERBOSE
+    fprintf(stderr,"Setting schedule %s,%d\n",schedule_names[schedule],chunk);
+#endif
+    omp_sched_orig_set_schedule.function(schedule, chunk);
+    current_schedule = schedule;
+    current_chunk = chunk;
+  }
+  if (blocktime >= 0 && blocktime != current_blocktime && omp_sched_orig_set_blocktime.vp)
+  {
+#ifdef VERBOSE
+    fprintf(stderr,"Setting blocktime %d ms\n",blocktime);
+#endif
+    omp_sched_orig_set_blocktime.function(blocktime);
+    current_blocktime = blocktime;
+  }
+}
+
+int omp_sched_process_before(void * vp,int ignore)
+{
+  struct omp_sched_information * info = vp;
+  apply(info->schedule_before, info->chunk_before, info->blocktime_before);
+  return 0;
+}
+
+int omp_sched_process_after(void * vp,int ignore)
+{
+  struct omp_sched_information * info = vp;
+  apply(info->schedule_after, info->chunk_after, info->blocktime_after);
+  return 0;
+}
@@ -0,0 +1,50 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+/*
+ * omp_sched.h
+ *
+ * Per-region loop schedule and wait policy of the OpenMP runtime
+ */
+
+#ifndef OMP_SCHED_H_
+#define OMP_SCHED_H_
+
+#include <inttypes.h>
+#include <libconfig.h>
+
+#define OMP_SCHED_CONFIG_STRING "omp"
+
+/* -1 for settings that are not changed */
+struct omp_sched_information{
+  int32_t schedule_before;
+  int32_t chunk_before;
+  int32_t blocktime_before;
+  int32_t schedule_after;
+  int32_t chunk_after;
+  int32_t blocktime_after;
+};
+
+int omp_sched_init(void);
+
+int omp_sched_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+int omp_sched_process_before(void * info,int ignored);
+int omp_sched_process_after(void * info,int ignored);
+
+#endif /* OMP_SCHED_H_ */
@@ -0,0 +1,371 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "placement.h"
+#include "dct.h"
+#include "threads.h"
+#include "topology.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Every thread that enters a region binds itself, OpenMP thread i to cpu i of
+ * the order of the policy. Threads that do not enter the region (e.g., helper
+ * threads of the runtime or of the program) are not changed.
+ * compact: hardware threads of a core, then cores of a die/package
+ * scatter: one cpu per core, alternating between packages
+ * one_per_core: one cpu per core, then the second hardware threads
+ * no_smt: not bound to a single cpu, but to the first hardware thread of
+ *   every core
+ * original: the masks the threads had before they were changed
+ * Only cpus of the affinity mask that the process has when libadapt is opened
+ * are used.
+ */
+static const char * policy_names[PLACEMENT_MAX] =
+{
+  "", "compact", "scatter", "one_per_core", "no_smt", "original"
+};
+
+/* cpu orders of the policies */
+static int * orders[PLACEMENT_MAX];
+static int nr_order = 0;
+static cpu_set_t no_smt_mask;
+
+/* the mask a thread had before it has been changed first */
+struct saved_mask{
+  pid_t tid;
+  cpu_set_t mask;
+};
+
+static struct saved_mask * saved_masks = NULL;
+static int nr_saved_masks = 0;
+static int size_saved_masks = 0;
+
+/* protects saved_masks */
+static volatile int placement_lock = 0;
+/* incremented when all masks are restored, so the cache of a thread becomes
+ * invalid */
+static volatile int generation = 0;
+
+/* the last policy the calling thread applied and its OpenMP thread number */
+static __thread int own_generation = 0;
+static __thread int own_policy = PLACEMENT_ORIGINAL;
+static __thread int own_thread_num = -1;
+
+static void lock(void)
+{
+  while (__sync_lock_test_and_set(&placement_lock, 1))
+    ;
+}
+
+static void unlock(void)
+{
+  __sync_lock_release(&placement_lock);
+}
+
+/* sort keys of the cpus for the current order */
+static int * sort_keys = NULL;
+static int nr_keys = 0;
+
+static int compare_cpus(const void * a, const void * b)
+{
+  const int * ka = &sort_keys[*(const int *) a * nr_keys];
+  const int * kb = &sort_keys[*(const int *) b * nr_keys];
+  int i;
+  for (i = 0; i < nr_keys; i++)
+    if (ka[i] != kb[i])
+      return (ka[i] > kb[i]) - (ka[i] < kb[i]);
+  return (*(const int *) a > *(const int *) b) - (*(const int *) a < *(const int *) b);
+}
+
+/* position of cpu within the hardware threads of its core */
+static int smt_index(int cpu)
+{
+  int nr, i;
+  const int * siblings = topology_cpus(TOPOLOGY_LEVEL_CORE, cpu, &nr);
+  for (i = 0; i < nr; i++)
+    if (siblings[i] == cpu)
+      return i;
+  return 0;
+}
+
+static int build_orders(const int * cpus, int nr_cpus)
+{
+  int policy, i, j;
+  sort_keys = calloc(topology_nr_cpus() * 4, sizeof(int));
+  if (sort_keys == NULL)
+    return ENOMEM;
+  for (policy = PLACEMENT_COMPACT; policy <= PLACEMENT_ONE_PER_CORE; policy++)
+  {
+    orders[policy] = malloc(nr_cpus * sizeof(int));
+    if (orders[policy] == NULL)
+    {
+      /* placement_fini is not called if the initialization fails */
+      while (--policy >= PLACEMENT_COMPACT)
+      {
+        free(orders[policy]);
+        orders[policy] = NULL;
+      }
+      free(sort_keys);
+      sort_keys = NULL;
+      return ENOMEM;
+    }
+    memcpy(orders[policy], cpus, nr_cpus * sizeof(int));
+  }
+  nr_keys = 4;
+  for (i = 0; i < nr_cpus; i++)
+  {
+    int * key = &sort_keys[cpus[i] * nr_keys];
+    key[0] = topology_package(cpus[i]);
+    key[1] = topology_die(cpus[i]);
+    key[2] = topology_core(cpus[i]);
+    key[3] = 0;
+  }
+  qsort(orders[PLACEMENT_COMPACT], nr_cpus, sizeof(int), compare_cpus);
+  for (i = 0; i < nr_cpus; i++)
+  {
+    int * key = &sort_keys[cpus[i] * nr_keys];
+    key[3] = key[2];
+    key[2] = key[1];
+    key[1] = key[0];
+    key[0] = smt_index(cpus[i]);
+  }
+  qsort(orders[PLACEMENT_ONE_PER_CORE], nr_cpus, sizeof(int), compare_cpus);
+  /* scatter: the n-th core of every package, before the n+1-th */
+  for (i = 0; i < nr_cpus; i++)
+  {
+    int cpu = orders[PLACEMENT_ONE_PER_CORE][i];
+    int * key = &sort_keys[cpu * nr_keys];
+    int rank = 0;
+    for (j = 0; j < i; j++)
+    {
+      int * other = &sort_keys[orders[PLACEMENT_ONE_PER_CORE][j] * nr_keys];
+      if (other[0] == key[0] && topology_package(orders[PLACEMENT_ONE_PER_CORE][j]) == topology_package(cpu))
+        rank++;
+    }
+    key[1] = rank;
+    key[2] = topology_package(cpu);
+    key[3] = 0;
+  }
+  qsort(orders[PLACEMENT_SCATTER], nr_cpus, sizeof(int), compare_cpus);
+  CPU_ZERO(&no_smt_mask);
+  for (i = 0; i < nr_cpus; i++)
+    if (smt_index(cpus[i]) == 0)
+      CPU_SET(cpus[i], &no_smt_mask);
+  free(sort_keys);
+  sort_keys = NULL;
+  nr_order = nr_cpus;
+  return 0;
+}
+
+int placement_init(void)
+{
+  cpu_set_t mask;
+  int * cpus;
+  int cpu, nr_cpus = 0, ret;
+
+  ret = topology_init();
+  if (ret)
+    return ret;
+  if (sched_getaffinity(0, sizeof(mask), &mask))
+    return errno;
+  cpus = calloc(topology_nr_cpus(), sizeof(int));
+  if (cpus == NULL)
+    return ENOMEM;
+  for (cpu = 0; cpu < topology_nr_cpus() && cpu < CPU_SETSIZE; cpu++)
+    if (CPU_ISSET(cpu, &mask) && topology_cpu_online(cpu))
+      cpus[nr_cpus++] = cpu;
+  if (nr_cpus == 0)
+    ret = ENODEV;
+  else
+    ret = build_orders(cpus, nr_cpus);
+  free(cpus);
+  return ret;
+}
+
+static int read_policy(struct config_t * cfg, char * buffer, int32_t * policy)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  const char * name;
+  *policy = PLACEMENT_UNSET;
+  if (setting == NULL)
+    return 0;
+  name = config_setting_get_string(setting);
+  for (*policy = PLACEMENT_COMPACT; *policy < PLACEMENT_MAX; (*policy)++)
+    if (name != NULL && strcmp(name, policy_names[*policy]) == 0)
+      break;
+  if (*policy == PLACEMENT_MAX)
+  {
+    fprintf(stderr, "Unknown %s, use compact, scatter, one_per_core, no_smt, or original\n", buffer);
+    *policy = PLACEMENT_UNSET;
+    return 0;
+  }
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %s\n",buffer,name);
+#endif
+  return 1;
+}
+
+int placement_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  int was_set = 0;
+  struct placement_information * info = vp;
+
+  sprintf(buffer, "%s.%s_before", prefix, PLACEMENT_CONFIG_STRING);
+  was_set |= read_policy(cfg, buffer, &info->placement_before);
+  sprintf(buffer, "%s.%s_after", prefix, PLACEMENT_CONFIG_STRING);
+  was_set |= read_policy(cfg, buffer, &info->placement_after);
+  /* the original placement is restored when the region is left */
+  if (info->placement_before != PLACEMENT_UNSET && info->placement_after == PLACEMENT_UNSET)
+    info->placement_after = PLACEMENT_ORIGINAL;
+  return was_set;
+}
+
+static struct saved_mask * find_saved(pid_t tid)
+{
+  int i;
+  for (i = 0; i < nr_saved_masks; i++)
+    if (saved_masks[i].tid == tid)
+      return &saved_masks[i];
+  return NULL;
+}
+
+/* remember the mask of a thread before it is changed the first time */
+static int save_mask(pid_t tid)
+{
+  if (find_saved(tid) != NULL)
+    return 0;
+  if (nr_saved_masks == size_saved_masks)
+  {
+    int size = size_saved_masks ? 2 * size_saved_masks : 64;
+    struct saved_mask * new_masks = realloc(saved_masks, size * sizeof(struct saved_mask));
+    if (new_masks == NULL)
+      return ENOMEM;
+    saved_masks = new_masks;
+    size_saved_masks = size;
+  }
+  if (sched_getaffinity(tid, sizeof(cpu_set_t), &saved_masks[nr_saved_masks].mask))
+    return errno;
+  saved_masks[nr_saved_masks].tid = tid;
+  nr_saved_masks++;
+  return 0;
+}
+
+static int restore_masks(void)
+{
+  int i;
+  int ok = 0;
+  for (i = 0; i < nr_saved_masks; i++)
+    /* threads that ended in between are ignored */
+    if (sched_setaffinity(saved_masks[i].tid, sizeof(cpu_set_t), &saved_masks[i].mask) && errno != ESRCH)
+      ok |= errno;
+  return ok;
+}
+
+static int apply_policy(int policy)
+{
+  cpu_set_t mask;
+  pid_t tid;
+  int thread_num, ret = 0;
+
+  if (policy == PLACEMENT_UNSET)
+    return 0;
+  thread_num = omp_dct_get_thread_num();
+  if (own_generation != generation)
+  {
+    own_generation = generation;
+    own_policy = PLACEMENT_ORIGINAL;
+  }
+  /* nothing changed since the last call of this thread */
+  if (policy == own_policy &&
+      (policy == PLACEMENT_ORIGINAL || policy == PLACEMENT_NO_SMT || thread_num == own_thread_num))
+    return 0;
+  tid = threads_self();
+  lock();
+  if (policy == PLACEMENT_ORIGINAL)
+  {
+    struct saved_mask * saved = find_saved(tid);
+    /* threads that have not been bound keep their mask */
+    if (saved == NULL)
+    {
+      unlock();
+      own_policy = policy;
+      return 0;
+    }
+    mask = saved->mask;
+  }
+  else
+  {
+    ret = save_mask(tid);
+    if (policy == PLACEMENT_NO_SMT)
+      mask = no_smt_mask;
+    else
+    {
+      CPU_ZERO(&mask);
+      CPU_SET(orders[policy][thread_num % nr_order], &mask);
+    }
+  }
+  unlock();
+  if (ret)
+    return ret;
+#ifdef VERBOSE
+  fprintf(stderr,"placing thread %d (%d) %s\n",thread_num,tid,policy_names[policy]);
+#endif
+  if (sched_setaffinity(0, sizeof(cpu_set_t), &mask))
+    return errno;
+  own_policy = policy;
+  own_thread_num = thread_num;
+  return 0;
+}
+
+int placement_process_before(void * vp, int32_t cpu)
+{
+  struct placement_information * info = vp;
+  return apply_policy(info->placement_before);
+}
+
+int placement_process_after(void * vp, int32_t cpu)
+{
+  struct placement_information * info = vp;
+  return apply_policy(info->placement_after);
+}
+
+int placement_fini(void)
+{
+  int policy;
+  int error = 0;
+  lock();
+  error = restore_masks();
+  generation++;
+  for (policy = 0; policy < PLACEMENT_MAX; policy++)
+  {
+    free(orders[policy]);
+    orders[policy] = NULL;
+  }
+  free(saved_masks);
+  saved_masks = NULL;
+  nr_saved_masks = 0;
+  size_saved_masks = 0;
+  unlock();
+  return error;
+}
@@ -0,0 +1,51 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef PLACEMENT_H_
+#define PLACEMENT_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#define PLACEMENT_CONFIG_STRING "placement"
+
+/* policies, see placement.c */
+#define PLACEMENT_UNSET        0
+#define PLACEMENT_COMPACT      1
+#define PLACEMENT_SCATTER      2
+#define PLACEMENT_ONE_PER_CORE 3
+#define PLACEMENT_NO_SMT       4
+#define PLACEMENT_ORIGINAL     5
+#define PLACEMENT_MAX          6
+
+struct placement_information{
+  int32_t placement_before;
+  int32_t placement_after;
+};
+
+int placement_init(void);
+
+int placement_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int placement_process_before(void * info, int32_t cpu);
+int placement_process_after(void * info, int32_t cpu);
+
+int placement_fini(void);
+
+#endif /* PLACEMENT_H_ */
@@ -0,0 +1,324 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "powercap.h"
+#include "sysfs_file.h"
+#include "topology.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define POWERCAP_PATH "/sys/class/powercap"
+
+/* kinds of zones */
+#define POWERCAP_PACKAGE 0
+#define POWERCAP_DRAM    1
+#define POWERCAP_KINDS   2
+
+/* a RAPL zone, i.e., a package (or die) or the DRAM of a package. lock
+ * serializes the writes of the cpus of the zone */
+struct powercap_zone{
+  int package;
+  /* -1 if the zone covers the whole package */
+  int die;
+  volatile int lock;
+  struct sysfs_file limit;
+  struct sysfs_file window;
+};
+
+/* the constraint that is changed, 0 is the long term limit */
+static int constraint = 0;
+
+static struct powercap_zone * zones[POWERCAP_KINDS];
+static int nr_zones[POWERCAP_KINDS];
+/* zone of every cpu, -1 if there is none */
+static int * cpu_zone[POWERCAP_KINDS];
+static int nr_cpus = 0;
+
+int powercap_read_global_config(struct config_t * cfg, char * buffer)
+{
+  config_setting_t *setting;
+  sprintf(buffer, "%s_constraint", POWERCAP_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting == NULL)
+    return 0;
+  constraint = config_setting_get_int(setting);
+  if (constraint < 0)
+  {
+    fprintf(stderr, "%s has to be positive\n", buffer);
+    return EINVAL;
+  }
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %d\n",buffer,constraint);
+#endif
+  return 0;
+}
+
+/* read the name of a zone, e.g., "package-0" or "dram" */
+static int read_name(const char * zone, char * name, size_t size)
+{
+  char path[512];
+  ssize_t len;
+  int fd;
+  if (sysfs_path(path, sizeof(path), POWERCAP_PATH "/%s/name", zone))
+    return ENAMETOOLONG;
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return errno;
+  len = read(fd, name, size - 1);
+  close(fd);
+  if (len <= 0)
+    return EIO;
+  while (len > 0 && name[len - 1] == '\n')
+    len--;
+  name[len] = '\0';
+  return 0;
+}
+
+static int add_zone(int kind, const char * directory, int package, int die)
+{
+  struct powercap_zone * current = &zones[kind][nr_zones[kind]];
+  int ret;
+  current->package = package;
+  current->die = die;
+  current->window.fd = -1;
+  ret = sysfs_file_open(&current->limit, POWERCAP_PATH "/%s/constraint_%d_power_limit_uw",
+      directory, constraint);
+  if (ret)
+    return ret;
+  /* not every constraint has a time window */
+  sysfs_file_open(&current->window, POWERCAP_PATH "/%s/constraint_%d_time_window_us",
+      directory, constraint);
+  nr_zones[kind]++;
+  return 0;
+}
+
+/* close the files of all zones and free the tables */
+static void free_zones(void)
+{
+  int kind, zone;
+  for (kind = 0; kind < POWERCAP_KINDS; kind++)
+  {
+    for (zone = 0; zone < nr_zones[kind]; zone++)
+    {
+      sysfs_file_close(&zones[kind][zone].window);
+      sysfs_file_close(&zones[kind][zone].limit);
+    }
+    free(zones[kind]);
+    zones[kind] = NULL;
+    nr_zones[kind] = 0;
+    free(cpu_zone[kind]);
+    cpu_zone[kind] = NULL;
+  }
+}
+
+int powercap_init(void)
+{
+  char path[512];
+  char name[64];
+  struct dirent **namelist;
+  int nr_entries, entry, cpu, kind, zone, ret;
+
+  ret = topology_init();
+  if (ret)
+    return ret;
+
+  if (sysfs_path(path, sizeof(path), POWERCAP_PATH))
+    return ENAMETOOLONG;
+  nr_entries = scandir(path, &namelist, NULL, alphasort);
+  if (nr_entries < 0)
+    return ENODEV;
+
+  for (kind = 0; kind < POWERCAP_KINDS; kind++)
+  {
+    nr_zones[kind] = 0;
+    zones[kind] = calloc(nr_entries, sizeof(struct powercap_zone));
+    if (zones[kind] == NULL)
+      ret = ENOMEM;
+  }
+
+  for (entry = 0; entry < nr_entries; entry++)
+  {
+    const char * directory = namelist[entry]->d_name;
+    int parent, subzone, package, die = -1;
+    int nr_ids = sscanf(directory, "intel-rapl:%d:%d", &parent, &subzone);
+    if (ret == 0 && nr_ids >= 1 && read_name(directory, name, sizeof(name)) == 0)
+    {
+      if (nr_ids == 1)
+      {
+        /* "package-<nr>" or "package-<nr>-die-<nr>", psys is ignored */
+        if (sscanf(name, "package-%d-die-%d", &package, &die) >= 1)
+          add_zone(POWERCAP_PACKAGE, directory, package, die);
+      }
+      else if (strcmp(name, "dram") == 0)
+      {
+        /* DRAM zones belong to the package of their parent */
+        char parent_directory[32];
+        sprintf(parent_directory, "intel-rapl:%d", parent);
+        if (read_name(parent_directory, name, sizeof(name)) == 0 &&
+            sscanf(name, "package-%d-die-%d", &package, &die) >= 1)
+          add_zone(POWERCAP_DRAM, directory, package, die);
+      }
+    }
+    free(namelist[entry]);
+  }
+  free(namelist);
+  /* powercap_fini is not called if the initialization fails */
+  if (ret == 0 && nr_zones[POWERCAP_PACKAGE] == 0 && nr_zones[POWERCAP_DRAM] == 0)
+    ret = ENODEV;
+  if (ret)
+  {
+    free_zones();
+    return ret;
+  }
+
+  /* map cpus to zones, so there is no search when a region is entered */
+  nr_cpus = topology_nr_cpus();
+  for (kind = 0; kind < POWERCAP_KINDS; kind++)
+  {
+    cpu_zone[kind] = calloc(nr_cpus, sizeof(int));
+    if (cpu_zone[kind] == NULL)
+    {
+      free_zones();
+      return ENOMEM;
+    }
+    for (cpu = 0; cpu < nr_cpus; cpu++)
+    {
+      cpu_zone[kind][cpu] = -1;
+      for (zone = 0; zone < nr_zones[kind]; zone++)
+        if (zones[kind][zone].package == topology_package(cpu) &&
+            (zones[kind][zone].die < 0 || zones[kind][zone].die == topology_die(cpu)))
+          cpu_zone[kind][cpu] = zone;
+    }
+  }
+  return 0;
+}
+
+int powercap_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  int was_set = 0;
+  config_setting_t *setting;
+  struct powercap_information * info = vp;
+  int64_t * values[8] = { &info->package_before, &info->package_after,
+      &info->package_window_before, &info->package_window_after,
+      &info->dram_before, &info->dram_after,
+      &info->dram_window_before, &info->dram_window_after };
+  const char * names[8] = { "package_before", "package_after",
+      "package_window_before", "package_window_after",
+      "dram_before", "dram_after",
+      "dram_window_before", "dram_window_after" };
+  int i;
+
+  for (i = 0; i < 8; i++)
+  {
+    *values[i] = -1;
+    sprintf(buffer, "%s.%s_%s", prefix, POWERCAP_CONFIG_STRING, names[i]);
+    setting = config_lookup(cfg, buffer);
+    if (setting) {
+      *values[i] = config_setting_get_int64(setting);
+      if (*values[i] < 0)
+      {
+        fprintf(stderr, "%s has to be positive\n", buffer);
+        *values[i] = -1;
+        continue;
+      }
+#ifdef VERBOSE
+      fprintf(stderr,"%s = %" PRId64 "\n",buffer,*values[i]);
+#endif
+      was_set = 1;
+    }
+  }
+  return was_set;
+}
+
+static int write_value(struct sysfs_file * file, int64_t value)
+{
+  char buffer[24];
+  int len;
+  if (value < 0)
+    return 0;
+  if (file->fd == -1)
+    return ENOENT;
+  len = snprintf(buffer, sizeof(buffer), "%" PRId64, value);
+  return sysfs_file_write(file, buffer, len);
+}
+
+static int set_limit(int kind, int64_t limit, int64_t window, int32_t cpu)
+{
+  struct powercap_zone * zone;
+  int ok = 0;
+  if (limit < 0 && window < 0)
+    return 0;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  if (cpu < 0 || cpu >= nr_cpus || cpu_zone[kind][cpu] < 0)
+    return EINVAL;
+  zone = &zones[kind][cpu_zone[kind][cpu]];
+#ifdef VERBOSE
+  fprintf(stderr,"changing power limit of %s zone of package %d to %" PRId64 " uW, %" PRId64 " us\n",
+      kind == POWERCAP_DRAM ? "dram" : "package", zone->package, limit, window);
+#endif
+  while (__sync_lock_test_and_set(&zone->lock, 1))
+    ;
+  ok |= write_value(&zone->window, window);
+  ok |= write_value(&zone->limit, limit);
+  __sync_lock_release(&zone->lock);
+#ifdef VERBOSE
+  if (ok)
+    fprintf(stderr,"Setting power limit failed %i!\n",ok);
+#endif
+  return ok;
+}
+
+int powercap_process_before(void * vp, int32_t cpu)
+{
+  struct powercap_information * info = vp;
+  return set_limit(POWERCAP_PACKAGE, info->package_before, info->package_window_before, cpu) |
+         set_limit(POWERCAP_DRAM, info->dram_before, info->dram_window_before, cpu);
+}
+
+int powercap_process_after(void * vp, int32_t cpu)
+{
+  struct powercap_information * info = vp;
+  return set_limit(POWERCAP_PACKAGE, info->package_after, info->package_window_after, cpu) |
+         set_limit(POWERCAP_DRAM, info->dram_after, info->dram_window_after, cpu);
+}
+
+int powercap_fini(void)
+{
+  /* reset original limits and close files */
+  int kind, zone;
+  int error = 0;
+  for (kind = 0; kind < POWERCAP_KINDS; kind++)
+    for (zone = 0; zone < nr_zones[kind]; zone++)
+    {
+      struct powercap_zone * current = &zones[kind][zone];
+      error |= sysfs_file_restore(&current->window);
+      error |= sysfs_file_restore(&current->limit);
+    }
+  free_zones();
+  return error;
+}
@@ -0,0 +1,51 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef POWERCAP_H_
+#define POWERCAP_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#define POWERCAP_CONFIG_STRING "powercap"
+
+/* power limits in uW and time windows in us, -1 if not set */
+struct powercap_information{
+  int64_t package_before;
+  int64_t package_after;
+  int64_t package_window_before;
+  int64_t package_window_after;
+  int64_t dram_before;
+  int64_t dram_after;
+  int64_t dram_window_before;
+  int64_t dram_window_after;
+};
+
+int powercap_read_global_config(struct config_t * cfg, char * buffer);
+
+int powercap_init(void);
+
+int powercap_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int powercap_process_before(void * info, int32_t cpu);
+int powercap_process_after(void * info, int32_t cpu);
+
+int powercap_fini(void);
+
+#endif /* POWERCAP_H_ */
@@ -0,0 +1,446 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "resctrl.h"
+#include "dct.h"
+#include "sysfs_file.h"
+#include "threads.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* a resctrl group, the first one is the default group at the root */
+struct resctrl_group{
+  char name[64];
+  /* the tasks file, opened on first use */
+  int fd;
+  /* schemata of groups that are created by libadapt, NULL otherwise */
+  char * schemata;
+  int created;
+};
+
+/* the group of a thread that has been moved */
+struct moved_thread{
+  pid_t tid;
+  int32_t group;
+  int32_t original;
+};
+
+/* where resctrl is mounted, below sysfs_root */
+static char resctrl_root[256] = "/sys/fs/resctrl";
+
+static struct resctrl_group groups[RESCTRL_MAX_GROUPS];
+static int nr_groups = 0;
+
+/* sorted by tid */
+static struct moved_thread * threads = NULL;
+static int nr_threads = 0;
+static volatile int threads_lock = 0;
+/* incremented whenever all threads are moved, so the cache of a thread
+ * becomes invalid */
+static volatile int generation = 0;
+
+/* the group of the calling thread */
+static __thread int own_generation = -1;
+static __thread int32_t own_group;
+
+static void lock(void)
+{
+  while (__sync_lock_test_and_set(&threads_lock, 1))
+    ;
+}
+
+static void unlock(void)
+{
+  __sync_lock_release(&threads_lock);
+}
+
+/* find a group by name or add it, "" and "/" are the default group */
+static int32_t get_group(const char * name)
+{
+  int32_t i;
+  while (*name == '/')
+    name++;
+  if (nr_groups == 0)
+  {
+    groups[0].name[0] = '\0';
+    groups[0].fd = -1;
+    groups[0].schemata = NULL;
+    groups[0].created = 0;
+    nr_groups = 1;
+  }
+  for (i = 0; i < nr_groups; i++)
+    if (strcmp(groups[i].name, name) == 0)
+      return i;
+  if (nr_groups == RESCTRL_MAX_GROUPS || strlen(name) >= sizeof(groups[0].name) ||
+      strchr(name, '/') != NULL)
+    return -1;
+  strcpy(groups[nr_groups].name, name);
+  groups[nr_groups].fd = -1;
+  groups[nr_groups].schemata = NULL;
+  groups[nr_groups].created = 0;
+  return nr_groups++;
+}
+
+int resctrl_read_global_config(struct config_t * cfg, char * buffer)
+{
+  config_setting_t *setting;
+  const char * value;
+  int i;
+
+  sprintf(buffer, "%s_root", RESCTRL_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  if (setting && (value = config_setting_get_string(setting)) != NULL)
+  {
+    if (strlen(value) >= sizeof(resctrl_root))
+      return ENAMETOOLONG;
+    strcpy(resctrl_root, value);
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %s\n",buffer,resctrl_root);
+#endif
+  }
+  /* groups that are created at initialization */
+  for (i = 0; i < RESCTRL_MAX_GROUPS; i++)
+  {
+    int32_t group;
+    size_t len;
+    sprintf(buffer, "%s_group_%d.name", RESCTRL_CONFIG_STRING, i);
+    setting = config_lookup(cfg, buffer);
+    if (setting == NULL)
+      break;
+    value = config_setting_get_string(setting);
+    group = value ? get_group(value) : -1;
+    if (group <= 0)
+    {
+      fprintf(stderr, "%s has to be a valid group name\n", buffer);
+      return EINVAL;
+    }
+    sprintf(buffer, "%s_group_%d.schemata", RESCTRL_CONFIG_STRING, i);
+    setting = config_lookup(cfg, buffer);
+    if (setting == NULL || (value = config_setting_get_string(setting)) == NULL)
+    {
+      fprintf(stderr, "%s is missing\n", buffer);
+      return EINVAL;
+    }
+    free(groups[group].schemata);
+    /* resctrl only applies lines that end with a newline */
+    len = strlen(value);
+    groups[group].schemata = malloc(len + 2);
+    if (groups[group].schemata == NULL)
+      return ENOMEM;
+    strcpy(groups[group].schemata, value);
+    if (len == 0 || value[len - 1] != '\n')
+      strcat(groups[group].schemata, "\n");
+#ifdef VERBOSE
+    fprintf(stderr,"%s = %s (%s)\n",buffer,value,groups[group].name);
+#endif
+  }
+  return 0;
+}
+
+static int create_group(struct resctrl_group * group)
+{
+  char path[512];
+  size_t len;
+  ssize_t written;
+  int fd, ret = 0;
+
+  if (sysfs_path(path, sizeof(path), "%s/%s", resctrl_root, group->name))
+    return ENAMETOOLONG;
+  if (mkdir(path, 0755) == 0)
+    group->created = 1;
+  else if (errno != EEXIST)
+    return errno;
+  if (sysfs_path(path, sizeof(path), "%s/%s/schemata", resctrl_root, group->name))
+    return ENAMETOOLONG;
+  fd = open(path, O_WRONLY | O_CREAT, 0644);
+  if (fd < 0)
+    return errno;
+  /* resctrl parses the schemata line by line */
+  len = strlen(group->schemata);
+  written = write(fd, group->schemata, len);
+  if (written != (ssize_t) len)
+  {
+    ret = written < 0 ? errno : EIO;
+    fprintf(stderr, "Could not write schemata \"%.*s\" of resctrl group %s\n",
+        (int) len - 1,
+        group->schemata, group->name);
+  }
+  close(fd);
+  return ret;
+}
+
+/* threads that are still in a created group are moved to the default group
+ * by the kernel */
+static void remove_groups(void)
+{
+  char path[512];
+  int i;
+  for (i = 0; i < nr_groups; i++)
+  {
+    if (groups[i].created &&
+        sysfs_path(path, sizeof(path), "%s/%s", resctrl_root, groups[i].name) == 0)
+      rmdir(path);
+    groups[i].created = 0;
+  }
+}
+
+int resctrl_init(void)
+{
+  int i, ret;
+  if (!sysfs_exists("%s/tasks", resctrl_root))
+    return ENODEV;
+  get_group("");
+  for (i = 1; i < nr_groups; i++)
+    if (groups[i].schemata != NULL)
+    {
+      ret = create_group(&groups[i]);
+      if (ret)
+      {
+        /* resctrl_fini is not called then */
+        remove_groups();
+        return ret;
+      }
+    }
+  return 0;
+}
+
+static int read_group(struct config_t * cfg, char * buffer, int32_t * group)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  const char * name;
+  *group = -1;
+  if (setting == NULL)
+    return 0;
+  name = config_setting_get_string(setting);
+  if (name != NULL)
+    *group = get_group(name);
+  if (*group < 0)
+  {
+    fprintf(stderr, "%s has to be a valid group name\n", buffer);
+    return 0;
+  }
+#ifdef VERBOSE
+  fprintf(stderr, "%s = %s\n",buffer,name);
+#endif
+  return 1;
+}
+
+int resctrl_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  struct resctrl_information * info = vp;
+  config_setting_t *setting;
+  int was_set = 0;
+
+  sprintf(buffer, "%s.%s_group_before", prefix, RESCTRL_CONFIG_STRING);
+  was_set |= read_group(cfg, buffer, &info->group_before);
+  sprintf(buffer, "%s.%s_group_after", prefix, RESCTRL_CONFIG_STRING);
+  was_set |= read_group(cfg, buffer, &info->group_after);
+  sprintf(buffer, "%s.%s_all_threads", prefix, RESCTRL_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  info->all_threads = setting ? config_setting_get_int(setting) : 0;
+  return was_set;
+}
+
+/* the group a thread is in, via /proc/<pid>/task/<tid>/resctrl if the
+ * kernel provides it, otherwise the default group is assumed, called with
+ * threads_lock held */
+static int32_t current_group(pid_t tid)
+{
+  char path[64];
+  char line[128];
+  int32_t group = 0;
+  FILE * file;
+
+  sprintf(path, "/proc/self/task/%d/resctrl", (int) tid);
+  file = fopen(path, "r");
+  if (file == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), file) != NULL)
+    if (strncmp(line, "res:", 4) == 0)
+    {
+      line[strcspn(line, "\n")] = '\0';
+      group = get_group(&line[4]);
+      break;
+    }
+  fclose(file);
+  return group < 0 ? 0 : group;
+}
+
+/* find a thread in the table, add it with its current group if it is new,
+ * called with threads_lock held */
+static struct moved_thread * get_thread(pid_t tid, int * error)
+{
+  struct moved_thread * tmp;
+  int low = 0, high = nr_threads, i;
+
+  while (low < high)
+  {
+    int mid = (low + high) / 2;
+    if (threads[mid].tid < tid)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (low < nr_threads && threads[low].tid == tid)
+    return &threads[low];
+  tmp = realloc(threads, (nr_threads + 1) * sizeof(struct moved_thread));
+  if (tmp == NULL)
+  {
+    *error = ENOMEM;
+    return NULL;
+  }
+  threads = tmp;
+  for (i = nr_threads; i > low; i--)
+    threads[i] = threads[i - 1];
+  nr_threads++;
+  threads[low].tid = tid;
+  threads[low].group = threads[low].original = current_group(tid);
+  return &threads[low];
+}
+
+/* write the thread id to the tasks file of the group, called with
+ * threads_lock held */
+static int move_thread(struct moved_thread * thread, int32_t group)
+{
+  char buffer[32];
+  int len;
+
+  if (thread->group == group)
+    return 0;
+  if (groups[group].fd == -1)
+  {
+    char path[512];
+    if (sysfs_path(path, sizeof(path), "%s/%s/tasks", resctrl_root, groups[group].name))
+      return ENAMETOOLONG;
+    groups[group].fd = open(path, O_WRONLY);
+    if (groups[group].fd == -1)
+      return errno;
+  }
+  len = sprintf(buffer, "%d\n", (int) thread->tid);
+  if (write(groups[group].fd, buffer, len) != len)
+    return errno ? errno : EIO;
+  thread->group = group;
+  return 0;
+}
+
+static int move_self(int32_t group)
+{
+  struct moved_thread * thread;
+  int ret = 0;
+
+  /* nothing changes, no write needed */
+  if (own_generation == generation && own_group == group)
+    return 0;
+  lock();
+  thread = get_thread(threads_self(), &ret);
+  if (thread != NULL)
+  {
+    ret = move_thread(thread, group);
+    own_group = thread->group;
+    own_generation = generation;
+  }
+  unlock();
+  return ret;
+}
+
+static int move_all(int32_t group)
+{
+  pid_t * tids;
+  int nr, i, ret;
+  int ok = 0;
+
+  ret = threads_list(&tids, &nr);
+  if (ret)
+    return ret;
+  lock();
+  for (i = 0; i < nr; i++)
+  {
+    struct moved_thread * thread = get_thread(tids[i], &ret);
+    if (thread == NULL)
+    {
+      ok |= ret;
+      continue;
+    }
+    ret = move_thread(thread, group);
+    /* threads that ended in between are ignored */
+    ok |= ret == ESRCH ? 0 : ret;
+  }
+  generation++;
+  unlock();
+  free(tids);
+  return ok;
+}
+
+static int apply(int32_t group, int all_threads)
+{
+  if (group < 0)
+    return 0;
+  /* within a team (e.g., via OMPT), only the primary thread moves all
+   * threads */
+  if (all_threads && omp_dct_get_thread_num() != 0)
+    return 0;
+  if (all_threads)
+    return move_all(group);
+  return move_self(group);
+}
+
+int resctrl_process_before(void * vp, int32_t cpu)
+{
+  struct resctrl_information * info = vp;
+  return apply(info->group_before, info->all_threads);
+}
+
+int resctrl_process_after(void * vp, int32_t cpu)
+{
+  struct resctrl_information * info = vp;
+  return apply(info->group_after, info->all_threads);
+}
+
+int resctrl_fini(void)
+{
+  int i, ret;
+  int ok = 0;
+  lock();
+  for (i = 0; i < nr_threads; i++)
+  {
+    ret = move_thread(&threads[i], threads[i].original);
+    ok |= ret == ESRCH ? 0 : ret;
+  }
+  free(threads);
+  threads = NULL;
+  nr_threads = 0;
+  generation++;
+  for (i = 0; i < nr_groups; i++)
+  {
+    if (groups[i].fd != -1)
+      close(groups[i].fd);
+    groups[i].fd = -1;
+    free(groups[i].schemata);
+    groups[i].schemata = NULL;
+  }
+  remove_groups();
+  unlock();
+  return ok;
+}
@@ -0,0 +1,50 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef RESCTRL_H_
+#define RESCTRL_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#define RESCTRL_CONFIG_STRING "resctrl"
+
+/* maximal number of resctrl groups that can be used */
+#define RESCTRL_MAX_GROUPS 64
+
+struct resctrl_information{
+  /* index of the resctrl group, -1 if not set */
+  int32_t group_before;
+  int32_t group_after;
+  /* move all threads of the process instead of the calling thread */
+  int32_t all_threads;
+};
+
+int resctrl_read_global_config(struct config_t * cfg, char * buffer);
+
+int resctrl_init(void);
+
+int resctrl_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int resctrl_process_before(void * info, int32_t cpu);
+int resctrl_process_after(void * info, int32_t cpu);
+
+int resctrl_fini(void);
+
+#endif /* RESCTRL_H_ */
@@ -0,0 +1,499 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "sched_policy.h"
+#include "dct.h"
+#include "threads.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* nested regions up to this depth restore the settings of the enclosing
+ * region on exit */
+#define SCHED_MAX_DEPTH 16
+
+static const struct {
+  const char * name;
+  int32_t policy;
+} policy_names[] = {
+  {"other", SCHED_OTHER},
+  {"normal", SCHED_OTHER},
+  {"batch", SCHED_BATCH},
+  {"idle", SCHED_IDLE},
+  {"fifo", SCHED_FIFO},
+  {"rr", SCHED_RR}
+};
+
+/* the settings of a thread that has been changed */
+struct sched_thread{
+  pid_t tid;
+  /* sched_flags of the thread, SCHED_FLAG_RESET_ON_FORK is kept */
+  uint64_t flags;
+  struct sched_settings current;
+  struct sched_settings original;
+  /* settings before the enclosing regions if all threads are changed */
+  int depth;
+  struct sched_settings previous[SCHED_MAX_DEPTH];
+};
+
+/* sorted by tid */
+static struct sched_thread * threads = NULL;
+static int nr_threads = 0;
+static volatile int threads_lock = 0;
+/* incremented whenever the settings are changed for all threads, so the
+ * cache of a thread becomes invalid */
+static volatile int generation = 0;
+
+/* the settings of the calling thread */
+static __thread int own_generation = -1;
+static __thread struct sched_settings own;
+/* settings before the enclosing regions of the calling thread */
+static __thread int own_depth = 0;
+static __thread struct sched_settings own_previous[SCHED_MAX_DEPTH];
+
+static void lock(void)
+{
+  while (__sync_lock_test_and_set(&threads_lock, 1))
+    ;
+}
+
+static void unlock(void)
+{
+  __sync_lock_release(&threads_lock);
+}
+
+static int is_realtime(int32_t policy)
+{
+  return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static int is_set(const struct sched_settings * settings)
+{
+  return settings->policy >= 0 || settings->priority >= 0 ||
+         settings->nice != SCHED_NICE_UNSET || settings->timerslack >= 0;
+}
+
+static int is_equal(const struct sched_settings * a, const struct sched_settings * b)
+{
+  return a->policy == b->policy && a->priority == b->priority &&
+         a->nice == b->nice && a->timerslack == b->timerslack;
+}
+
+int sched_policy_init(void)
+{
+  struct threads_sched_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  return threads_get_sched_attr(0, &attr);
+}
+
+static int read_settings(struct config_t * cfg, char * buffer, char * prefix,
+    const char * suffix, struct sched_settings * settings)
+{
+  config_setting_t *setting;
+  int was_set = 0;
+  int i;
+
+  settings->policy = -1;
+  settings->priority = -1;
+  settings->nice = SCHED_NICE_UNSET;
+  settings->timerslack = -1;
+
+  sprintf(buffer, "%s.%s_policy_%s", prefix, SCHED_POLICY_CONFIG_STRING, suffix);
+  setting = config_lookup(cfg, buffer);
+  if (setting != NULL)
+  {
+    const char * name = config_setting_get_string(setting);
+    for (i = 0; name != NULL && i < sizeof(policy_names) / sizeof(policy_names[0]); i++)
+      if (strcmp(name, policy_names[i].name) == 0)
+        settings->policy = policy_names[i].policy;
+    if (settings->policy < 0)
+      fprintf(stderr, "%s has to be one of other, batch, idle, fifo or rr\n", buffer);
+    else
+    {
+      was_set = 1;
+#ifdef VERBOSE
+      fprintf(stderr, "%s = %s\n", buffer, name);
+#endif
+    }
+  }
+
+  sprintf(buffer, "%s.%s_priority_%s", prefix, SCHED_POLICY_CONFIG_STRING, suffix);
+  setting = config_lookup(cfg, buffer);
+  if (setting != NULL)
+  {
+    settings->priority = config_setting_get_int(setting);
+    if (settings->priority < 1 || settings->priority > 99)
+    {
+      fprintf(stderr, "%s has to be between 1 and 99\n", buffer);
+      settings->priority = -1;
+    }
+    else
+    {
+      was_set = 1;
+#ifdef VERBOSE
+      fprintf(stderr, "%s = %" PRId32 "\n", buffer, settings->priority);
+#endif
+    }
+  }
+
+  sprintf(buffer, "%s.%s_nice_%s", prefix, SCHED_POLICY_CONFIG_STRING, suffix);
+  setting = config_lookup(cfg, buffer);
+  if (setting != NULL)
+  {
+    settings->nice = config_setting_get_int(setting);
+    if (settings->nice < -20 || settings->nice > 19)
+    {
+      fprintf(stderr, "%s has to be between -20 and 19\n", buffer);
+      settings->nice = SCHED_NICE_UNSET;
+    }
+    else
+    {
+      was_set = 1;
+#ifdef VERBOSE
+      fprintf(stderr, "%s = %" PRId32 "\n", buffer, settings->nice);
+#endif
+    }
+  }
+
+  sprintf(buffer, "%s.%s_timerslack_%s", prefix, SCHED_POLICY_CONFIG_STRING, suffix);
+  setting = config_lookup(cfg, buffer);
+  if (setting != NULL)
+  {
+    settings->timerslack = config_setting_get_int64(setting);
+    if (settings->timerslack < 0)
+    {
+      fprintf(stderr, "%s has to be positive\n", buffer);
+      settings->timerslack = -1;
+    }
+    else
+    {
+      was_set = 1;
+#ifdef VERBOSE
+      fprintf(stderr, "%s = %" PRId64 "\n", buffer, settings->timerslack);
+#endif
+    }
+  }
+  return was_set;
+}
+
+int sched_policy_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  struct sched_policy_information * info = vp;
+  config_setting_t *setting;
+  int was_set = 0;
+
+  was_set |= read_settings(cfg, buffer, prefix, "before", &info->before);
+  was_set |= read_settings(cfg, buffer, prefix, "after", &info->after);
+  sprintf(buffer, "%s.%s_all_threads", prefix, SCHED_POLICY_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  info->all_threads = setting ? config_setting_get_int(setting) : 0;
+  return was_set;
+}
+
+/* the settings of a thread after applying a request */
+static void merge(const struct sched_settings * current,
+    const struct sched_settings * request, struct sched_settings * result)
+{
+  *result = *current;
+  if (request->policy >= 0)
+    result->policy = request->policy;
+  if (request->priority >= 0)
+    result->priority = request->priority;
+  if (request->nice != SCHED_NICE_UNSET)
+    result->nice = request->nice;
+  if (request->timerslack >= 0)
+    result->timerslack = request->timerslack;
+  /* realtime policies need a priority, all others use 0 */
+  if (!is_realtime(result->policy))
+    result->priority = 0;
+  else if (result->priority == 0)
+    result->priority = 1;
+}
+
+/* find a thread in the table, add it with its current settings if it is
+ * new, called with threads_lock held. The timer slack of other threads can
+ * only be read with ptrace permissions, so it is -1 until it is changed */
+static struct sched_thread * get_thread(pid_t tid, int * error)
+{
+  struct threads_sched_attr attr;
+  struct sched_thread * tmp;
+  int low = 0, high = nr_threads, i;
+
+  while (low < high)
+  {
+    int mid = (low + high) / 2;
+    if (threads[mid].tid < tid)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (low < nr_threads && threads[low].tid == tid)
+    return &threads[low];
+  memset(&attr, 0, sizeof(attr));
+  *error = threads_get_sched_attr(tid, &attr);
+  if (*error)
+    return NULL;
+  tmp = realloc(threads, (nr_threads + 1) * sizeof(struct sched_thread));
+  if (tmp == NULL)
+  {
+    *error = ENOMEM;
+    return NULL;
+  }
+  threads = tmp;
+  for (i = nr_threads; i > low; i--)
+    threads[i] = threads[i - 1];
+  nr_threads++;
+  memset(&threads[low], 0, sizeof(struct sched_thread));
+  threads[low].tid = tid;
+  threads[low].flags = attr.sched_flags;
+  threads[low].current.policy = attr.sched_policy & ~SCHED_RESET_ON_FORK;
+  threads[low].current.priority = attr.sched_priority;
+  threads[low].current.nice = attr.sched_nice;
+  threads[low].current.timerslack = -1;
+  threads[low].original = threads[low].current;
+  return &threads[low];
+}
+
+/* write the settings that differ from the current ones, called with
+ * threads_lock held. A timer slack of -1 is the original one */
+static int write_settings(struct sched_thread * thread, const struct sched_settings * settings)
+{
+  struct threads_sched_attr attr;
+  int64_t slack = settings->timerslack;
+  uint64_t read;
+  int ret;
+
+  if (settings->policy != thread->current.policy ||
+      settings->priority != thread->current.priority ||
+      settings->nice != thread->current.nice)
+  {
+    memset(&attr, 0, sizeof(attr));
+    attr.sched_policy = settings->policy;
+    attr.sched_priority = settings->priority;
+    attr.sched_nice = settings->nice;
+    attr.sched_flags = thread->flags & SCHED_FLAG_RESET_ON_FORK;
+    ret = threads_set_sched_attr(thread->tid, &attr);
+    if (ret)
+      return ret;
+    thread->current.policy = settings->policy;
+    thread->current.priority = settings->priority;
+    thread->current.nice = settings->nice;
+  }
+  if (slack < 0)
+    slack = thread->original.timerslack;
+  if (slack < 0 || slack == thread->current.timerslack)
+    return 0;
+  /* read when it is changed first, EPERM only affects this setting */
+  if (thread->original.timerslack < 0)
+  {
+    ret = threads_get_timerslack(thread->tid, &read);
+    if (ret)
+      return ret;
+    thread->original.timerslack = read;
+    thread->current.timerslack = read;
+    if (slack == thread->current.timerslack)
+      return 0;
+  }
+  ret = threads_set_timerslack(thread->tid, slack);
+  if (ret)
+    return ret;
+  thread->current.timerslack = slack;
+  return 0;
+}
+
+/* update the cached settings of the calling thread if another thread
+ * changed them */
+static int sync_self(void)
+{
+  struct sched_thread * thread;
+  int ret = 0;
+  if (own_generation == generation)
+    return 0;
+  lock();
+  thread = get_thread(threads_self(), &ret);
+  if (thread != NULL)
+  {
+    own = thread->current;
+    own_generation = generation;
+  }
+  unlock();
+  return ret;
+}
+
+static int set_self(const struct sched_settings * settings)
+{
+  struct sched_thread * thread;
+  int ret = 0;
+  /* nothing changes, no syscall needed */
+  if (is_equal(&own, settings))
+    return 0;
+  lock();
+  thread = get_thread(threads_self(), &ret);
+  if (thread != NULL)
+  {
+    ret = write_settings(thread, settings);
+    own = thread->current;
+    own_generation = generation;
+  }
+  unlock();
+  return ret;
+}
+
+static int apply_self(const struct sched_settings * request, int keep_previous)
+{
+  struct sched_settings settings;
+  int ret = sync_self();
+  if (ret)
+    return ret;
+  if (keep_previous)
+  {
+    if (own_depth < SCHED_MAX_DEPTH)
+      own_previous[own_depth] = own;
+    own_depth++;
+  }
+  merge(&own, request, &settings);
+  return set_self(&settings);
+}
+
+static int restore_self(void)
+{
+  int ret;
+  if (own_depth == 0)
+    return 0;
+  own_depth--;
+  if (own_depth >= SCHED_MAX_DEPTH)
+    return 0;
+  ret = sync_self();
+  if (ret)
+    return ret;
+  return set_self(&own_previous[own_depth]);
+}
+
+static int apply_all(const struct sched_settings * request, int keep_previous)
+{
+  struct sched_settings settings;
+  pid_t * tids;
+  int nr, i, ret;
+  int ok = 0;
+
+  ret = threads_list(&tids, &nr);
+  if (ret)
+    return ret;
+  lock();
+  for (i = 0; i < nr; i++)
+  {
+    struct sched_thread * thread = get_thread(tids[i], &ret);
+    if (thread == NULL)
+    {
+      /* threads that ended in between are ignored */
+      ok |= ret == ESRCH ? 0 : ret;
+      continue;
+    }
+    if (keep_previous)
+    {
+      if (thread->depth < SCHED_MAX_DEPTH)
+        thread->previous[thread->depth] = thread->current;
+      thread->depth++;
+    }
+    merge(&thread->current, request, &settings);
+    ret = write_settings(thread, &settings);
+    ok |= ret == ESRCH ? 0 : ret;
+  }
+  generation++;
+  unlock();
+  free(tids);
+  return ok;
+}
+
+static int restore_all(void)
+{
+  int i, ret;
+  int ok = 0;
+  lock();
+  for (i = 0; i < nr_threads; i++)
+  {
+    if (threads[i].depth == 0)
+      continue;
+    threads[i].depth--;
+    if (threads[i].depth >= SCHED_MAX_DEPTH)
+      continue;
+    ret = write_settings(&threads[i], &threads[i].previous[threads[i].depth]);
+    ok |= ret == ESRCH ? 0 : ret;
+  }
+  generation++;
+  unlock();
+  return ok;
+}
+
+int sched_policy_process_before(void * vp, int32_t cpu)
+{
+  struct sched_policy_information * info = vp;
+  /* without settings for the exit, the previous settings are restored */
+  int keep_previous = !is_set(&info->after);
+  if (!is_set(&info->before))
+    return 0;
+  /* within a team (e.g., via OMPT), only the primary thread changes the
+   * settings of all threads */
+  if (info->all_threads && omp_dct_get_thread_num() != 0)
+    return 0;
+  if (info->all_threads)
+    return apply_all(&info->before, keep_previous);
+  return apply_self(&info->before, keep_previous);
+}
+
+int sched_policy_process_after(void * vp, int32_t cpu)
+{
+  struct sched_policy_information * info = vp;
+  if (info->all_threads && omp_dct_get_thread_num() != 0)
+    return 0;
+  if (is_set(&info->after))
+  {
+    if (info->all_threads)
+      return apply_all(&info->after, 0);
+    return apply_self(&info->after, 0);
+  }
+  if (!is_set(&info->before))
+    return 0;
+  if (info->all_threads)
+    return restore_all();
+  return restore_self();
+}
+
+int sched_policy_fini(void)
+{
+  int i, ret;
+  int ok = 0;
+  lock();
+  for (i = 0; i < nr_threads; i++)
+  {
+    ret = write_settings(&threads[i], &threads[i].original);
+    ok |= ret == ESRCH ? 0 : ret;
+  }
+  free(threads);
+  threads = NULL;
+  nr_threads = 0;
+  generation++;
+  unlock();
+  own_depth = 0;
+  return ok;
+}
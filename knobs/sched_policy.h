@@ -0,0 +1,56 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef SCHED_POLICY_H_
+#define SCHED_POLICY_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#define SCHED_POLICY_CONFIG_STRING "sched"
+
+/* a nice value that is not set */
+#define SCHED_NICE_UNSET 100
+
+/* the scheduling settings of a thread, the policy, priority and timer slack
+ * are -1 if not set, the nice value is SCHED_NICE_UNSET */
+struct sched_settings{
+  int32_t policy;
+  int32_t priority;
+  int32_t nice;
+  int64_t timerslack;
+};
+
+struct sched_policy_information{
+  struct sched_settings before;
+  struct sched_settings after;
+  /* apply to all threads of the process instead of the calling thread */
+  int32_t all_threads;
+};
+
+int sched_policy_init(void);
+
+int sched_policy_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int sched_policy_process_before(void * info, int32_t cpu);
+int sched_policy_process_after(void * info, int32_t cpu);
+
+int sched_policy_fini(void);
+
+#endif /* SCHED_POLICY_H_ */
@@ -0,0 +1,259 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "turbo.h"
+#include "sysfs_file.h"
+#include "topology.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CPUFREQ_PATH "/sys/devices/system/cpu/cpufreq"
+#define NO_TURBO_PATH "/sys/devices/system/cpu/intel_pstate/no_turbo"
+
+/* how turbo is switched, detected at initialization */
+#define TURBO_BACKEND_POLICY       0 /* cpufreq/policy<nr>/boost */
+#define TURBO_BACKEND_INTEL_PSTATE 1 /* intel_pstate/no_turbo */
+#define TURBO_BACKEND_GLOBAL       2 /* cpufreq/boost */
+
+static int backend = TURBO_BACKEND_GLOBAL;
+
+/* one file for TURBO_BACKEND_INTEL_PSTATE and TURBO_BACKEND_GLOBAL, one per
+ * policy for TURBO_BACKEND_POLICY */
+static struct sysfs_file * files = NULL;
+static int nr_files = 0;
+/* serializes the writes, which are rare since unchanged values are skipped */
+static volatile int files_lock = 0;
+/* file of every cpu, -1 if there is none */
+static int * cpu_file = NULL;
+static int nr_cpus = 0;
+
+/* map the cpus of a policy (policy<nr>/related_cpus) to its file */
+static void map_policy(const char * policy, int file)
+{
+  char path[512];
+  char list[1024];
+  char * current, * end;
+  ssize_t len;
+  int fd;
+
+  if (sysfs_path(path, sizeof(path), CPUFREQ_PATH "/%s/related_cpus", policy))
+    return;
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return;
+  len = read(fd, list, sizeof(list) - 1);
+  close(fd);
+  if (len <= 0)
+    return;
+  list[len] = '\0';
+  /* a list of cpus separated by spaces */
+  for (current = list; ; current = end)
+  {
+    long cpu = strtol(current, &end, 10);
+    if (end == current)
+      break;
+    if (cpu >= 0 && cpu < nr_cpus)
+      cpu_file[cpu] = file;
+  }
+}
+
+static int init_policies(void)
+{
+  char path[512];
+  struct dirent **namelist;
+  int nr_entries, entry, nr;
+
+  if (sysfs_path(path, sizeof(path), CPUFREQ_PATH))
+    return ENAMETOOLONG;
+  nr_entries = scandir(path, &namelist, NULL, alphasort);
+  if (nr_entries < 0)
+    return ENODEV;
+  files = calloc(nr_entries, sizeof(struct sysfs_file));
+  for (entry = 0; entry < nr_entries; entry++)
+  {
+    const char * policy = namelist[entry]->d_name;
+    if (files != NULL && sscanf(policy, "policy%d", &nr) == 1 &&
+        sysfs_exists(CPUFREQ_PATH "/%s/boost", policy) &&
+        sysfs_file_open(&files[nr_files], CPUFREQ_PATH "/%s/boost", policy) == 0)
+    {
+      map_policy(policy, nr_files);
+      nr_files++;
+    }
+    free(namelist[entry]);
+  }
+  free(namelist);
+  if (files == NULL)
+    return ENOMEM;
+  if (nr_files == 0)
+  {
+    free(files);
+    files = NULL;
+    return ENODEV;
+  }
+  return 0;
+}
+
+static int init_single(const char * path)
+{
+  int cpu, ret;
+  files = calloc(1, sizeof(struct sysfs_file));
+  if (files == NULL)
+    return ENOMEM;
+  ret = sysfs_file_open(&files[0], path);
+  if (ret)
+  {
+    free(files);
+    files = NULL;
+    return ret;
+  }
+  nr_files = 1;
+  for (cpu = 0; cpu < nr_cpus; cpu++)
+    cpu_file[cpu] = 0;
+  return 0;
+}
+
+int turbo_init(void)
+{
+  int cpu, ret;
+
+  ret = topology_init();
+  if (ret)
+    return ret;
+  nr_cpus = topology_nr_cpus();
+  cpu_file = malloc(nr_cpus * sizeof(int));
+  if (cpu_file == NULL)
+    return ENOMEM;
+  for (cpu = 0; cpu < nr_cpus; cpu++)
+    cpu_file[cpu] = -1;
+
+  /* prefer the backend with the finest granularity */
+  backend = TURBO_BACKEND_POLICY;
+  ret = init_policies();
+  if (ret && sysfs_exists(NO_TURBO_PATH))
+  {
+    backend = TURBO_BACKEND_INTEL_PSTATE;
+    ret = init_single(NO_TURBO_PATH);
+  }
+  if (ret && sysfs_exists(CPUFREQ_PATH "/boost"))
+  {
+    backend = TURBO_BACKEND_GLOBAL;
+    ret = init_single(CPUFREQ_PATH "/boost");
+  }
+  if (ret)
+  {
+    free(cpu_file);
+    cpu_file = NULL;
+    return ret;
+  }
+#ifdef VERBOSE
+  fprintf(stderr, "Switching turbo via %s\n",
+      backend == TURBO_BACKEND_POLICY ? "cpufreq policies" :
+      backend == TURBO_BACKEND_INTEL_PSTATE ? "intel_pstate" : "cpufreq boost");
+#endif
+  return 0;
+}
+
+static int read_value(struct config_t * cfg, char * buffer, int32_t * value)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  *value = -1;
+  if (setting == NULL)
+    return 0;
+  *value = config_setting_get_int(setting) ? 1 : 0;
+#ifdef VERBOSE
+  fprintf(stderr,"%s = %" PRId32 "\n",buffer,*value);
+#endif
+  return 1;
+}
+
+int turbo_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  int was_set = 0;
+  struct turbo_information * info = vp;
+
+  sprintf(buffer, "%s.%s_before", prefix, TURBO_CONFIG_STRING);
+  was_set |= read_value(cfg, buffer, &info->turbo_before);
+  sprintf(buffer, "%s.%s_after", prefix, TURBO_CONFIG_STRING);
+  was_set |= read_value(cfg, buffer, &info->turbo_after);
+  return was_set;
+}
+
+static int set_turbo(int32_t turbo, int32_t cpu)
+{
+  const char * value;
+  int ok;
+  if (turbo < 0)
+    return 0;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  if (cpu < 0 || cpu >= nr_cpus || cpu_file[cpu] < 0)
+    return EINVAL;
+  /* no_turbo is inverted */
+  if (backend == TURBO_BACKEND_INTEL_PSTATE)
+    value = turbo ? "0" : "1";
+  else
+    value = turbo ? "1" : "0";
+  while (__sync_lock_test_and_set(&files_lock, 1))
+    ;
+  ok = sysfs_file_write(&files[cpu_file[cpu]], value, 1);
+  __sync_lock_release(&files_lock);
+#ifdef VERBOSE
+  if (ok)
+    fprintf(stderr,"Setting turbo failed %i!\n",ok);
+#endif
+  return ok;
+}
+
+int turbo_process_before(void * vp, int32_t cpu)
+{
+  struct turbo_information * info = vp;
+  return set_turbo(info->turbo_before, cpu);
+}
+
+int turbo_process_after(void * vp, int32_t cpu)
+{
+  struct turbo_information * info = vp;
+  return set_turbo(info->turbo_after, cpu);
+}
+
+int turbo_fini(void)
+{
+  /* reset original values and close files */
+  int file;
+  int error = 0;
+  for (file = 0; file < nr_files; file++)
+  {
+    error |= sysfs_file_restore(&files[file]);
+    sysfs_file_close(&files[file]);
+  }
+  free(files);
+  files = NULL;
+  nr_files = 0;
+  free(cpu_file);
+  cpu_file = NULL;
+  return error;
+}
@@ -0,0 +1,43 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef TURBO_H_
+#define TURBO_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#define TURBO_CONFIG_STRING "turbo"
+
+/* 1 to enable turbo, 0 to disable it, -1 if not set */
+struct turbo_information{
+  int32_t turbo_before;
+  int32_t turbo_after;
+};
+
+int turbo_init(void);
+
+int turbo_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int turbo_process_before(void * info, int32_t cpu);
+int turbo_process_after(void * info, int32_t cpu);
+
+int turbo_fini(void);
+
+#endif /* TURBO_H_ */
@@ -0,0 +1,312 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "uclamp.h"
+#include "dct.h"
+#include "sysfs_file.h"
+#include "threads.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UCLAMP_MAX 1024
+/* only exists if the kernel supports utilization clamping */
+#define UCLAMP_SYSCTL_PATH "/proc/sys/kernel/sched_util_clamp_max"
+
+/* the clamps of a thread that has been changed */
+struct clamped_thread{
+  pid_t tid;
+  uint32_t min;
+  uint32_t max;
+  uint32_t original_min;
+  uint32_t original_max;
+};
+
+/* sorted by tid */
+static struct clamped_thread * threads = NULL;
+static int nr_threads = 0;
+static volatile int threads_lock = 0;
+/* incremented whenever the clamps are changed for all threads, so the cache
+ * of a thread becomes invalid */
+static volatile int generation = 0;
+
+/* the clamps of the calling thread */
+static __thread int own_generation = -1;
+static __thread uint32_t own_min;
+static __thread uint32_t own_max;
+
+static void lock(void)
+{
+  while (__sync_lock_test_and_set(&threads_lock, 1))
+    ;
+}
+
+static void unlock(void)
+{
+  __sync_lock_release(&threads_lock);
+}
+
+/* writing the current clamps again would also probe the support, but marks
+ * them as set by the user, so they no longer follow the system defaults */
+int uclamp_init(void)
+{
+  struct threads_sched_attr attr;
+  int ret;
+  memset(&attr, 0, sizeof(attr));
+  ret = threads_get_sched_attr(0, &attr);
+  if (ret)
+    return ret;
+  if (!sysfs_exists(UCLAMP_SYSCTL_PATH))
+    return EOPNOTSUPP;
+  return 0;
+}
+
+static int read_clamp(struct config_t * cfg, char * buffer, int32_t * value)
+{
+  config_setting_t *setting = config_lookup(cfg, buffer);
+  *value = -1;
+  if (setting == NULL)
+    return 0;
+  *value = config_setting_get_int(setting);
+  if (*value < 0 || *value > UCLAMP_MAX)
+  {
+    fprintf(stderr, "%s has to be between 0 and %d\n", buffer, UCLAMP_MAX);
+    *value = -1;
+    return 0;
+  }
+#ifdef VERBOSE
+  fprintf(stderr, "%s = %" PRId32 "\n",buffer,*value);
+#endif
+  return 1;
+}
+
+int uclamp_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  struct uclamp_information * info = vp;
+  config_setting_t *setting;
+  int was_set = 0;
+
+  sprintf(buffer, "%s.%s_min_before", prefix, UCLAMP_CONFIG_STRING);
+  was_set |= read_clamp(cfg, buffer, &info->min_before);
+  sprintf(buffer, "%s.%s_max_before", prefix, UCLAMP_CONFIG_STRING);
+  was_set |= read_clamp(cfg, buffer, &info->max_before);
+  sprintf(buffer, "%s.%s_min_after", prefix, UCLAMP_CONFIG_STRING);
+  was_set |= read_clamp(cfg, buffer, &info->min_after);
+  sprintf(buffer, "%s.%s_max_after", prefix, UCLAMP_CONFIG_STRING);
+  was_set |= read_clamp(cfg, buffer, &info->max_after);
+  /* the kernel rejects a minimum above the maximum */
+  if (info->max_before >= 0 && info->min_before > info->max_before)
+  {
+    fprintf(stderr, "%s.%s_min_before is above %s_max_before, using the maximum\n",
+        prefix, UCLAMP_CONFIG_STRING, UCLAMP_CONFIG_STRING);
+    info->min_before = info->max_before;
+  }
+  if (info->max_after >= 0 && info->min_after > info->max_after)
+  {
+    fprintf(stderr, "%s.%s_min_after is above %s_max_after, using the maximum\n",
+        prefix, UCLAMP_CONFIG_STRING, UCLAMP_CONFIG_STRING);
+    info->min_after = info->max_after;
+  }
+  sprintf(buffer, "%s.%s_all_threads", prefix, UCLAMP_CONFIG_STRING);
+  setting = config_lookup(cfg, buffer);
+  info->all_threads = setting ? config_setting_get_int(setting) : 0;
+  return was_set;
+}
+
+/* find a thread in the table, add it with its current clamps if it is new,
+ * called with threads_lock held */
+static struct clamped_thread * get_thread(pid_t tid, int * error)
+{
+  struct threads_sched_attr attr;
+  struct clamped_thread * tmp;
+  int low = 0, high = nr_threads, i;
+
+  while (low < high)
+  {
+    int mid = (low + high) / 2;
+    if (threads[mid].tid < tid)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (low < nr_threads && threads[low].tid == tid)
+    return &threads[low];
+  memset(&attr, 0, sizeof(attr));
+  *error = threads_get_sched_attr(tid, &attr);
+  if (*error)
+    return NULL;
+  tmp = realloc(threads, (nr_threads + 1) * sizeof(struct clamped_thread));
+  if (tmp == NULL)
+  {
+    *error = ENOMEM;
+    return NULL;
+  }
+  threads = tmp;
+  for (i = nr_threads; i > low; i--)
+    threads[i] = threads[i - 1];
+  nr_threads++;
+  threads[low].tid = tid;
+  threads[low].min = threads[low].original_min = attr.sched_util_min;
+  threads[low].max = threads[low].original_max = attr.sched_util_max;
+  return &threads[low];
+}
+
+/* called with threads_lock held. If only one clamp is requested, the other
+ * one of the thread can conflict with it, then min is lowered to max */
+static int set_clamps(struct clamped_thread * thread, uint32_t min, uint32_t max)
+{
+  struct threads_sched_attr attr;
+  int ret;
+  if (min > max)
+    min = max;
+  if (thread->min == min && thread->max == max)
+    return 0;
+  memset(&attr, 0, sizeof(attr));
+  attr.sched_flags = SCHED_FLAG_KEEP_POLICY | SCHED_FLAG_KEEP_PARAMS |
+                     SCHED_FLAG_UTIL_CLAMP_MIN | SCHED_FLAG_UTIL_CLAMP_MAX;
+  attr.sched_util_min = min;
+  attr.sched_util_max = max;
+  ret = threads_set_sched_attr(thread->tid, &attr);
+  if (ret == 0)
+  {
+    thread->min = min;
+    thread->max = max;
+  }
+  return ret;
+}
+
+/* clamps that have not been set by the user follow the system defaults.
+ * Writing (uint32_t) -1 resets them to these since Linux 5.11, older kernels
+ * reject it and get the default values instead */
+static int reset_clamps(struct clamped_thread * thread)
+{
+  struct threads_sched_attr attr;
+  int ret;
+  memset(&attr, 0, sizeof(attr));
+  attr.sched_flags = SCHED_FLAG_KEEP_POLICY | SCHED_FLAG_KEEP_PARAMS |
+                     SCHED_FLAG_UTIL_CLAMP_MIN | SCHED_FLAG_UTIL_CLAMP_MAX;
+  attr.sched_util_min = (uint32_t) -1;
+  attr.sched_util_max = (uint32_t) -1;
+  ret = threads_set_sched_attr(thread->tid, &attr);
+  if (ret == EINVAL)
+    return set_clamps(thread, 0, UCLAMP_MAX);
+  return ret;
+}
+
+static int clamp_self(int32_t min, int32_t max)
+{
+  struct clamped_thread * thread;
+  uint32_t new_min, new_max;
+  int ret = 0;
+
+  /* nothing changes, no syscall needed */
+  if (own_generation == generation &&
+      (min < 0 || min == own_min) && (max < 0 || max == own_max))
+    return 0;
+  lock();
+  thread = get_thread(threads_self(), &ret);
+  if (thread != NULL)
+  {
+    new_min = min >= 0 ? min : thread->min;
+    new_max = max >= 0 ? max : thread->max;
+    ret = set_clamps(thread, new_min, new_max);
+    own_min = thread->min;
+    own_max = thread->max;
+    own_generation = generation;
+  }
+  unlock();
+  return ret;
+}
+
+static int clamp_all(int32_t min, int32_t max)
+{
+  pid_t * tids;
+  int nr, i, ret;
+  int ok = 0;
+
+  ret = threads_list(&tids, &nr);
+  if (ret)
+    return ret;
+  lock();
+  for (i = 0; i < nr; i++)
+  {
+    struct clamped_thread * thread = get_thread(tids[i], &ret);
+    if (thread == NULL)
+    {
+      /* threads that ended in between are ignored */
+      ok |= ret == ESRCH ? 0 : ret;
+      continue;
+    }
+    ret = set_clamps(thread, min >= 0 ? min : thread->min, max >= 0 ? max : thread->max);
+    ok |= ret == ESRCH ? 0 : ret;
+  }
+  generation++;
+  unlock();
+  free(tids);
+  return ok;
+}
+
+static int apply(int32_t min, int32_t max, int all_threads)
+{
+  if (min < 0 && max < 0)
+    return 0;
+  /* within a team (e.g., via OMPT), only the primary thread changes the
+   * clamps of all threads */
+  if (all_threads && omp_dct_get_thread_num() != 0)
+    return 0;
+  if (all_threads)
+    return clamp_all(min, max);
+  return clamp_self(min, max);
+}
+
+int uclamp_process_before(void * vp, int32_t cpu)
+{
+  struct uclamp_information * info = vp;
+  return apply(info->min_before, info->max_before, info->all_threads);
+}
+
+int uclamp_process_after(void * vp, int32_t cpu)
+{
+  struct uclamp_information * info = vp;
+  return apply(info->min_after, info->max_after, info->all_threads);
+}
+
+int uclamp_fini(void)
+{
+  int i, ret;
+  int ok = 0;
+  lock();
+  for (i = 0; i < nr_threads; i++)
+  {
+    if (threads[i].original_min == 0 && threads[i].original_max == UCLAMP_MAX)
+      ret = reset_clamps(&threads[i]);
+    else
+      ret = set_clamps(&threads[i], threads[i].original_min, threads[i].original_max);
+    ok |= ret == ESRCH ? 0 : ret;
+  }
+  free(threads);
+  threads = NULL;
+  nr_threads = 0;
+  generation++;
+  unlock();
+  return ok;
+}
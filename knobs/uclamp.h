@@ -0,0 +1,47 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef UCLAMP_H_
+#define UCLAMP_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#define UCLAMP_CONFIG_STRING "uclamp"
+
+/* clamps are 0 to 1024, -1 if not set */
+struct uclamp_information{
+  int32_t min_before;
+  int32_t max_before;
+  int32_t min_after;
+  int32_t max_after;
+  /* apply to all threads of the process instead of the calling thread */
+  int32_t all_threads;
+};
+
+int uclamp_init(void);
+
+int uclamp_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int uclamp_process_before(void * info, int32_t cpu);
+int uclamp_process_after(void * info, int32_t cpu);
+
+int uclamp_fini(void);
+
+#endif /* UCLAMP_H_ */
@@ -0,0 +1,245 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include "uncore.h"
+#include "sysfs_file.h"
+#include "topology.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNCORE_PATH "/sys/devices/system/cpu/intel_uncore_frequency"
+
+/* an uncore frequency domain, i.e., a die of a package. lock is held while
+ * the cached values are compared and written, since all cpus of the die
+ * share them */
+struct uncore_domain{
+  int package;
+  int die;
+  volatile int lock;
+  struct sysfs_file min;
+  struct sysfs_file max;
+};
+
+static struct uncore_domain * domains = NULL;
+static int nr_domains = 0;
+/* uncore domain of every cpu, -1 if there is none */
+static int * cpu_domain = NULL;
+static int nr_cpus = 0;
+
+int uncore_init(void)
+{
+  char path[512];
+  struct dirent **namelist;
+  int nr_entries, entry, cpu, domain, ret;
+
+  ret = topology_init();
+  if (ret)
+    return ret;
+
+  if (sysfs_path(path, sizeof(path), UNCORE_PATH))
+    return ENAMETOOLONG;
+  nr_entries = scandir(path, &namelist, NULL, alphasort);
+  if (nr_entries < 0)
+    return ENODEV;
+
+  domains = calloc(nr_entries, sizeof(struct uncore_domain));
+  if (domains == NULL)
+  {
+    for (entry = 0; entry < nr_entries; entry++)
+      free(namelist[entry]);
+    free(namelist);
+    return ENOMEM;
+  }
+
+  for (entry = 0; entry < nr_entries; entry++)
+  {
+    int package, die;
+    /* newer kernels also provide uncore<nr> directories, which are not
+     * bound to a package and die */
+    if (sscanf(namelist[entry]->d_name, "package_%d_die_%d", &package, &die) == 2)
+    {
+      struct uncore_domain * current = &domains[nr_domains];
+      current->package = package;
+      current->die = die;
+      current->max.fd = -1;
+      ret = sysfs_file_open(&current->min, UNCORE_PATH "/%s/min_freq_khz", namelist[entry]->d_name);
+      if (ret == 0)
+        ret = sysfs_file_open(&current->max, UNCORE_PATH "/%s/max_freq_khz", namelist[entry]->d_name);
+      if (ret)
+      {
+        sysfs_file_close(&current->min);
+        sysfs_file_close(&current->max);
+      }
+      else
+        nr_domains++;
+    }
+    free(namelist[entry]);
+  }
+  free(namelist);
+
+  if (nr_domains == 0)
+  {
+    free(domains);
+    domains = NULL;
+    return ret ? ret : ENODEV;
+  }
+
+  /* map cpus to domains, so there is no search when a region is entered */
+  nr_cpus = topology_nr_cpus();
+  cpu_domain = calloc(nr_cpus, sizeof(int));
+  if (cpu_domain == NULL)
+    return ENOMEM;
+  for (cpu = 0; cpu < nr_cpus; cpu++)
+  {
+    cpu_domain[cpu] = -1;
+    for (domain = 0; domain < nr_domains; domain++)
+      if (domains[domain].package == topology_package(cpu) &&
+          domains[domain].die == topology_die(cpu))
+        cpu_domain[cpu] = domain;
+  }
+  return 0;
+}
+
+int uncore_read_from_config(void * vp,struct config_t * cfg, char * buffer, char * prefix)
+{
+  int was_set = 0;
+  config_setting_t *setting;
+  struct uncore_information * info = vp;
+  int32_t * values[4] = { &info->min_before, &info->max_before, &info->min_after, &info->max_after };
+  const char * names[4] = { "min_before", "max_before", "min_after", "max_after" };
+  int i;
+
+  for (i = 0; i < 4; i++)
+  {
+    *values[i] = 0;
+    sprintf(buffer, "%s.%s_%s", prefix, UNCORE_CONFIG_STRING, names[i]);
+    setting = config_lookup(cfg, buffer);
+    if (setting) {
+      *values[i] = config_setting_get_int(setting);
+#ifdef VERBOSE
+      fprintf(stderr,"%s = %" PRId32 "\n",buffer,*values[i]);
+#endif
+      was_set = 1;
+    }
+  }
+  return was_set;
+}
+
+static int write_khz(struct sysfs_file * file, int32_t khz)
+{
+  char value[16];
+  int len = snprintf(value, sizeof(value), "%" PRId32, khz);
+  return sysfs_file_write(file, value, len);
+}
+
+/* set the limits of a domain, 0 keeps the current limit unless it would
+ * conflict with the other one. The order of writes keeps min <= max at any
+ * time */
+static int set_uncore(int32_t min, int32_t max, int32_t cpu)
+{
+  struct uncore_domain * domain;
+  long current_min, current_max;
+  int ok = 0;
+  if (min == 0 && max == 0)
+    return 0;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  if (cpu < 0 || cpu >= nr_cpus || cpu_domain[cpu] < 0)
+    return EINVAL;
+  domain = &domains[cpu_domain[cpu]];
+  while (__sync_lock_test_and_set(&domain->lock, 1))
+    ;
+  current_min = strtol(domain->min.value, NULL, 10);
+  current_max = strtol(domain->max.value, NULL, 10);
+  if (max == 0 && min > current_max)
+    max = min;
+  if (min == 0 && max < current_min)
+    min = max;
+
+#ifdef VERBOSE
+  fprintf(stderr,"changing uncore frequency of package %d die %d to %" PRId32 "-%" PRId32 "\n",
+      domain->package, domain->die, min, max);
+#endif
+  if (min > current_max)
+  {
+    if (max > 0)
+      ok |= write_khz(&domain->max, max);
+    ok |= write_khz(&domain->min, min);
+  }
+  else
+  {
+    if (min > 0)
+      ok |= write_khz(&domain->min, min);
+    if (max > 0)
+      ok |= write_khz(&domain->max, max);
+  }
+  __sync_lock_release(&domain->lock);
+#ifdef VERBOSE
+  if (ok)
+    fprintf(stderr,"Setting uncore frequency failed %i!\n",ok);
+#endif
+  return ok;
+}
+
+int uncore_process_before(void * vp, int32_t cpu)
+{
+  struct uncore_information * info = vp;
+  return set_uncore(info->min_before, info->max_before, cpu);
+}
+
+int uncore_process_after(void * vp, int32_t cpu)
+{
+  struct uncore_information * info = vp;
+  return set_uncore(info->min_after, info->max_after, cpu);
+}
+
+int uncore_fini(void)
+{
+  /* reset original limits and close files, same order as above */
+  int domain;
+  int error = 0;
+  for (domain = 0; domain < nr_domains; domain++)
+  {
+    struct uncore_domain * current = &domains[domain];
+    if (strtol(current->min.original, NULL, 10) > strtol(current->max.value, NULL, 10))
+    {
+      error |= sysfs_file_restore(&current->max);
+      error |= sysfs_file_restore(&current->min);
+    }
+    else
+    {
+      error |= sysfs_file_restore(&current->min);
+      error |= sysfs_file_restore(&current->max);
+    }
+    sysfs_file_close(&current->min);
+    sysfs_file_close(&current->max);
+  }
+  free(domains);
+  domains = NULL;
+  nr_domains = 0;
+  free(cpu_domain);
+  cpu_domain = NULL;
+  return error;
+}
@@ -0,0 +1,45 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#ifndef UNCORE_H_
+#define UNCORE_H_
+
+#include <stdint.h>
+#include <libconfig.h>
+
+#define UNCORE_CONFIG_STRING "uncore"
+
+/* frequencies in kHz, 0 if not set */
+struct uncore_information{
+  int32_t min_before;
+  int32_t max_before;
+  int32_t min_after;
+  int32_t max_after;
+};
+
+int uncore_init(void);
+
+int uncore_read_from_config(void * info,struct config_t * cfg, char * buffer, char * prefix);
+
+int uncore_process_before(void * info, int32_t cpu);
+int uncore_process_after(void * info, int32_t cpu);
+
+int uncore_fini(void);
+
+#endif /* UNCORE_H_ */
@@ -37,13 +37,21 @@
 #include <sys/sysinfo.h>
 
 #include "x86_adapt_items.h"
+#include "topology.h"
 
 extern int sched_getcpu(void);
 
-static int * cpu_fds;
-static int * die_fds;
-
-static int set=0;
+/* devices are opened when the first setting is read */
+static int devices_opened = 0;
+static int nr_devices[X86_ADAPT_MAX];
+static int * fds[X86_ADAPT_MAX];
+/* the die device of every cpu, -1 if unknown */
+static int * cpu_to_die;
+static int nr_cpu_to_die = 0;
+/* the last value written per device and configuration item */
+static int nr_cis[X86_ADAPT_MAX];
+static uint64_t * values[X86_ADAPT_MAX];
+static uint8_t * values_valid[X86_ADAPT_MAX];
 
 static void init_info(struct pref_setting_ids * settings, x86_adapt_device_type type, int ci_nr, int64_t setting){
   settings->id=ci_nr;
@@ -51,6 +59,71 @@ static void init_info(struct pref_setting_ids * settings, x86_adapt_device_type
   settings->type=type;
 }
 
+/*
+ * Die devices are numbered like the (package, die) groups of the topology,
+ * ordered by their first cpu. If the numbers do not match, packages are used.
+ */
+static void map_cpus_to_dies(void)
+{
+  int level, cpu, nr, next;
+  nr_cpu_to_die = topology_nr_cpus();
+  cpu_to_die = malloc(nr_cpu_to_die * sizeof(int));
+  if (cpu_to_die == NULL)
+  {
+    nr_cpu_to_die = 0;
+    return;
+  }
+  for (level = TOPOLOGY_LEVEL_DIE; level <= TOPOLOGY_LEVEL_PACKAGE; level++)
+  {
+    next = 0;
+    for (cpu = 0; cpu < nr_cpu_to_die; cpu++)
+    {
+      const int * group = topology_cpus(level, cpu, &nr);
+      cpu_to_die[cpu] = -1;
+      if (group == NULL || nr == 0)
+        continue;
+      if (group[0] == cpu)
+        cpu_to_die[cpu] = next++;
+      else if (group[0] < cpu)
+        cpu_to_die[cpu] = cpu_to_die[group[0]];
+    }
+    if (next == nr_devices[X86_ADAPT_DIE])
+      return;
+  }
+  fprintf(stderr, "x86_adapt: %d die devices do not match the topology, die settings are only applied via _all\n", nr_devices[X86_ADAPT_DIE]);
+  for (cpu = 0; cpu < nr_cpu_to_die; cpu++)
+    cpu_to_die[cpu] = -1;
+}
+
+static void open_devices(void)
+{
+  x86_adapt_device_type type;
+  int i;
+  if (devices_opened)
+    return;
+  devices_opened = 1;
+  for (type = 0; type < X86_ADAPT_MAX; type++)
+  {
+    nr_devices[type] = x86_adapt_get_nr_avaible_devices(type);
+    nr_cis[type] = x86_adapt_get_number_cis(type);
+    if (nr_devices[type] <= 0)
+    {
+      nr_devices[type] = 0;
+      continue;
+    }
+    fds[type] = calloc(nr_devices[type], sizeof(int));
+    values[type] = calloc((size_t) nr_devices[type] * nr_cis[type], sizeof(uint64_t));
+    values_valid[type] = calloc((size_t) nr_devices[type] * nr_cis[type], sizeof(uint8_t));
+    if (fds[type] == NULL || values[type] == NULL || values_valid[type] == NULL)
+    {
+      nr_devices[type] = 0;
+      continue;
+    }
+    for (i = 0; i < nr_devices[type]; i++)
+      fds[type][i] = x86_adapt_get_device(type, i);
+  }
+  map_cpus_to_dies();
+}
 
 int x86_adapt_read_from_config(void * vp,struct config_t * cfg, char * buffer,
                                char * prefix)
@@ -58,8 +131,8 @@ int x86_adapt_read_from_config(void * vp,struct config_t * cfg, char * buffer,
   config_setting_t *setting;
   struct x86_adapt_configuration_item  ci;
   x86_adapt_device_type type;
-  int i;
   int ci_nr;
+  int set = 0;
   struct x86_adapt_pref_information * info = vp;
   memset(info,0,sizeof(struct x86_adapt_pref_information));
 
@@ -129,111 +202,105 @@ int x86_adapt_read_from_config(void * vp,struct config_t * cfg, char * buffer,
     }
   }
   if (set)
+    open_devices();
+  return set;
+}
+
+/* write a setting to a device, unless it has been written before */
+static int write_setting(x86_adapt_device_type type, int device, struct pref_setting_ids * setting)
+{
+  size_t index;
+  int ret;
+  if (device < 0 || device >= nr_devices[type] || fds[type][device] <= 0)
+    return 1;
+  index = (size_t) device * nr_cis[type] + setting->id;
+  if (values_valid[type][index] && values[type][index] == setting->setting)
+    return 0;
+  ret = x86_adapt_set_setting(fds[type][device], setting->id, setting->setting);
+  if (ret < 0)
   {
-    cpu_fds=(int*)calloc(x86_adapt_get_nr_avaible_devices(X86_ADAPT_CPU),sizeof(int));
-    for (i=0;i<x86_adapt_get_nr_avaible_devices(X86_ADAPT_CPU);i++)
-    {
-      cpu_fds[i]=x86_adapt_get_device(X86_ADAPT_CPU,i);
-    }
-    die_fds=(int*)calloc(x86_adapt_get_nr_avaible_devices(X86_ADAPT_DIE),sizeof(int));
-		for (i=0;i<x86_adapt_get_nr_avaible_devices(X86_ADAPT_DIE);i++)
-    {
-      die_fds[i]=x86_adapt_get_device(X86_ADAPT_DIE,i);
-    }
+    /* written again next time */
+    values_valid[type][index] = 0;
+    return 1;
   }
-  return set;
+  values[type][index] = setting->setting;
+  values_valid[type][index] = 1;
+  return 0;
 }
 
-int x86_adapt_process_before(void * vp, int32_t cpu)
+static int process(struct pref_setting_ids * settings, int nr_settings,
+                   struct pref_setting_ids * settings_all, int nr_settings_all, int32_t cpu)
 {
-  int i;
-  struct x86_adapt_pref_information * info = vp;
+  int i, device;
+  int ok = 0;
 
   if (cpu<0)
     cpu=sched_getcpu();
 
-  for (i=0;i<info->nr_settings_before;i++)
+  /* settings for the device of the current cpu */
+  for (i=0;i<nr_settings;i++)
   {
-    switch (info->settings_before[i].type)
+    switch (settings[i].type)
     {
       case X86_ADAPT_CPU:
-        if ( cpu_fds[cpu] > 0 )
-        {
-          x86_adapt_set_setting(cpu_fds[cpu],info->settings_before[i].id,info->settings_before[i].setting);
-          return 0;
-        }
-        return 1;
-      case X86_ADAPT_DIE: /* fall-through */
+        ok |= write_setting(X86_ADAPT_CPU, cpu, &settings[i]);
+        break;
+      case X86_ADAPT_DIE:
+        device = cpu < nr_cpu_to_die ? cpu_to_die[cpu] : -1;
+        ok |= write_setting(X86_ADAPT_DIE, device, &settings[i]);
+        break;
       default:
-        return 1;
+        ok |= 1;
     }
   }
 
-  for (i=0;i<info->nr_settings_before_all;i++)
+  /* settings for all devices */
+  for (i=0;i<nr_settings_all;i++)
   {
-    int nr_devices=x86_adapt_get_nr_avaible_devices(info->settings_before_all[i].type);
-    int * fds=NULL;
-    switch (info->settings_before_all[i].type)
-    {
-      case X86_ADAPT_CPU: fds=cpu_fds; break;
-      case X86_ADAPT_DIE: fds=die_fds; break;
-      default:
-        return 1;
-    }
-    for (cpu=0;cpu<nr_devices;cpu++)
+    if (settings_all[i].type >= X86_ADAPT_MAX)
     {
-      if ( fds[cpu] > 0 )
-        x86_adapt_set_setting(fds[cpu],info->settings_before_all[i].id,info->settings_before_all[i].setting);
+      ok |= 1;
+      continue;
     }
+    for (device=0;device<nr_devices[settings_all[i].type];device++)
+      ok |= write_setting(settings_all[i].type, device, &settings_all[i]);
   }
-  return 0;
+  return ok;
 }
 
-int x86_adapt_process_after(void * vp, int32_t cpu)
+int x86_adapt_process_before(void * vp, int32_t cpu)
 {
-  int i;
   struct x86_adapt_pref_information * info = vp;
+  return process(info->settings_before, info->nr_settings_before,
+                 info->settings_before_all, info->nr_settings_before_all, cpu);
+}
 
-  if (cpu<0)
-    cpu=sched_getcpu();
-
-  for (i=0;i<info->nr_settings_after;i++)
-  {
-    switch (info->settings_after[i].type)
-    {
-      case X86_ADAPT_CPU:
-        if (cpu_fds[cpu] > 0)
-        {
-          x86_adapt_set_setting(cpu_fds[cpu],info->settings_after[i].id,info->settings_after[i].setting);
-          return 0;
-        }
-        return 1;
-      case X86_ADAPT_DIE: /* fall-through, no match from cpu to die */
-      default:
-        return 1;
-    }
-  }
+int x86_adapt_process_after(void * vp, int32_t cpu)
+{
+  struct x86_adapt_pref_information * info = vp;
+  return process(info->settings_after, info->nr_settings_after,
+                 info->settings_after_all, info->nr_settings_after_all, cpu);
+}
 
-  for (i=0;i<info->nr_settings_after_all;i++)
+int x86_adapt_reset(){
+  x86_adapt_device_type type;
+  int i;
+  for (type = 0; type < X86_ADAPT_MAX; type++)
   {
-    int nr_devices=x86_adapt_get_nr_avaible_devices(info->settings_after_all[i].type);
-    int * fds=NULL;
-    switch (info->settings_after_all[i].type)
-    {
-      case X86_ADAPT_CPU: fds=cpu_fds; break;
-      case X86_ADAPT_DIE: fds=die_fds; break;
-      default:
-        return 1;
-    }
-    for (cpu=0;cpu<nr_devices;cpu++)
-    {
-      if (fds[cpu] > 0)
-        x86_adapt_set_setting(fds[cpu],info->settings_after_all[i].id,info->settings_after_all[i].setting);
-    }
+    for (i = 0; i < nr_devices[type]; i++)
+      if (fds[type][i] > 0)
+        x86_adapt_put_device(type, i);
+    free(fds[type]);
+    free(values[type]);
+    free(values_valid[type]);
+    fds[type] = NULL;
+    values[type] = NULL;
+    values_valid[type] = NULL;
+    nr_devices[type] = 0;
   }
+  free(cpu_to_die);
+  cpu_to_die = NULL;
+  nr_cpu_to_die = 0;
+  devices_opened = 0;
   return 0;
 }
-
-int x86_adapt_reset(){
-   return 0;
-}
@@ -17,6 +17,7 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.*
  ***********************************************************************/
 
+#include <errno.h>
 #include <libconfig.h>
 #include <stdio.h>
 #include <pthread.h>
@@ -28,6 +29,9 @@
 #include "adapt.h"
 #include "adapt_internal.h"
 #include "binary_handling.h"
+#include "msr.h"
+#include "sysfs_file.h"
+#include "topology.h"
 
 
 /* Check if the given value is zero or not and return the
@@ -62,6 +66,23 @@ static int supress_max_thread_count_error = 0;
  */
 static size_t * knob_offsets = NULL;
 
+/**
+ * this is the offset of the scopes of all knob types within the infos
+ */
+static size_t scope_offset = 0;
+
+/* names of the scopes in the config file, see enum adapt_scope */
+static const char * scope_names[ADAPT_SCOPE_MAX] =
+{
+  "cpu", "core", "die", "package", "affinity", "all"
+};
+
+/* topology levels of the scopes that are resolved via topology_cpus */
+static const int scope_levels[ADAPT_SCOPE_MAX] =
+{
+  -1, TOPOLOGY_LEVEL_CORE, TOPOLOGY_LEVEL_DIE, TOPOLOGY_LEVEL_PACKAGE, -1, TOPOLOGY_LEVEL_ALL
+};
+
 /**
  * These are the function stack sizes for different number of threads
  * They only support one binary. I think thats ok.
@@ -94,6 +115,91 @@ static uint32_t max_function_stack = 256;
 static FILE * error_stream;
 
 
+/* apply the settings of a knob to all cpus of its scope, relative to cpu */
+static int knob_process(int knob, char * settings, int exit, int32_t cpu)
+{
+  int (*process)(void *, int32_t) = exit ? knobs[knob].process_after : knobs[knob].process_before;
+  void * info = &settings[knob_offsets[knob]];
+  uint8_t scope = ((uint8_t *) &settings[scope_offset])[knob];
+  const int * cpus;
+  int nr_cpus, i;
+  int ok = 0;
+
+  if (process == NULL)
+    return 0;
+  if (scope == ADAPT_SCOPE_CPU)
+    return process(info, cpu);
+  if (scope == ADAPT_SCOPE_AFFINITY)
+  {
+    cpu_set_t mask;
+    int nr_found = 0;
+    if (sched_getaffinity(0, sizeof(mask), &mask))
+      return errno;
+    nr_cpus = CPU_COUNT(&mask);
+    for (i = 0; i < CPU_SETSIZE && nr_found < nr_cpus; i++)
+      if (CPU_ISSET(i, &mask))
+      {
+        ok |= process(info, i);
+        nr_found++;
+      }
+    return ok;
+  }
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  cpus = topology_cpus(scope_levels[scope], cpu, &nr_cpus);
+  /* no topology information, fall back to the cpu */
+  if (nr_cpus == 0)
+    return process(info, cpu);
+  for (i = 0; i < nr_cpus; i++)
+    ok |= process(info, cpus[i]);
+  return ok;
+}
+
+/* read the scopes of all knob types for a region from the config file,
+ * "<prefix>.scope" for all knob types and "<prefix>.<knob>_scope" for a
+ * single one */
+static void read_scopes(char * settings, char * buffer, char * prefix)
+{
+  uint8_t * scopes = (uint8_t *) &settings[scope_offset];
+  config_setting_t *setting;
+  int knob_index, scope;
+  const char * name;
+  int region_scope = ADAPT_SCOPE_CPU;
+
+  for (knob_index = -1; knob_index < ADAPT_MAX; knob_index++)
+  {
+    if (knob_index == -1)
+      sprintf(buffer, "%s.scope", prefix);
+    else if (knobs[knob_index].config_string != NULL)
+      sprintf(buffer, "%s.%s_scope", prefix, knobs[knob_index].config_string);
+    else
+      continue;
+    if (knob_index >= 0)
+      scopes[knob_index] = region_scope;
+    setting = config_lookup(&cfg, buffer);
+    if (setting == NULL)
+      continue;
+    name = config_setting_get_string(setting);
+    for (scope = 0; scope < ADAPT_SCOPE_MAX; scope++)
+      if (name != NULL && strcmp(name, scope_names[scope]) == 0)
+        break;
+    if (name != NULL && strcmp(name, "smt") == 0)
+      scope = ADAPT_SCOPE_CORE;
+    if (scope == ADAPT_SCOPE_MAX)
+    {
+      fprintf(error_stream, "Unknown %s, use cpu, core, smt, die, package, affinity, or all\n", buffer);
+      continue;
+    }
+#ifdef VERBOSE
+    fprintf(error_stream, "%s = %s\n", buffer, name);
+#endif
+    if (knob_index == -1)
+      region_scope = scope;
+    else
+      scopes[knob_index] = scope;
+  }
+}
+
 /* loop through all the knobs and apply the settings in settings for
  * before or atfer at cpu depend on exit and save the result for
  * RETURN_ADAPT_STATUS() in ok
@@ -116,7 +222,7 @@ static int knobs_loop(char * settings, int exit, int32_t cpu )
     {
       if (knobs[i].process_before)
       {
-        ok |=knobs[i].process_before(&(settings[knob_offsets[i]]),cpu);
+        ok |= knob_process(i, settings, exit, cpu);
 #ifdef VERBOSE
         fprintf(error_stream, "Knob: %d \t Status(Bitwise inclusive): %d\n", i, ok);
 #endif
@@ -126,7 +232,7 @@ static int knobs_loop(char * settings, int exit, int32_t cpu )
     {
       if (knobs[i].process_after)
       {
-        ok |= knobs[i].process_after(&(settings[knob_offsets[i]]),cpu);
+        ok |= knob_process(i, settings, exit, cpu);
 #ifdef VERBOSE
         fprintf(error_stream, "Knob: %d \t Status(Bitwise inclusive): %d\n", i, ok);
 #endif
@@ -186,6 +292,15 @@ int adapt_open()
   if (setting)
     error_stream = fopen(config_setting_get_string(setting),"w+");
 
+  /* prefix for sysfs files, e.g., to test against a fake tree */
+  setting = config_lookup(&cfg, "sysfs_root");
+  if (setting)
+    if (sysfs_set_root(config_setting_get_string(setting)))
+    {
+      fprintf(error_stream, "sysfs_root is too long\n");
+      return 1;
+    }
+
   if (function_stacks != NULL)
   {
     fprintf(error_stream, "libadapt already initialized\n");
@@ -211,12 +326,19 @@ int adapt_open()
     knob_offsets[knob_index]=current_offset;
     current_offset+=knobs[knob_index].information_size;
   }
+  scope_offset=current_offset;
+
+  /* used to resolve the scopes of settings, without topology information
+   * settings are only applied to the current cpu */
+  if (topology_init())
+    fprintf(error_stream, "Reading the cpu topology failed\n");
 
   /* initialize */
   for (knob_index = 0; knob_index < ADAPT_MAX; knob_index++ )
   {
-    if (knobs[knob_index].init != NULL)
-      if (knobs[knob_index].init())
+    if ((knobs[knob_index].read_global_config != NULL &&
+         knobs[knob_index].read_global_config(&cfg,buffer)) ||
+        (knobs[knob_index].init != NULL && knobs[knob_index].init()))
       {
         fprintf(error_stream, "Error initializing knob category \"%s\"\n",knobs[knob_index].name);
         knobs[knob_index].read_from_config = NULL;
@@ -226,6 +348,8 @@ int adapt_open()
       }
   }
   /* get inits and defaults and apply inits */
+  read_scopes(default_infos, buffer, prefix_default);
+  read_scopes(init_infos, buffer, prefix_init);
   for (knob_index = 0; knob_index < ADAPT_MAX; knob_index++ )
   {
     set_init = 0;
@@ -239,7 +363,7 @@ int adapt_open()
       {
         if (knobs[knob_index].process_before)
           /* apply setting for initialize for the current cpu */
-          ok |= knobs[knob_index].process_before(&(init_infos[knob_offsets[knob_index]]),sched_getcpu());
+          ok |= knob_process(knob_index, init_infos, 0, sched_getcpu());
       }
 
 #ifdef VERBOSE
@@ -317,6 +441,7 @@ uint64_t adapt_add_binary(char * binary_name)
 
   /* get defaults from the config */
   sprintf(prefix, "binary_%d", binary_id_in_cfg_file);
+  read_scopes(bid_struct->default_infos, buffer, prefix);
   for (knob_index = 0; knob_index < ADAPT_MAX; knob_index++ )
   {
     if (knobs[knob_index].read_from_config)
@@ -354,6 +479,7 @@ uint64_t adapt_add_binary(char * binary_name)
       fprintf(error_stream,"Function definition:%s/%s %s %" PRIu32 " %" PRIu32 " %" PRIu64 "\n",binary_name_in_cfg,binary_name,function_name_in_cfg,binary_id_in_cfg_file, function_id_in_cfg_file,crid);
 #endif
 
+      read_scopes(tmp_crid_to_config_struct.infos, buffer, prefix);
       for (knob_index = 0; knob_index < ADAPT_MAX; knob_index++ )
       {
         if ( knobs[knob_index].read_from_config )
@@ -389,6 +515,11 @@ int adapt_def_region(uint64_t binary_id, const char* rname, uint32_t rid)
       return 1;
   }
 
+#ifndef NO_DCT
+  /* tuning also covers regions without a definition */
+  dct_tune_def_region(binary_id, rid, get_id(rname));
+#endif
+
   if (!is_binary_id_used(binary_id))
   {
 #ifdef VERBOSE
@@ -455,6 +586,12 @@ static int adapt_enter_or_exit(uint64_t binary_id, uint32_t tid, uint32_t rid,in
     return ADAPT_ERROR_WHILE_ADAPT;
   }
 
+#ifndef NO_DCT
+  /* the region that is tuned when entered */
+  if (!exit)
+    dct_tune_set_region(binary_id, rid);
+#endif
+
   /* binary not used -> use defaults */
   if ( !is_binary_id_used(binary_id) )
   {
@@ -584,6 +721,15 @@ int adapt_exit(uint64_t binary_id, uint32_t tid, int32_t cpu)
     return adapt_enter_or_exit(binary_id, tid, 0, cpu, 1, 1);
 }
 
+int adapt_register_range(const char * name, void * address, size_t length)
+{
+#ifndef NO_MADVISE
+  return madvise_register_range(name, address, length);
+#else
+  return ENOSYS;
+#endif
+}
+
 void adapt_close()
 {
   int knob_index;
@@ -639,5 +785,8 @@ void adapt_close()
     if (knobs[knob_index].fini)
       knobs[knob_index].fini();
   }
+  /* after the knobs restored their registers */
+  msr_cached_close();
+  topology_fini();
 }
 
@@ -0,0 +1,209 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "msr.h"
+#include "sysfs_file.h"
+#include "topology.h"
+
+int msr_open(int cpu)
+{
+  char path[512];
+  int ret = sysfs_path(path, sizeof(path), "/dev/cpu/%d/msr", cpu);
+  if (ret)
+  {
+    errno = ret;
+    return -1;
+  }
+  return open(path, O_RDWR);
+}
+
+int msr_read(int fd, uint32_t reg, uint64_t * value)
+{
+  ssize_t ret = pread(fd, value, sizeof(*value), reg);
+  if (ret != sizeof(*value))
+    return ret < 0 ? errno : EIO;
+  return 0;
+}
+
+int msr_write(int fd, uint32_t reg, uint64_t value)
+{
+  ssize_t ret = pwrite(fd, &value, sizeof(value), reg);
+  if (ret != sizeof(value))
+    return ret < 0 ? errno : EIO;
+  return 0;
+}
+
+/* registers that have been changed via msr_cached_update */
+struct cached_register {
+  uint32_t reg;
+  uint64_t value;
+  uint64_t original;
+};
+
+struct cached_cpu {
+  /* -2 if not opened yet */
+  int fd;
+  volatile int lock;
+  struct cached_register * registers;
+  int nr_registers;
+};
+
+static struct cached_cpu * cached_cpus = NULL;
+static int nr_cached_cpus = 0;
+static volatile int cached_cpus_lock = 0;
+
+static struct cached_cpu * get_cached_cpu(int cpu)
+{
+  if (cached_cpus == NULL)
+  {
+    while (__sync_lock_test_and_set(&cached_cpus_lock, 1))
+      ;
+    if (cached_cpus == NULL)
+    {
+      /* the possible cpus, which may be those of a fake tree */
+      long nr = topology_init() == 0 ? topology_nr_cpus() : sysconf(_SC_NPROCESSORS_CONF);
+      struct cached_cpu * cpus = calloc(nr, sizeof(struct cached_cpu));
+      int i;
+      if (cpus != NULL)
+      {
+        for (i = 0; i < nr; i++)
+          cpus[i].fd = -2;
+        nr_cached_cpus = nr;
+        __sync_synchronize();
+        cached_cpus = cpus;
+      }
+    }
+    __sync_lock_release(&cached_cpus_lock);
+  }
+  if (cached_cpus == NULL || cpu < 0 || cpu >= nr_cached_cpus)
+    return NULL;
+  return &cached_cpus[cpu];
+}
+
+static struct cached_register * get_register(struct cached_cpu * current, uint32_t reg, int * error)
+{
+  struct cached_register * registers;
+  int i;
+  for (i = 0; i < current->nr_registers; i++)
+    if (current->registers[i].reg == reg)
+      return &current->registers[i];
+  registers = realloc(current->registers, (current->nr_registers + 1) * sizeof(struct cached_register));
+  if (registers == NULL)
+  {
+    *error = ENOMEM;
+    return NULL;
+  }
+  current->registers = registers;
+  /* read once, later values are computed from the cache */
+  *error = msr_read(current->fd, reg, &registers[current->nr_registers].original);
+  if (*error)
+    return NULL;
+  registers[current->nr_registers].reg = reg;
+  registers[current->nr_registers].value = registers[current->nr_registers].original;
+  return &registers[current->nr_registers++];
+}
+
+int msr_cached_update(int cpu, int nr, const struct msr_update * updates)
+{
+  struct cached_cpu * current = get_cached_cpu(cpu);
+  int i, error = 0;
+
+  if (current == NULL)
+    return EINVAL;
+  while (__sync_lock_test_and_set(&current->lock, 1))
+    ;
+  if (current->fd == -2)
+    current->fd = msr_open(cpu);
+  if (current->fd < 0)
+  {
+    __sync_lock_release(&current->lock);
+    return ENODEV;
+  }
+  for (i = 0; i < nr; i++)
+  {
+    int ret = 0;
+    struct cached_register * cached = get_register(current, updates[i].reg, &ret);
+    uint64_t value;
+    if (cached == NULL)
+    {
+      error |= ret;
+      continue;
+    }
+    value = (cached->value & ~updates[i].mask) | (updates[i].value & updates[i].mask);
+    if (value == cached->value)
+      continue;
+    ret = msr_write(current->fd, updates[i].reg, value);
+    if (ret)
+      error |= ret;
+    else
+      cached->value = value;
+  }
+  __sync_lock_release(&current->lock);
+  return error;
+}
+
+int msr_cached_restore(uint32_t reg)
+{
+  int cpu, i, error = 0;
+  for (cpu = 0; cpu < nr_cached_cpus; cpu++)
+  {
+    struct cached_cpu * current = &cached_cpus[cpu];
+    while (__sync_lock_test_and_set(&current->lock, 1))
+      ;
+    for (i = 0; i < current->nr_registers; i++)
+      if (current->registers[i].reg == reg && current->registers[i].value != current->registers[i].original)
+      {
+        int ret = msr_write(current->fd, reg, current->registers[i].original);
+        if (ret)
+          error |= ret;
+        else
+          current->registers[i].value = current->registers[i].original;
+      }
+    __sync_lock_release(&current->lock);
+  }
+  return error;
+}
+
+void msr_cached_close(void)
+{
+  int cpu;
+  for (cpu = 0; cpu < nr_cached_cpus; cpu++)
+  {
+    struct cached_cpu * current = &cached_cpus[cpu];
+    while (__sync_lock_test_and_set(&current->lock, 1))
+      ;
+    if (current->fd >= 0)
+      close(current->fd);
+    /* reopened and reread if used again */
+    current->fd = -2;
+    free(current->registers);
+    current->registers = NULL;
+    current->nr_registers = 0;
+    __sync_lock_release(&current->lock);
+  }
+  /* reallocated if used again, e.g., with another sysfs_root */
+  free(cached_cpus);
+  cached_cpus = NULL;
+  nr_cached_cpus = 0;
+}
@@ -0,0 +1,321 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <omp-tools.h>
+
+#include "adapt.h"
+#ifndef NO_CPUFREQ
+#include "../knobs/dvfs.h"
+#endif
+
+/*
+ * OpenMP Tool Interface (OMPT) frontend
+ *
+ * The OpenMP runtime calls ompt_start_tool when it is initialized. If the
+ * environment variable ADAPT_OMPT is set to 1, libadapt registers for
+ * parallel regions and adapts them like functions. A parallel region is
+ * named after the function that contains it.
+ * */
+
+/* number of cached parallel regions, has to be a power of 2 */
+#define OMPT_REGION_CACHE_SIZE 4096
+
+/* a parallel region, identified by the return address of the runtime call.
+ * rid is written before codeptr_ra, so lookups do not need the lock */
+struct ompt_region {
+  const void * volatile codeptr_ra;
+  uint32_t rid;
+};
+
+static struct ompt_region regions[OMPT_REGION_CACHE_SIZE];
+static uint32_t nr_regions = 0;
+/* serializes the insertion of regions */
+static volatile int regions_lock = 0;
+
+static uint64_t ompt_binary_id;
+/* 0 before adapt_open, 1 afterwards, -1 if it failed */
+static int ompt_adapt_state = 0;
+static pthread_once_t ompt_adapt_once = PTHREAD_ONCE_INIT;
+
+/* threads get the lowest free id when they enter libadapt, which is freed
+ * again when the thread ends, so the ids stay below the number of threads
+ * that exist at the same time (see max_threads) */
+static char * tids_used = NULL;
+static uint32_t nr_tids = 0;
+static volatile int tids_lock = 0;
+/* id + 1 of the calling thread, 0 if it has none */
+static __thread uint32_t current_tid = 0;
+
+static uint32_t tid_alloc(void)
+{
+  uint32_t tid;
+  while (__sync_lock_test_and_set(&tids_lock, 1))
+    ;
+  for (tid = 0; tid < nr_tids; tid++)
+    if (!tids_used[tid])
+      break;
+  if (tid == nr_tids)
+  {
+    uint32_t nr = nr_tids ? 2 * nr_tids : 64;
+    char * tmp = realloc(tids_used, nr);
+    if (tmp != NULL)
+    {
+      memset(tmp + nr_tids, 0, nr - nr_tids);
+      tids_used = tmp;
+      nr_tids = nr;
+    }
+  }
+  /* without memory, the id is shared with other threads */
+  if (tid < nr_tids)
+    tids_used[tid] = 1;
+  __sync_lock_release(&tids_lock);
+  return tid;
+}
+
+static void tid_free(uint32_t tid)
+{
+  while (__sync_lock_test_and_set(&tids_lock, 1))
+    ;
+  if (tid < nr_tids)
+    tids_used[tid] = 0;
+  __sync_lock_release(&tids_lock);
+}
+
+static inline uint32_t get_tid(void)
+{
+  if (current_tid == 0)
+    current_tid = tid_alloc() + 1;
+  return current_tid - 1;
+}
+
+/* name a region after the symbol that contains codeptr_ra. Symbols of the
+ * executable are only found if it exports them (-rdynamic), otherwise the
+ * name is the offset within the binary, e.g., "0x119b" */
+static void region_name(const void * codeptr_ra, char * buffer, size_t size)
+{
+  Dl_info info;
+  if (!dladdr(codeptr_ra, &info))
+    snprintf(buffer, size, "%p", codeptr_ra);
+  else if (info.dli_sname != NULL)
+    snprintf(buffer, size, "%s", info.dli_sname);
+  else
+    snprintf(buffer, size, "0x%lx", (unsigned long) ((uintptr_t) codeptr_ra - (uintptr_t) info.dli_fbase));
+}
+
+/* adapt_open is called with the first parallel region, since knobs use the
+ * OpenMP runtime, which can not be called while it initializes the tool */
+static void ompt_adapt_open(void)
+{
+  char binary_name[1024];
+  ssize_t length;
+  int ret;
+
+  ompt_adapt_state = -1;
+  length = readlink("/proc/self/exe", binary_name, sizeof(binary_name) - 1);
+  if (length < 0) {
+    fprintf(stderr, "Could not read /proc/self/exe\n");
+    return;
+  }
+  binary_name[length] = '\0';
+
+  ret = adapt_open();
+  if (ret != ADAPT_OK && ret != ADAPT_ERROR_WHILE_ADAPT)
+    return;
+  ompt_binary_id = adapt_add_binary(binary_name);
+  ompt_adapt_state = 1;
+}
+
+/* find the entry of codeptr_ra or the free entry where it belongs, NULL if
+ * the cache is full */
+static struct ompt_region * find_region(const void * codeptr_ra)
+{
+  uint32_t index = ((uintptr_t) codeptr_ra >> 2) & (OMPT_REGION_CACHE_SIZE - 1);
+  uint32_t probe;
+  for (probe = 0; probe < OMPT_REGION_CACHE_SIZE; probe++)
+  {
+    struct ompt_region * current = &regions[(index + probe) & (OMPT_REGION_CACHE_SIZE - 1)];
+    const void * found = current->codeptr_ra;
+    if (found == codeptr_ra || found == NULL)
+      return current;
+  }
+  return NULL;
+}
+
+/* get the region id of codeptr_ra, define the region if it is new.
+ * return 0 if the cache is full or libadapt could not be opened */
+static uint32_t get_region(const void * codeptr_ra)
+{
+  struct ompt_region * current;
+  uint32_t rid = 0;
+  char name[1024];
+
+  /* adapt_open is not called with the lock held, other threads wait here */
+  pthread_once(&ompt_adapt_once, ompt_adapt_open);
+  if (ompt_adapt_state != 1)
+    return 0;
+  current = find_region(codeptr_ra);
+  if (current != NULL && current->codeptr_ra == codeptr_ra)
+  {
+    /* codeptr_ra is read before rid */
+    __sync_synchronize();
+    return current->rid;
+  }
+
+  while (__sync_lock_test_and_set(&regions_lock, 1))
+    ;
+  /* another thread could have inserted it in between */
+  current = find_region(codeptr_ra);
+  if (current != NULL && current->codeptr_ra == codeptr_ra)
+    rid = current->rid;
+  else if (current != NULL)
+  {
+    region_name(codeptr_ra, name, sizeof(name));
+    rid = ++nr_regions;
+    adapt_def_region(ompt_binary_id, name, rid);
+#ifdef VERBOSE
+    fprintf(stderr, "OMPT: parallel region %p in %s has id %" PRIu32 "\n", codeptr_ra, name, rid);
+#endif
+    current->rid = rid;
+    /* rid is visible before codeptr_ra */
+    __sync_synchronize();
+    current->codeptr_ra = codeptr_ra;
+  }
+  __sync_lock_release(&regions_lock);
+  return rid;
+}
+
+/* The primary thread applies the settings before the team is formed, so
+ * dct_threads_before already selects the size of this team. Strictly, OMPT
+ * does not allow runtime library routines in callbacks, but dct calls
+ * omp_set_num_threads here. This relies on the LLVM OpenMP runtime (and
+ * runtimes based on it), which reads the number of threads afterwards */
+static void ompt_on_parallel_begin(ompt_data_t * encountering_task_data,
+    const ompt_frame_t * encountering_task_frame, ompt_data_t * parallel_data,
+    unsigned int requested_parallelism, int flags, const void * codeptr_ra)
+{
+  parallel_data->value = get_region(codeptr_ra);
+  if (parallel_data->value)
+    adapt_enter_stacks(ompt_binary_id, get_tid(), parallel_data->value, -1);
+}
+
+static void ompt_on_parallel_end(ompt_data_t * parallel_data,
+    ompt_data_t * encountering_task_data, int flags, const void * codeptr_ra)
+{
+  if (parallel_data->value)
+    adapt_exit(ompt_binary_id, get_tid(), -1);
+}
+
+/* the other threads of the team apply the settings on their own cpus */
+static void ompt_on_implicit_task(ompt_scope_endpoint_t endpoint,
+    ompt_data_t * parallel_data, ompt_data_t * task_data,
+    unsigned int actual_parallelism, unsigned int index, int flags)
+{
+  if ((flags & ompt_task_initial) || index == 0)
+    return;
+  if (endpoint == ompt_scope_begin)
+  {
+    task_data->value = parallel_data != NULL ? parallel_data->value : 0;
+    if (task_data->value)
+      adapt_enter_stacks(ompt_binary_id, get_tid(), task_data->value, -1);
+  }
+  else if (task_data->value)
+    adapt_exit(ompt_binary_id, get_tid(), -1);
+}
+
+static void ompt_on_thread_end(ompt_data_t * thread_data)
+{
+  if (current_tid == 0)
+    return;
+  tid_free(current_tid - 1);
+  current_tid = 0;
+}
+
+#ifndef NO_CPUFREQ
+/* threads that wait at barriers, taskwaits, taskgroups, or locks can run at
+ * a lower frequency (see dvfs_wait_freq) */
+static void ompt_on_sync_region_wait(ompt_sync_region_t kind,
+    ompt_scope_endpoint_t endpoint, ompt_data_t * parallel_data,
+    ompt_data_t * task_data, const void * codeptr_ra)
+{
+  if (endpoint == ompt_scope_begin)
+    dvfs_wait_begin(codeptr_ra);
+  else
+    dvfs_wait_end(codeptr_ra);
+}
+
+static void ompt_on_mutex_acquire(ompt_mutex_t kind, unsigned int hint,
+    unsigned int impl, ompt_wait_id_t wait_id, const void * codeptr_ra)
+{
+  dvfs_wait_begin(codeptr_ra);
+}
+
+static void ompt_on_mutex_acquired(ompt_mutex_t kind, ompt_wait_id_t wait_id,
+    const void * codeptr_ra)
+{
+  dvfs_wait_end(codeptr_ra);
+}
+#endif
+
+static int ompt_tool_initialize(ompt_function_lookup_t lookup,
+    int initial_device_num, ompt_data_t * tool_data)
+{
+  ompt_set_callback_t set_callback;
+
+  set_callback = (ompt_set_callback_t) lookup("ompt_set_callback");
+  if (set_callback == NULL)
+    return 0;
+
+  set_callback(ompt_callback_parallel_begin, (ompt_callback_t) ompt_on_parallel_begin);
+  set_callback(ompt_callback_parallel_end, (ompt_callback_t) ompt_on_parallel_end);
+  set_callback(ompt_callback_implicit_task, (ompt_callback_t) ompt_on_implicit_task);
+  set_callback(ompt_callback_thread_end, (ompt_callback_t) ompt_on_thread_end);
+#ifndef NO_CPUFREQ
+  set_callback(ompt_callback_sync_region_wait, (ompt_callback_t) ompt_on_sync_region_wait);
+  set_callback(ompt_callback_mutex_acquire, (ompt_callback_t) ompt_on_mutex_acquire);
+  set_callback(ompt_callback_mutex_acquired, (ompt_callback_t) ompt_on_mutex_acquired);
+#endif
+  return 1;
+}
+
+static void ompt_tool_finalize(ompt_data_t * tool_data)
+{
+  if (ompt_adapt_state == 1)
+    adapt_close();
+}
+
+ompt_start_tool_result_t * ompt_start_tool(unsigned int omp_version,
+    const char * runtime_version)
+{
+  static ompt_start_tool_result_t result = {
+    &ompt_tool_initialize, &ompt_tool_finalize, { 0 }
+  };
+  const char * enabled = getenv("ADAPT_OMPT");
+  if (enabled == NULL || strcmp(enabled, "1") != 0)
+    return NULL;
+  return &result;
+}
@@ -0,0 +1,164 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+#include "sysfs_file.h"
+
+/* older headers don't know the resctrl file system */
+#ifndef RDTGROUP_SUPER_MAGIC
+#define RDTGROUP_SUPER_MAGIC 0x7655821
+#endif
+
+/* prefix for all paths, empty for the real system */
+static char sysfs_root[256] = "";
+
+int sysfs_set_root(const char * root)
+{
+  if (root == NULL)
+    root = "";
+  if (strlen(root) >= sizeof(sysfs_root))
+    return ENAMETOOLONG;
+  strcpy(sysfs_root, root);
+  return 0;
+}
+
+static int sysfs_vpath(char * buffer, size_t size, const char * format, va_list args)
+{
+  int nr_chars = snprintf(buffer, size, "%s", sysfs_root);
+  if (nr_chars >= size)
+    return ENAMETOOLONG;
+  if (vsnprintf(&buffer[nr_chars], size - nr_chars, format, args) >= size - nr_chars)
+    return ENAMETOOLONG;
+  return 0;
+}
+
+int sysfs_path(char * buffer, size_t size, const char * format, ...)
+{
+  int ret;
+  va_list args;
+  va_start(args, format);
+  ret = sysfs_vpath(buffer, size, format, args);
+  va_end(args);
+  return ret;
+}
+
+int sysfs_exists(const char * format, ...)
+{
+  char path[512];
+  int ret;
+  va_list args;
+  va_start(args, format);
+  ret = sysfs_vpath(path, sizeof(path), format, args);
+  va_end(args);
+  if (ret)
+    return 0;
+  return access(path, F_OK) == 0;
+}
+
+int sysfs_file_open(struct sysfs_file * file, const char * format, ...)
+{
+  char path[512];
+  struct statfs status;
+  ssize_t nr_read;
+  int ret;
+  va_list args;
+
+  file->fd = -1;
+  file->value_len = 0;
+  file->original_len = 0;
+  file->regular = 0;
+  va_start(args, format);
+  ret = sysfs_vpath(path, sizeof(path), format, args);
+  va_end(args);
+  if (ret)
+    return ret;
+
+  file->fd = open(path, O_RDWR);
+  if (file->fd == -1)
+    return errno;
+  /* sysfs and procfs files look like regular files, but don't keep data */
+  if (fstatfs(file->fd, &status) == 0)
+    file->regular = status.f_type != SYSFS_MAGIC && status.f_type != PROC_SUPER_MAGIC &&
+        status.f_type != RDTGROUP_SUPER_MAGIC;
+
+  nr_read = pread(file->fd, file->original, sizeof(file->original) - 1, 0);
+  if (nr_read < 0)
+  {
+    ret = errno;
+    close(file->fd);
+    file->fd = -1;
+    return ret;
+  }
+  /* sysfs values end with a newline, which is not written back */
+  while (nr_read > 0 && file->original[nr_read - 1] == '\n')
+    nr_read--;
+  file->original[nr_read] = '\0';
+  file->original_len = nr_read;
+  memcpy(file->value, file->original, nr_read + 1);
+  file->value_len = nr_read;
+#ifdef VERBOSE
+  fprintf(stderr, "Opened %s: %s\n", path, file->original);
+#endif
+  return 0;
+}
+
+int sysfs_file_write(struct sysfs_file * file, const char * value, size_t len)
+{
+  if (len >= SYSFS_FILE_VALUE_SIZE)
+    return EINVAL;
+  /* nothing to do */
+  if (len == file->value_len && memcmp(file->value, value, len) == 0)
+    return 0;
+  /* files of a fake tree are regular files and have to be truncated */
+  if (file->regular && ftruncate(file->fd, len))
+    return errno;
+  if (pwrite(file->fd, value, len, 0) != (ssize_t) len)
+  {
+    /* the state of the file is unknown now, so don't skip the next write */
+    file->value_len = SYSFS_FILE_VALUE_SIZE;
+    return errno ? errno : EIO;
+  }
+  memcpy(file->value, value, len);
+  file->value[len] = '\0';
+  file->value_len = len;
+  return 0;
+}
+
+int sysfs_file_restore(struct sysfs_file * file)
+{
+  if (file->fd == -1)
+    return 0;
+  return sysfs_file_write(file, file->original, file->original_len);
+}
+
+void sysfs_file_close(struct sysfs_file * file)
+{
+  if (file->fd != -1)
+    close(file->fd);
+  file->fd = -1;
+}
@@ -0,0 +1,146 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include "threads.h"
+
+static int compare_tids(const void * a, const void * b)
+{
+  pid_t ta = *(const pid_t *) a;
+  pid_t tb = *(const pid_t *) b;
+  return (ta > tb) - (ta < tb);
+}
+
+int threads_list(pid_t ** tids, int * nr)
+{
+  DIR * dir;
+  struct dirent * entry;
+  pid_t * list = NULL;
+  int size = 0;
+  int count = 0;
+
+  dir = opendir("/proc/self/task");
+  if (dir == NULL)
+    return errno;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    pid_t tid = atoi(entry->d_name);
+    if (tid <= 0)
+      continue;
+    if (count == size)
+    {
+      pid_t * new_list;
+      size = size ? 2 * size : 64;
+      new_list = realloc(list, size * sizeof(pid_t));
+      if (new_list == NULL)
+      {
+        free(list);
+        closedir(dir);
+        return ENOMEM;
+      }
+      list = new_list;
+    }
+    list[count++] = tid;
+  }
+  closedir(dir);
+  qsort(list, count, sizeof(pid_t), compare_tids);
+  *tids = list;
+  *nr = count;
+  return 0;
+}
+
+pid_t threads_self(void)
+{
+  return syscall(SYS_gettid);
+}
+
+int threads_get_sched_attr(pid_t tid, struct threads_sched_attr * attr)
+{
+  if (syscall(SYS_sched_getattr, tid, attr, sizeof(struct threads_sched_attr), 0))
+    return errno;
+  return 0;
+}
+
+int threads_set_sched_attr(pid_t tid, struct threads_sched_attr * attr)
+{
+  attr->size = sizeof(struct threads_sched_attr);
+  if (syscall(SYS_sched_setattr, tid, attr, 0))
+    return errno;
+  return 0;
+}
+
+int threads_get_timerslack(pid_t tid, uint64_t * slack)
+{
+  char path[64];
+  char buffer[32];
+  int fd;
+  ssize_t len;
+
+  if (tid == 0 || tid == threads_self())
+  {
+    int ret = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+    if (ret < 0)
+      return errno;
+    *slack = ret;
+    return 0;
+  }
+  sprintf(path, "/proc/self/task/%d/timerslack_ns", (int) tid);
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return errno == ENOENT ? ESRCH : errno;
+  len = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+  if (len <= 0)
+    return len < 0 ? errno : EIO;
+  buffer[len] = '\0';
+  *slack = strtoull(buffer, NULL, 10);
+  return 0;
+}
+
+int threads_set_timerslack(pid_t tid, uint64_t slack)
+{
+  char path[64];
+  char buffer[32];
+  int fd, len, ret = 0;
+
+  if (tid == 0 || tid == threads_self())
+  {
+    if (prctl(PR_SET_TIMERSLACK, (unsigned long) slack, 0, 0, 0))
+      return errno;
+    return 0;
+  }
+  sprintf(path, "/proc/self/task/%d/timerslack_ns", (int) tid);
+  fd = open(path, O_WRONLY);
+  if (fd < 0)
+    return errno == ENOENT ? ESRCH : errno;
+  len = sprintf(buffer, "%" PRIu64, slack);
+  if (write(fd, buffer, len) != len)
+    ret = errno;
+  close(fd);
+  return ret;
+}
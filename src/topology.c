@@ -0,0 +1,359 @@
+/***********************************************************************
+ * Copyright (c) 2010-2016 Technische Universitaet Dresden             *
+ *                                                                     *
+ * This file is part of libadapt.                                      *
+ *                                                                     *
+ * libadapt is free software: you can redistribute it and/or modify    *
+ * it under the terms of the GNU General Public License as published by*
+ * the Free Software Foundation, either version 3 of the License, or   *
+ * (at your option) any later version.                                 *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.*
+ ***********************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sysfs_file.h"
+#include "topology.h"
+
+#define CPU_PATH "/sys/devices/system/cpu/cpu%d"
+#define NODE_PATH "/sys/devices/system/node"
+
+struct cpu_topology {
+  int online;
+  int package;
+  int die;
+  int core;
+  int node;
+};
+
+static struct cpu_topology * cpus = NULL;
+static int nr_cpus = 0;
+
+/* online NUMA nodes, a single node 0 if the system does not report nodes */
+static int * nodes_online = NULL;
+static int nr_nodes = 0;
+
+/* the online cpus of every level, ordered so that the cpus of a core, die,
+ * or package are contiguous. group_first and group_size give the part of
+ * members that holds the group of a cpu */
+struct topology_level {
+  int * members;
+  int * group_first;
+  int * group_size;
+};
+
+static struct topology_level levels[TOPOLOGY_LEVEL_MAX];
+
+/* read a single integer from a sysfs file, return default_value if the
+ * file does not exist */
+static int read_int(const char * format, int cpu, const char * file, int default_value)
+{
+  char path[512];
+  FILE * fp;
+  int value;
+  if (sysfs_path(path, sizeof(path), format, cpu))
+    return default_value;
+  if (snprintf(&path[strlen(path)], sizeof(path) - strlen(path), "/%s", file) >= sizeof(path) - strlen(path))
+    return default_value;
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return default_value;
+  if (fscanf(fp, "%d", &value) != 1)
+    value = default_value;
+  fclose(fp);
+  return value;
+}
+
+/* whether two online cpus belong to the same group of a level. cpus with
+ * unknown ids only form a group of their own */
+static int same_group(const struct cpu_topology * cpus, int level, int a, int b)
+{
+  if (a == b)
+    return 1;
+  if (level == TOPOLOGY_LEVEL_ALL)
+    return 1;
+  if (cpus[a].package < 0 || cpus[a].package != cpus[b].package)
+    return 0;
+  if (level == TOPOLOGY_LEVEL_PACKAGE)
+    return 1;
+  if (cpus[a].die != cpus[b].die)
+    return 0;
+  if (level == TOPOLOGY_LEVEL_DIE)
+    return 1;
+  return cpus[a].core >= 0 && cpus[a].core == cpus[b].core;
+}
+
+static void free_level(struct topology_level * current)
+{
+  free(current->members);
+  free(current->group_first);
+  free(current->group_size);
+  current->members = NULL;
+  current->group_first = NULL;
+  current->group_size = NULL;
+}
+
+static int init_level(struct topology_level * current, int level,
+    const struct cpu_topology * cpus, int nr_cpus)
+{
+  int cpu, other, nr_members = 0;
+  current->members = calloc(nr_cpus, sizeof(int));
+  current->group_first = calloc(nr_cpus, sizeof(int));
+  current->group_size = calloc(nr_cpus, sizeof(int));
+  if (current->members == NULL || current->group_first == NULL || current->group_size == NULL)
+    return ENOMEM;
+  for (cpu = 0; cpu < nr_cpus; cpu++)
+    current->group_first[cpu] = -1;
+  for (cpu = 0; cpu < nr_cpus; cpu++)
+  {
+    int first = nr_members;
+    if (!cpus[cpu].online || current->group_first[cpu] != -1)
+      continue;
+    for (other = cpu; other < nr_cpus; other++)
+      if (cpus[other].online && same_group(cpus, level, cpu, other))
+        current->members[nr_members++] = other;
+    for (other = first; other < nr_members; other++)
+    {
+      current->group_first[current->members[other]] = first;
+      current->group_size[current->members[other]] = nr_members - first;
+    }
+  }
+  return 0;
+}
+
+/* read a list of cpus or nodes (e.g., "0-3,8-11"), set mask[i] for every
+ * listed i < size (mask can be NULL), return the highest listed number or -1
+ * if the file does not exist */
+static int read_list(const char * format, int nr, int * mask, int size)
+{
+  char path[512];
+  char list[1024];
+  char * current;
+  FILE * fp;
+  int max = -1, first = -1;
+  if (sysfs_path(path, sizeof(path), format, nr))
+    return -1;
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return -1;
+  if (fgets(list, sizeof(list), fp) == NULL)
+    list[0] = '\0';
+  fclose(fp);
+  for (current = list; *current != '\0'; current++)
+  {
+    if (*current >= '0' && *current <= '9')
+    {
+      int value = strtol(current, &current, 10);
+      int i;
+      /* the end of a range "first-value" */
+      if (first < 0 || first > value)
+        first = value;
+      for (i = first; mask != NULL && i <= value && i < size; i++)
+        mask[i] = 1;
+      if (value > max)
+        max = value;
+      first = *current == '-' ? value + 1 : -1;
+      current--;
+    }
+  }
+  return max;
+}
+
+/* get the number of cpus from the list of possible cpus, which is also
+ * available for a fake tree */
+static int read_nr_cpus(void)
+{
+  int max = read_list("/sys/devices/system/cpu/possible", 0, NULL, 0);
+  if (max < 0)
+    return sysconf(_SC_NPROCESSORS_CONF);
+  return max + 1;
+}
+
+/* read the online NUMA nodes and the node of every cpu */
+static int init_nodes(struct cpu_topology * cpus, int nr_cpus, int ** online, int * nr)
+{
+  int node, cpu;
+  int * node_cpus;
+  int * nodes_online;
+  int nr_nodes = read_list(NODE_PATH "/online", 0, NULL, 0) + 1;
+  if (nr_nodes <= 0)
+  {
+    /* no NUMA information, everything belongs to node 0 */
+    nodes_online = calloc(1, sizeof(int));
+    if (nodes_online == NULL)
+      return ENOMEM;
+    nodes_online[0] = 1;
+    for (cpu = 0; cpu < nr_cpus; cpu++)
+      cpus[cpu].node = 0;
+    *online = nodes_online;
+    *nr = 1;
+    return 0;
+  }
+  nodes_online = calloc(nr_nodes, sizeof(int));
+  node_cpus = calloc(nr_cpus, sizeof(int));
+  if (nodes_online == NULL || node_cpus == NULL)
+  {
+    free(nodes_online);
+    free(node_cpus);
+    return ENOMEM;
+  }
+  read_list(NODE_PATH "/online", 0, nodes_online, nr_nodes);
+  for (cpu = 0; cpu < nr_cpus; cpu++)
+    cpus[cpu].node = -1;
+  for (node = 0; node < nr_nodes; node++)
+  {
+    if (!nodes_online[node])
+      continue;
+    memset(node_cpus, 0, nr_cpus * sizeof(int));
+    read_list(NODE_PATH "/node%d/cpulist", node, node_cpus, nr_cpus);
+    for (cpu = 0; cpu < nr_cpus; cpu++)
+      if (node_cpus[cpu])
+        cpus[cpu].node = node;
+  }
+  free(node_cpus);
+  *online = nodes_online;
+  *nr = nr_nodes;
+  return 0;
+}
+
+/* the table is built in locals and only published if it is complete, so a
+ * failed call leaves no partial topology behind */
+int topology_init(void)
+{
+  struct cpu_topology * new_cpus;
+  struct topology_level new_levels[TOPOLOGY_LEVEL_MAX];
+  int * new_nodes = NULL;
+  int new_nr_cpus, new_nr_nodes = 0;
+  int cpu, level, ret;
+  if (cpus != NULL)
+    return 0;
+  new_nr_cpus = read_nr_cpus();
+  new_cpus = calloc(new_nr_cpus, sizeof(struct cpu_topology));
+  if (new_cpus == NULL)
+    return ENOMEM;
+  for (cpu = 0; cpu < new_nr_cpus; cpu++)
+  {
+    /* cpu0 usually has no online file */
+    new_cpus[cpu].online = read_int(CPU_PATH, cpu, "online", 1);
+    new_cpus[cpu].package = read_int(CPU_PATH, cpu, "topology/physical_package_id", -1);
+    new_cpus[cpu].die = read_int(CPU_PATH, cpu, "topology/die_id", new_cpus[cpu].package < 0 ? -1 : 0);
+    new_cpus[cpu].core = read_int(CPU_PATH, cpu, "topology/core_id", -1);
+  }
+  ret = init_nodes(new_cpus, new_nr_cpus, &new_nodes, &new_nr_nodes);
+  if (ret)
+  {
+    free(new_cpus);
+    return ret;
+  }
+#ifdef VERBOSE
+  for (cpu = 0; cpu < new_nr_cpus; cpu++)
+    fprintf(stderr, "cpu %d: online %d package %d die %d core %d node %d\n", cpu,
+        new_cpus[cpu].online, new_cpus[cpu].package, new_cpus[cpu].die, new_cpus[cpu].core,
+        new_cpus[cpu].node);
+#endif
+  memset(new_levels, 0, sizeof(new_levels));
+  for (level = 0; level < TOPOLOGY_LEVEL_MAX; level++)
+  {
+    ret = init_level(&new_levels[level], level, new_cpus, new_nr_cpus);
+    if (ret)
+    {
+      for (level = 0; level < TOPOLOGY_LEVEL_MAX; level++)
+        free_level(&new_levels[level]);
+      free(new_nodes);
+      free(new_cpus);
+      return ret;
+    }
+  }
+  memcpy(levels, new_levels, sizeof(levels));
+  nodes_online = new_nodes;
+  nr_nodes = new_nr_nodes;
+  nr_cpus = new_nr_cpus;
+  cpus = new_cpus;
+  return 0;
+}
+
+void topology_fini(void)
+{
+  int level;
+  for (level = 0; level < TOPOLOGY_LEVEL_MAX; level++)
+    free_level(&levels[level]);
+  free(nodes_online);
+  nodes_online = NULL;
+  nr_nodes = 0;
+  free(cpus);
+  cpus = NULL;
+  nr_cpus = 0;
+}
+
+int topology_nr_cpus(void)
+{
+  return nr_cpus;
+}
+
+int topology_cpu_online(int cpu)
+{
+  if (cpu < 0 || cpu >= nr_cpus)
+    return 0;
+  return cpus[cpu].online;
+}
+
+int topology_package(int cpu)
+{
+  if (cpu < 0 || cpu >= nr_cpus)
+    return -1;
+  return cpus[cpu].package;
+}
+
+int topology_die(int cpu)
+{
+  if (cpu < 0 || cpu >= nr_cpus)
+    return -1;
+  return cpus[cpu].die;
+}
+
+int topology_core(int cpu)
+{
+  if (cpu < 0 || cpu >= nr_cpus)
+    return -1;
+  return cpus[cpu].core;
+}
+
+int topology_node(int cpu)
+{
+  if (cpu < 0 || cpu >= nr_cpus)
+    return -1;
+  return cpus[cpu].node;
+}
+
+int topology_nr_nodes(void)
+{
+  return nr_nodes;
+}
+
+int topology_node_online(int node)
+{
+  if (node < 0 || node >= nr_nodes)
+    return 0;
+  return nodes_online[node];
+}
+
+const int * topology_cpus(int level, int cpu, int * nr)
+{
+  *nr = 0;
+  if (level < 0 || level >= TOPOLOGY_LEVEL_MAX || cpu < 0 || cpu >= nr_cpus ||
+      levels[level].group_first == NULL || levels[level].group_first[cpu] < 0)
+    return NULL;
+  *nr = levels[level].group_size[cpu];
+  return &levels[level].members[levels[level].group_first[cpu]];
+}
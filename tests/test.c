@@ -19,9 +19,13 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <omp.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 #include "adapt.h"
 
@@ -29,8 +33,17 @@
 #include "x86_adapt.h"
 #endif
 
-/* hardcoded path to control the frequency scaling */
-#define SCALING_CUR_FREQ "/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq"
+/* fake sysfs tree that is created by test.sh and used as sysfs_root */
+#define FAKE_SYS "./fake_sys"
+/* a sparse file that stands in for the msr device of cpu 0 */
+#define FAKE_MSR FAKE_SYS "/dev/cpu/0/msr"
+#define FAKE_MSR_OF_CPU FAKE_SYS "/dev/cpu/%d/msr"
+#define FAKE_GOVERNOR FAKE_SYS "/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor"
+/* the powercap zone of package 0 in the fake tree */
+#define FAKE_RAPL FAKE_SYS "/sys/class/powercap/intel-rapl:0"
+#define FAKE_RAPL_LIMIT FAKE_RAPL "/constraint_0_power_limit_uw"
+#define FAKE_RAPL_WINDOW FAKE_RAPL "/constraint_0_time_window_us"
+#define FAKE_NUMA_BALANCING FAKE_SYS "/proc/sys/kernel/numa_balancing"
 
 /* define variables for test environment */
 #define TEST_DCT (1<<0)
@@ -41,6 +54,10 @@
 #else
     #define TEST_X86ADAPT 0
 #endif
+#define TEST_MSR (1<<4)
+#define TEST_CLOCK_MOD (1<<5)
+#define TEST_POWERCAP (1<<6)
+#define TEST_MEMPOLICY (1<<7)
 
 
 /* Print nice header for a category */
@@ -76,30 +93,42 @@ def_region(int message, char * category, uint64_t bid, int rid)
 
 /* Make adapt_enter_stacks compact */
 int
-enter_stacks(int message, uint64_t bid, int rid)
+enter_stacks_on(int message, uint64_t bid, int rid, int cpu)
 {
     int error;
 
     if ( message == 1 ) printf("\nEnter region with stacks\n");
-    error = adapt_enter_stacks(bid, 0, rid, 0);
+    error = adapt_enter_stacks(bid, 0, rid, cpu);
     if ( message == 1 ) printf("Returned error code: %d\n", error);
 
     return error;
 }
 
+int
+enter_stacks(int message, uint64_t bid, int rid)
+{
+    return enter_stacks_on(message, bid, rid, 0);
+}
+
 /* Make adapt_exit compact */
 int
-exit_stacks(int message, uint64_t bid, int rid)
+exit_stacks_on(int message, uint64_t bid, int rid, int cpu)
 {
     int error;
 
     if ( message == 1 ) printf("\nExit region\n");
-    error = adapt_exit(bid, 0, 0);
+    error = adapt_exit(bid, 0, cpu);
     if ( message == 1 ) printf("Returned error code: %d\n", error);
 
     return error;
 }
 
+int
+exit_stacks(int message, uint64_t bid, int rid)
+{
+    return exit_stacks_on(message, bid, rid, 0);
+}
+
 /* Print out a file like cat */
 int
 cat(char * filename, int overhead)
@@ -143,6 +172,68 @@ cat(char * filename, int overhead)
     return i;
 }
 
+/* Print a register of the fake msr device of a cpu like cat */
+int
+print_msr(int cpu, uint32_t reg)
+{
+    char path[64];
+    uint64_t value = 0;
+    int fd;
+
+    /* the register address is the offset within the device */
+    snprintf(path, sizeof(path), FAKE_MSR_OF_CPU, cpu);
+    fd = open(path, O_RDONLY);
+    if ( fd < 0 )
+        return -1;
+    if ( pread(fd, &value, sizeof(value), reg) != sizeof(value) )
+    {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    printf("%" PRIu64, value);
+
+    return 0;
+}
+
+/* Print the frequency that is set in IA32_PERF_CTL of the fake msr device,
+ * dvfs_backend = "msr" writes the ratio to 100 MHz to bits 15:8 */
+int
+print_freq(void)
+{
+    uint64_t value = 0;
+    int fd;
+
+    fd = open(FAKE_MSR, O_RDONLY);
+    if ( fd < 0 )
+        return -1;
+    if ( pread(fd, &value, sizeof(value), 0x199) != sizeof(value) )
+    {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    printf("%" PRIu64, ((value >> 8) & 0xff) * 100000);
+
+    return 0;
+}
+
+/* Print the memory policy mode of the calling thread */
+int
+print_mempolicy(void)
+{
+    int mode;
+
+    if ( syscall(SYS_get_mempolicy, &mode, NULL, 0, NULL, 0) )
+        return -1;
+
+    printf("%d", mode);
+
+    return 0;
+}
+
 /* Print number of threads for testing */
 int
 print_threads(void)
@@ -209,11 +300,11 @@ test_dvfs(uint64_t bid, int message)
 
     print_category(message, category);
 
-    if ( message == 1 ) printf("\nFile %s \n", SCALING_CUR_FREQ);
+    if ( message == 1 ) printf("\nIA32_PERF_CTL of %s \n", FAKE_MSR);
 
     if ( message == 1 ) printf("\nFreq:\n");
     printf("init_dvfs_freq_before=");
-    cat(SCALING_CUR_FREQ, 0);
+    error |= print_freq();
     printf("\n");
 
     error |= def_region(message, category, bid, rid);
@@ -222,14 +313,14 @@ test_dvfs(uint64_t bid, int message)
 
     if ( message == 1 ) printf("\nFreq:\n");
     printf("bin_dvfs_freq_before=");
-    cat(SCALING_CUR_FREQ, 0);
+    error |= print_freq();
     printf("\n");
 
     error |= exit_stacks(message, bid, rid);
 
     if ( message == 1 ) printf("\nFreq:\n");
     printf("bin_dvfs_freq_after=");
-    cat(SCALING_CUR_FREQ, 0);
+    error |= print_freq();
     printf("\n");
 
     if ( message == 1 ) printf("*********\n");
@@ -271,6 +362,145 @@ test_file(uint64_t bid, int message, char * filename)
     return error;
 }
 
+/* model specific register behavior with a fake msr device */
+int
+test_msr(uint64_t bid, int message)
+{
+    char * category = "msr";
+    int error = 0;
+    uint32_t rid = 16;
+
+    print_category(message, category);
+
+    error |= def_region(message, category, bid, rid);
+
+    error |= enter_stacks(message, bid, rid);
+
+    if ( message == 1 ) printf("\nMSR 0x1a4 of %s:\n", FAKE_MSR);
+    printf("bin_msr_before_value=");
+    error |= print_msr(0, 0x1a4);
+    printf("\n");
+
+    error |= exit_stacks(message, bid, rid);
+
+    if ( message == 1 ) printf("\nMSR 0x1a4 of %s:\n", FAKE_MSR);
+    printf("bin_msr_after_value=");
+    error |= print_msr(0, 0x1a4);
+    printf("\n");
+
+    if ( message == 1 ) printf("*********\n");
+
+    return error;
+}
+
+/* clock modulation behavior with a fake msr device */
+int
+test_clock_mod(uint64_t bid, int message)
+{
+    char * category = "clock_mod";
+    int error = 0;
+    uint32_t rid = 32;
+    /* IA32_PERF_CTL of cpu 0 overlaps in the fake msr device, which has at
+     * least two cpus */
+    int cpu = 1;
+
+    print_category(message, category);
+
+    error |= def_region(message, category, bid, rid);
+
+    error |= enter_stacks_on(message, bid, rid, cpu);
+
+    if ( message == 1 ) printf("\nMSR 0x19a of cpu %d:\n", cpu);
+    printf("bin_clock_mod_before_value=");
+    error |= print_msr(cpu, 0x19a);
+    printf("\n");
+
+    error |= exit_stacks_on(message, bid, rid, cpu);
+
+    if ( message == 1 ) printf("\nMSR 0x19a of cpu %d:\n", cpu);
+    printf("bin_clock_mod_after_value=");
+    error |= print_msr(cpu, 0x19a);
+    printf("\n");
+
+    if ( message == 1 ) printf("*********\n");
+
+    return error;
+}
+
+/* power limit behavior with a fake powercap zone */
+int
+test_powercap(uint64_t bid, int message)
+{
+    char * category = "powercap";
+    int error = 0;
+    uint32_t rid = 64;
+
+    print_category(message, category);
+
+    error |= def_region(message, category, bid, rid);
+
+    error |= enter_stacks(message, bid, rid);
+
+    if ( message == 1 ) printf("\nContent of %s:\n", FAKE_RAPL_LIMIT);
+    printf("bin_powercap_package_before=");
+    error |= cat(FAKE_RAPL_LIMIT, 0) < 0;
+    printf("\n");
+    if ( message == 1 ) printf("\nContent of %s:\n", FAKE_RAPL_WINDOW);
+    printf("bin_powercap_window_before=");
+    error |= cat(FAKE_RAPL_WINDOW, 0) < 0;
+    printf("\n");
+
+    error |= exit_stacks(message, bid, rid);
+
+    if ( message == 1 ) printf("\nContent of %s:\n", FAKE_RAPL_LIMIT);
+    printf("bin_powercap_package_after=");
+    error |= cat(FAKE_RAPL_LIMIT, 0) < 0;
+    printf("\n");
+
+    if ( message == 1 ) printf("*********\n");
+
+    return error;
+}
+
+/* memory policy and numa balancing behavior */
+int
+test_mempolicy(uint64_t bid, int message)
+{
+    char * category = "mempolicy";
+    int error = 0;
+    uint32_t rid = 128;
+
+    print_category(message, category);
+
+    error |= def_region(message, category, bid, rid);
+
+    error |= enter_stacks(message, bid, rid);
+
+    if ( message == 1 ) printf("\nMemory policy of the thread:\n");
+    printf("bin_mempolicy_mode_before=");
+    error |= print_mempolicy();
+    printf("\n");
+    if ( message == 1 ) printf("\nContent of %s:\n", FAKE_NUMA_BALANCING);
+    printf("bin_mempolicy_numa_balancing_before=");
+    error |= cat(FAKE_NUMA_BALANCING, 0) < 0;
+    printf("\n");
+
+    error |= exit_stacks(message, bid, rid);
+
+    if ( message == 1 ) printf("\nMemory policy of the thread:\n");
+    printf("bin_mempolicy_mode_after=");
+    error |= print_mempolicy();
+    printf("\n");
+    if ( message == 1 ) printf("\nContent of %s:\n", FAKE_NUMA_BALANCING);
+    printf("bin_mempolicy_numa_balancing_after=");
+    error |= cat(FAKE_NUMA_BALANCING, 0) < 0;
+    printf("\n");
+
+    if ( message == 1 ) printf("*********\n");
+
+    return error;
+}
+
 #ifdef X86_ADAPT
 /* frequency/dvfs behavior */
 int
@@ -362,8 +592,17 @@ main(int argc, char **argv)
             test |= TEST_FILE;
         else if ( strcmp(*argv, "x86_adapt") == 0  )
             test |= TEST_X86ADAPT;
+        else if ( strcmp(*argv, "msr") == 0 )
+            test |= TEST_MSR;
+        else if ( strcmp(*argv, "clock_mod") == 0 )
+            test |= TEST_CLOCK_MOD;
+        else if ( strcmp(*argv, "powercap") == 0 )
+            test |= TEST_POWERCAP;
+        else if ( strcmp(*argv, "mempolicy") == 0 )
+            test |= TEST_MEMPOLICY;
         else if ( strcmp(*argv, "all") == 0 )
-            test = TEST_DCT | TEST_DVFS | TEST_FILE | TEST_X86ADAPT;
+            test = TEST_DCT | TEST_DVFS | TEST_FILE | TEST_X86ADAPT | TEST_MSR
+                | TEST_CLOCK_MOD | TEST_POWERCAP | TEST_MEMPOLICY;
         else if ( strstr(*argv, "/") != NULL )
             filename = *argv;
         else if ( strstr(*argv, "x86_adapt_") != NULL  )
@@ -374,7 +613,8 @@ main(int argc, char **argv)
     }
     /* if atfer all this the test scenario wasn't set we will set it */
     if ( test == 0 )
-        test = TEST_DCT | TEST_DVFS | TEST_FILE | TEST_X86ADAPT;
+        test = TEST_DCT | TEST_DVFS | TEST_FILE | TEST_X86ADAPT | TEST_MSR
+            | TEST_CLOCK_MOD | TEST_POWERCAP | TEST_MEMPOLICY;
 
     /* open adapt and init everything */
     if (message == 1) printf("\nOpen adapter \n");
@@ -401,6 +641,38 @@ main(int argc, char **argv)
         test &= ~TEST_FILE;
     }
 
+    /* test for model specific registers */
+    if ( test & TEST_MSR )
+    {
+        error |= test_msr(bid, message);
+        test &= ~TEST_MSR;
+        executed_tests |= TEST_MSR;
+    }
+
+    /* test for clock modulation */
+    if ( test & TEST_CLOCK_MOD )
+    {
+        error |= test_clock_mod(bid, message);
+        test &= ~TEST_CLOCK_MOD;
+        executed_tests |= TEST_CLOCK_MOD;
+    }
+
+    /* test for power limits */
+    if ( test & TEST_POWERCAP )
+    {
+        error |= test_powercap(bid, message);
+        test &= ~TEST_POWERCAP;
+        executed_tests |= TEST_POWERCAP;
+    }
+
+    /* test for memory policies */
+    if ( test & TEST_MEMPOLICY )
+    {
+        error |= test_mempolicy(bid, message);
+        test &= ~TEST_MEMPOLICY;
+        executed_tests |= TEST_MEMPOLICY;
+    }
+
     /* test for dvfs or frequency scaling */
     if ( test & TEST_DVFS)
     {
@@ -436,7 +708,15 @@ main(int argc, char **argv)
     {
         if ( message == 1 ) { printf("Test dvfs\n"); printf("Freq:\n"); }
         printf("init_dvfs_freq_after=");
-        cat(SCALING_CUR_FREQ, 0);
+        print_freq();
+        printf("\n");
+        /* the original value of IA32_PERF_CTL has to be restored */
+        printf("fini_dvfs_perf_ctl=");
+        error |= print_msr(0, 0x199);
+        printf("\n");
+        /* and the governor that has been replaced by userspace */
+        printf("fini_dvfs_governor=");
+        error |= cat(FAKE_GOVERNOR, 0) < 0;
         printf("\n");
         if ( message == 1 ) printf("\n");
         executed_tests &= ~TEST_DVFS;
@@ -451,6 +731,47 @@ main(int argc, char **argv)
         executed_tests &= ~TEST_DCT;
     }
 
+    /* the original values of the fake tree have to be restored */
+    if ( executed_tests & TEST_MSR )
+    {
+        if ( message == 1 ) { printf("Test msr\n"); printf("MSR 0x1a4:\n"); }
+        printf("fini_msr=");
+        error |= print_msr(0, 0x1a4);
+        printf("\n");
+        executed_tests &= ~TEST_MSR;
+    }
+
+    if ( executed_tests & TEST_CLOCK_MOD )
+    {
+        if ( message == 1 ) { printf("Test clock_mod\n"); printf("MSR 0x19a:\n"); }
+        printf("fini_clock_mod=");
+        error |= print_msr(1, 0x19a);
+        printf("\n");
+        executed_tests &= ~TEST_CLOCK_MOD;
+    }
+
+    if ( executed_tests & TEST_POWERCAP )
+    {
+        if ( message == 1 ) { printf("Test powercap\n"); printf("Content of %s:\n", FAKE_RAPL_LIMIT); }
+        printf("fini_powercap_package=");
+        error |= cat(FAKE_RAPL_LIMIT, 0) < 0;
+        printf("\n");
+        if ( message == 1 ) printf("Content of %s:\n", FAKE_RAPL_WINDOW);
+        printf("fini_powercap_window=");
+        error |= cat(FAKE_RAPL_WINDOW, 0) < 0;
+        printf("\n");
+        executed_tests &= ~TEST_POWERCAP;
+    }
+
+    if ( executed_tests & TEST_MEMPOLICY )
+    {
+        if ( message == 1 ) { printf("Test mempolicy\n"); printf("Content of %s:\n", FAKE_NUMA_BALANCING); }
+        printf("fini_mempolicy_numa_balancing=");
+        error |= cat(FAKE_NUMA_BALANCING, 0) < 0;
+        printf("\n");
+        executed_tests &= ~TEST_MEMPOLICY;
+    }
+
     /* give back an good error code */
     return error;
 }
@@ -27,6 +27,67 @@ GREEN=$(tput setaf 2)
 NORMAL=$(tput sgr0)
 COL=$(tput cols)
 
+fake_sys() {
+    ## Function to create a fake sysfs tree that is used as sysfs_root, so that
+    ## the knobs which write to sysfs, procfs or msr devices can be tested
+
+    root="$(pwd)/fake_sys"
+    # at least two cpus, see the msr registers below
+    nr_cpus=$(nproc --all)
+    [ $nr_cpus -lt 2 ] && nr_cpus=2
+
+    mkdir -p $root/sys/devices/system/cpu
+    echo "0-$(($nr_cpus-1))" > $root/sys/devices/system/cpu/possible
+    for cpu in $(seq 0 $(($nr_cpus-1))); do
+	mkdir -p $root/sys/devices/system/cpu/cpu$cpu/topology
+	echo 1 > $root/sys/devices/system/cpu/cpu$cpu/online
+	echo 0 > $root/sys/devices/system/cpu/cpu$cpu/topology/physical_package_id
+	echo 0 > $root/sys/devices/system/cpu/cpu$cpu/topology/die_id
+	echo $cpu > $root/sys/devices/system/cpu/cpu$cpu/topology/core_id
+	# a sparse file of zeros, the register address is the offset
+	mkdir -p $root/dev/cpu/$cpu
+	truncate -s 4096 $root/dev/cpu/$cpu/msr
+	# set a bit of MSR 0x1a4 that must not be touched by the masked writes
+	printf '\x20' | dd of=$root/dev/cpu/$cpu/msr bs=1 seek=$((0x1a4)) conv=notrunc status=none
+	# registers overlap in the file, IA32_PERF_CTL (0x199) is tested on cpu 0
+	# and IA32_CLOCK_MODULATION (0x19a) on cpu 1
+	if [ $cpu -eq 0 ]; then
+	    # the ratio of the original frequency in bits 15:8
+	    printf "\\x$(printf %02x $(($fini_dvfs_perf_ctl >> 8)))" | \
+		dd of=$root/dev/cpu/$cpu/msr bs=1 seek=$((0x199 + 1)) conv=notrunc status=none
+	elif [ $cpu -eq 1 ]; then
+	    # a bit that must not be touched by the masked writes
+	    printf '\x20' | dd of=$root/dev/cpu/$cpu/msr bs=1 seek=$((0x19a)) conv=notrunc status=none
+	fi
+	# every cpu has its own cpufreq policy
+	freq_dir=$root/sys/devices/system/cpu/cpu$cpu/cpufreq
+	mkdir -p $freq_dir
+	echo $cpu > $freq_dir/related_cpus
+	echo $(seq 1000000 100000 2500000) > $freq_dir/scaling_available_frequencies
+	echo $fini_dvfs_governor > $freq_dir/scaling_governor
+	echo "<unsupported>" > $freq_dir/scaling_setspeed
+	echo 1000000 > $freq_dir/scaling_min_freq
+	echo 2500000 > $freq_dir/scaling_max_freq
+    done
+
+    # the msr backend of dvfs is only used on Intel processors
+    mkdir -p $root/proc
+    printf 'processor\t: 0\nvendor_id\t: GenuineIntel\n' > $root/proc/cpuinfo
+
+    # a single RAPL zone for package 0
+    mkdir -p $root/sys/class/powercap/intel-rapl:0
+    echo "package-0" > $root/sys/class/powercap/intel-rapl:0/name
+    echo $fini_powercap_package > $root/sys/class/powercap/intel-rapl:0/constraint_0_power_limit_uw
+    echo $fini_powercap_window > $root/sys/class/powercap/intel-rapl:0/constraint_0_time_window_us
+
+    # a single NUMA node with all cpus and numa_balancing
+    mkdir -p $root/sys/devices/system/node/node0
+    echo 0 > $root/sys/devices/system/node/online
+    echo "0-$(($nr_cpus-1))" > $root/sys/devices/system/node/node0/cpulist
+    mkdir -p $root/proc/sys/kernel
+    echo $fini_mempolicy_numa_balancing > $root/proc/sys/kernel/numa_balancing
+}
+
 config() {
     ## Function to create the config file from the given values so that we can proof
     ## if them applied the right way
@@ -92,11 +153,53 @@ config() {
     export bin_x86_adapt_option="x86_adapt_Intel_Clock_Modulation"
     export bin_x86_adapt_before=19
     export bin_x86_adapt_after=21
+    # the msr test writes the lowest four bits, bit 5 is set in the fake msr
+    bin_msr_before=5
+    bin_msr_after=3
+    export bin_msr_before_value=$((0x20 | $bin_msr_before))
+    export bin_msr_after_value=$((0x20 | $bin_msr_after))
+    # duty cycles in percent, 50 % and 25 % have the same bits for 8 and 16
+    # steps: enable bit (0x10) and 8/16 or 4/16 of the cycle
+    bin_clock_mod_before=50
+    bin_clock_mod_after=25
+    export bin_clock_mod_before_value=$((0x20 | 0x18))
+    export bin_clock_mod_after_value=$((0x20 | 0x14))
+    # power limit in uW and time window in us of the package
+    export bin_powercap_package_before=80000000
+    export bin_powercap_package_after=120000000
+    export bin_powercap_window_before=10000
+    # MPOL_INTERLEAVE is 3, the previous policy (MPOL_DEFAULT) is restored
+    bin_mempolicy_before="interleave"
+    export bin_mempolicy_mode_before=3
+    export bin_mempolicy_mode_after=0
+    # numa_balancing is only set while the thread is in the region
+    export bin_mempolicy_numa_balancing_before=1
+    export bin_mempolicy_numa_balancing_after=0
+
+    ## after adapt_close()
+    # the original value of the fake msr has to be restored
+    export fini_msr=$((0x20))
+    export fini_clock_mod=$((0x20))
+    # the original limit and window of the fake powercap zone
+    export fini_powercap_package=150000000
+    export fini_powercap_window=28000
+    export fini_mempolicy_numa_balancing=0
+    # IA32_PERF_CTL with a ratio of 10 (1 GHz) and the governor
+    export fini_dvfs_perf_ctl=$((0x0a00))
+    export fini_dvfs_governor=performance
+
+    # the fake tree has to exist before the test starts
+    fake_sys
 
     ## create config
     if [ ! -f $(pwd)/example_config ]; then
 	# build config with individual settings
 	cat << EOF > $(pwd)/example_config
+# msr, sysfs and procfs writes go to the fake tree
+sysfs_root = "$(pwd)/fake_sys";
+# frequencies are written to IA32_PERF_CTL of the fake msr device
+dvfs_backend = "msr";
+
 init:
 {
     # no initial settings
@@ -164,6 +267,45 @@ binary_0:
 	${bin_x86_adapt_option}_after=$bin_x86_adapt_after;
 
     };
+
+    # msrs of the fake msr device
+    function_4:
+    {
+	name="test_msr";
+	# set the prefetcher bits (lowest four bits) of MSR 0x1a4
+	msr_0:
+	{
+	    address=0x1a4;
+	    mask=0xf;
+	    before=$bin_msr_before;
+	    after=$bin_msr_after;
+	};
+    };
+
+    # clock modulation via the fake msr device
+    function_5:
+    {
+	name="test_clock_mod";
+	clock_mod_before=$bin_clock_mod_before;
+	clock_mod_after=$bin_clock_mod_after;
+    };
+
+    # power limits of the fake powercap zone
+    function_6:
+    {
+	name="test_powercap";
+	powercap_package_before=$bin_powercap_package_before;
+	powercap_package_window_before=$bin_powercap_window_before;
+	powercap_package_after=$bin_powercap_package_after;
+    };
+
+    # memory policy of the thread and numa_balancing of the fake tree
+    function_7:
+    {
+	name="test_mempolicy";
+	mempolicy_before="$bin_mempolicy_before";
+	mempolicy_numa_balancing=$bin_mempolicy_numa_balancing_before;
+    };
 };
 EOF
 
@@ -261,18 +403,13 @@ build() {
 	# if we haven't such a nice environment we make the decision for you
 	echo "No build directory was found so I will try to compile on my own with decent flags"
 	mkdir ../build && cd ../build
-	if [[ $@ =~ "testsys" || ( $@ =~ "x86_adapt" && $@ =~ "dvfs" ) ]]; then
-	    # on our testsystem we have sudo and can use cpufreq
+	# dvfs writes to the fake tree, so it needs no further libraries
+	if [[ $@ =~ "testsys" || $@ =~ "x86_adapt" ]]; then
+	    # on our testsystem we can use x86_adapt
 	    cmake -DCMAKE_BUILD_TYPE=Debug -DXA_INC=$PWDX/x86_adapt/library/include -DXA_LIB=$PWDX/x86_adapt/build ../
 	    status=$(($status + $?))
-	elif [[ $@ =~ "x86_adapt" ]]; then
-	    cmake -DCMAKE_BUILD_TYPE=Debug -DNO_CPUFREQ=yes -DXA_INC=$PWDX/x86_adapt/library/include -DXA_LIB=$PWDX/x86_adapt/build ../
-	    status=$(($status + $?))
-	elif [[ $@ =~ "dvfs" ]]; then
-	    cmake -DCMAKE_BUILD_TYPE=Debug -DNO_X86_ADAPT=yes ../
-	    status=$(($status + $?))
 	else
-	    cmake -DCMAKE_BUILD_TYPE=Debug -DNO_X86_ADAPT=yes -DNO_CPUFREQ=yes ../
+	    cmake -DCMAKE_BUILD_TYPE=Debug -DNO_X86_ADAPT=yes ../
 	    status=$(($status + $?))
 	fi
 	cmake --build .
@@ -350,7 +487,10 @@ run() {
     else
 	# info if we have no sudo
 	echo "Sudo is not available. So need the right permissions to set the frequency"
-	ADAPT_CONFIG_FILE="$(pwd)/example_config" LD_LIBRARY_PATH="$(pwd)/" ./test $bin_file_name $bin_x86_adapt_option "$@"
+	# init settings of dvfs are applied to the current cpu
+	pin=""
+	$(which taskset > /dev/null 2>&1) && pin="taskset -c 0"
+	ADAPT_CONFIG_FILE="$(pwd)/example_config" LD_LIBRARY_PATH="$(pwd)/" $pin ./test $bin_file_name $bin_x86_adapt_option "$@"
 	status=$(($status + $?))
     fi
     echo "======================="; echo "Done"; echo
@@ -365,6 +505,8 @@ clean() {
     rm test
     # test file
     rm $bin_file_name
+    # fake sysfs tree
+    rm -r fake_sys
     # header file
     rm adapt.h
     # libraries
@@ -390,7 +532,7 @@ evaluate() {
     ## Function to check the stdout log if everything gone right
 
     # loop over all of our created variables
-    for var in $(printenv | grep -e init_ -e def_ -e bin_); do
+    for var in $(printenv | grep -e init_ -e def_ -e bin_ -e fini_); do
 	# save the setting name
 	name=$(echo $var | cut -d '=' -f 1)
 	# and the correspondent value
@@ -448,7 +590,7 @@ if [ "$1" = "" ]; then
     # pipe the output to /dev/null
     # so only the fail or sucess of the evaluate() is printed
     until_run_no_output $@ && \
-    run machine dct file >run.log 2>/dev/null && \
+    run machine dct dvfs file msr clock_mod powercap mempolicy >run.log 2>/dev/null && \
     evaluate run.log  && \
     clean log conf
 elif [ "$1" = "travis" ]; then